@@ -16,6 +16,13 @@ workspace "LinkVue"
 
 outputdir = "%{cfg.buildcfg}-%{cfg.system}-%{cfg.architecture}"
 
+-- premake5 --count-allocations vs2022: counts heap allocations per frame and per subsystem
+newoption
+{
+	trigger = "count-allocations",
+	description = "Count heap allocations per frame and per subsystem (LV_COUNT_ALLOCATIONS)"
+}
+
 -- Include directories relative to the root folder (solution directory)
 IncludeDir = {}
 IncludeDir["GLFW"] = "LinkVue/vendor/GLFW/include"
@@ -32,7 +39,9 @@ group "Dependencies"
 group ""
 
 
-project "LinkVue"
+-- Settings every project in the solution shares; call right after project.
+-- Leaves the filter reset, so what follows applies to every configuration.
+function linkvueProject()
 	location "LinkVue"
 	kind "ConsoleApp"
 	language "C++"
@@ -42,29 +51,9 @@ project "LinkVue"
 	targetdir ("bin/" .. outputdir .. "/%{prj.name}")
 	objdir ("bin-int/" .. outputdir .. "/%{prj.name}")
 
-	files
-	{
-		"./LinkVue/Source/**.h",
-		"./LinkVue/Source/**.cpp"
-	}
-
 	includedirs
 	{
 		"$(ProjectDir)Source",
-		"$(ProjectDir)vendor/spdlog/include",
-		"$(ProjectDir)%{IncludeDir.yaml_cpp}",
-		"$(SolutionDir)%{IncludeDir.GLFW}",
-		"$(SolutionDir)%{IncludeDir.Glad}",
-		"$(SolutionDir)%{IncludeDir.ImGui}",
-		-- "$(SolutionDir)%{IncludeDir.GameNetworkingSockets}"
-	}
-
-	links 
-	{
-		"GLFW",
-		-- "yaml_cpp",
-		"Glad",
-		"ImGui",
 	}
 
 	filter "system:windows"
@@ -74,18 +63,6 @@ project "LinkVue"
 	filter "system:linux"
 		defines { "LV_PLATFORM_LINUX" }
 
-	filter { "system:windows", "configurations:Debug" }	
-		links
-		{
-			"$(ProjectDir)vendor/yaml-cpp/bin/Debug-windows-x86_64/yaml-cpp/yaml-cpp.lib"
-		}
-  
-	filter { "system:windows", "configurations:Release or configurations:Dist" }	
-		links
-		{
-			"$(ProjectDir)vendor/yaml-cpp/bin/Release-windows-x86_64/yaml-cpp/yaml-cpp.lib"
-		}
-
 	filter "configurations:Debug"
 		defines { "LV_DEBUG" }
 		runtime "Debug"
@@ -102,3 +79,127 @@ project "LinkVue"
 		runtime "Release"
 		optimize "On"
 		symbols "Off"
+
+	filter {}
+end
+
+-- For projects that encode or decode ops
+function linkYamlCpp()
+	includedirs
+	{
+		"$(ProjectDir)vendor/spdlog/include",
+		"$(ProjectDir)%{IncludeDir.yaml_cpp}",
+	}
+
+	filter { "system:windows", "configurations:Debug" }	
+		links
+		{
+			"$(ProjectDir)vendor/yaml-cpp/bin/Debug-windows-x86_64/yaml-cpp/yaml-cpp.lib"
+		}
+  
+	filter { "system:windows", "configurations:Release or configurations:Dist" }	
+		links
+		{
+			"$(ProjectDir)vendor/yaml-cpp/bin/Release-windows-x86_64/yaml-cpp/yaml-cpp.lib"
+		}
+
+	filter {}
+end
+
+-- For projects that draw with ImGui and OpenGL
+function linkGraphics()
+	includedirs
+	{
+		"$(SolutionDir)%{IncludeDir.GLFW}",
+		"$(SolutionDir)%{IncludeDir.Glad}",
+		"$(SolutionDir)%{IncludeDir.ImGui}",
+		-- "$(SolutionDir)%{IncludeDir.GameNetworkingSockets}"
+	}
+
+	links 
+	{
+		"GLFW",
+		-- "yaml_cpp",
+		"Glad",
+		"ImGui",
+	}
+end
+
+-- The board and what it is built on, without the window, networking or UI around it
+BoardSources =
+{
+	"./LinkVue/Source/Whiteboard.cpp",
+	"./LinkVue/Source/BoardDocument.cpp",
+	"./LinkVue/Source/BoardDigest.cpp",
+	"./LinkVue/Source/BoardPager.cpp",
+	"./LinkVue/Source/BlobStore.cpp",
+	"./LinkVue/Source/Clipboard.cpp",
+	"./LinkVue/Source/Exporter.cpp",
+	"./LinkVue/Source/Geometry.cpp",
+	"./LinkVue/Source/ImageCache.cpp",
+	"./LinkVue/Source/Metrics.cpp",
+	"./LinkVue/Source/PngWriter.cpp",
+	"./LinkVue/Source/Protocol.cpp",
+	"./LinkVue/Source/SessionRecording.cpp",
+	"./LinkVue/Source/Shapes.cpp",
+	"./LinkVue/Source/StrokeRenderer.cpp",
+	"./LinkVue/Source/StrokeTessellator.cpp",
+	"./LinkVue/Source/ThreadPool.cpp",
+}
+
+
+project "LinkVue"
+	linkvueProject()
+	linkYamlCpp()
+	linkGraphics()
+
+	files
+	{
+		"./LinkVue/Source/**.h",
+		"./LinkVue/Source/**.cpp"
+	}
+
+	filter "options:count-allocations"
+		defines { "LV_COUNT_ALLOCATIONS" }
+
+
+-- Headless replay of session recordings: LinkVueReplay <recording> [--speed <factor>]
+project "LinkVueReplay"
+	linkvueProject()
+	linkYamlCpp()
+	linkGraphics()
+
+	files
+	{
+		"./LinkVue/Source/**.h",
+		BoardSources,
+		"./LinkVue/Tools/Replay/**.cpp"
+	}
+
+
+-- Anti-entropy repair bandwidth versus board size: LinkVueDigestBench [--max <strokes>] [--seed <n>]
+project "LinkVueDigestBench"
+	linkvueProject()
+	linkYamlCpp()
+
+	files
+	{
+		"./LinkVue/Source/**.h",
+		"./LinkVue/Source/BoardDigest.cpp",
+		"./LinkVue/Source/Geometry.cpp",
+		"./LinkVue/Source/InterestManager.cpp",
+		"./LinkVue/Source/Protocol.cpp",
+		"./LinkVue/Tools/DigestBench/**.cpp"
+	}
+
+-- Point kernels at each SIMD level versus scalar, checked bit for bit: LinkVueGeometryBench [--points <n>] [--seed <n>]
+project "LinkVueGeometryBench"
+	linkvueProject()
+
+	files
+	{
+		"./LinkVue/Source/Geometry.h",
+		"./LinkVue/Source/Stroke.h",
+		"./LinkVue/Source/Geometry.cpp",
+		"./LinkVue/Tools/GeometryBench/**.cpp"
+	}
@@ -0,0 +1,98 @@
+#include "AllocationStats.h"
+#include "Metrics.h"
+
+#include <cstdlib>
+#include <new>
+
+const char* getAllocationSubsystemName(AllocationSubsystem subsystem)
+{
+    switch (subsystem) {
+    case AllocationSubsystem::Other: return "other";
+    case AllocationSubsystem::Network: return "network";
+    case AllocationSubsystem::Inbound: return "inbound";
+    case AllocationSubsystem::Board: return "board";
+    case AllocationSubsystem::Render: return "render";
+    case AllocationSubsystem::Interface: return "interface";
+    case AllocationSubsystem::Count: break;
+    }
+    return "";
+}
+
+AllocationCounts AllocationCounts::since(const AllocationCounts& earlier) const
+{
+    AllocationCounts difference;
+    for (size_t i = 0; i < ALLOCATION_SUBSYSTEMS; i++) {
+        difference.allocations[i] = allocations[i] - earlier.allocations[i];
+        difference.bytes[i] = bytes[i] - earlier.bytes[i];
+    }
+    return difference;
+}
+
+#ifdef LV_COUNT_ALLOCATIONS
+
+namespace {
+    // Constant-initialized, so allocations made before main are counted safely
+    thread_local AllocationSubsystem t_Subsystem = AllocationSubsystem::Other;
+    std::array<ShardedCounter, ALLOCATION_SUBSYSTEMS> g_Allocations;
+    std::array<ShardedCounter, ALLOCATION_SUBSYSTEMS> g_Bytes;
+
+    void* countedAllocate(std::size_t size)
+    {
+        size_t subsystem = static_cast<size_t>(t_Subsystem);
+        g_Allocations[subsystem].add();
+        g_Bytes[subsystem].add(size);
+        void* memory = std::malloc(size == 0 ? 1 : size);
+        if (memory == nullptr) {
+            throw std::bad_alloc();
+        }
+        return memory;
+    }
+}
+
+AllocationScope::AllocationScope(AllocationSubsystem subsystem)
+    : m_Previous(t_Subsystem)
+{
+    t_Subsystem = subsystem;
+}
+
+AllocationScope::~AllocationScope()
+{
+    t_Subsystem = m_Previous;
+}
+
+bool isCountingAllocations()
+{
+    return true;
+}
+
+AllocationCounts getAllocationCounts()
+{
+    AllocationCounts counts;
+    for (size_t i = 0; i < ALLOCATION_SUBSYSTEMS; i++) {
+        counts.allocations[i] = g_Allocations[i].value();
+        counts.bytes[i] = g_Bytes[i].value();
+    }
+    return counts;
+}
+
+// The aligned forms are left to the runtime; nothing on the frame path uses them
+void* operator new(std::size_t size) { return countedAllocate(size); }
+void* operator new[](std::size_t size) { return countedAllocate(size); }
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::size_t) noexcept { std::free(memory); }
+
+#else
+
+bool isCountingAllocations()
+{
+    return false;
+}
+
+AllocationCounts getAllocationCounts()
+{
+    return {};
+}
+
+#endif
@@ -0,0 +1,55 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Heap allocations counted by the subsystem that made them, to keep the per-frame
+// path allocation-free. Counting replaces the global operator new and is only
+// built in with LV_COUNT_ALLOCATIONS (premake --count-allocations); without it
+// scopes cost nothing and every count reads zero.
+enum class AllocationSubsystem : uint8_t {
+    Other,
+    Network,  // Socket threads
+    Inbound,  // Applying received events
+    Board,    // Paging, local ops and other board upkeep
+    Render,   // Canvas input and drawing
+    Interface,// Tool and status windows
+    Count
+};
+
+constexpr size_t ALLOCATION_SUBSYSTEMS = static_cast<size_t>(AllocationSubsystem::Count);
+
+const char* getAllocationSubsystemName(AllocationSubsystem subsystem);
+
+struct AllocationCounts {
+    std::array<uint64_t, ALLOCATION_SUBSYSTEMS> allocations{};
+    std::array<uint64_t, ALLOCATION_SUBSYSTEMS> bytes{};
+
+    // What was counted since earlier was taken
+    AllocationCounts since(const AllocationCounts& earlier) const;
+};
+
+// Whether this build counts at all
+bool isCountingAllocations();
+
+// Totals since the program started, over every thread
+AllocationCounts getAllocationCounts();
+
+// Attributes allocations on this thread to a subsystem until it goes out of scope
+class AllocationScope {
+public:
+#ifdef LV_COUNT_ALLOCATIONS
+    explicit AllocationScope(AllocationSubsystem subsystem);
+    ~AllocationScope();
+#else
+    explicit AllocationScope(AllocationSubsystem) {}
+#endif
+
+    AllocationScope(const AllocationScope&) = delete;
+    AllocationScope& operator=(const AllocationScope&) = delete;
+
+#ifdef LV_COUNT_ALLOCATIONS
+private:
+    AllocationSubsystem m_Previous;
+#endif
+};
@@ -7,7 +7,45 @@
 #include <examples/imgui_impl_glfw.h>
 #include <examples/imgui_impl_opengl3.h>
 #include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <map>
+#include <random>
+#include <unordered_set>
 
+namespace {
+    // How often a client compares its board with the host, and when it gives up on a reply
+    const auto DIGEST_INTERVAL = std::chrono::seconds(5);
+    const auto DIGEST_TIMEOUT = std::chrono::seconds(30);
+
+    // UI thread time spent applying network events per frame; at least one is applied regardless
+    const auto APPLY_BUDGET = std::chrono::milliseconds(4);
+
+    // Strokes of a large batch applied per slice
+    const size_t SLICE_STROKES = 1024;
+
+    // Encoded strokes sent to a client per message, well under the frame limit
+    const size_t MAX_BATCH_BYTES = 4 * 1024 * 1024;
+    static_assert(MAX_BATCH_BYTES < NetworkManager::MAX_MESSAGE_SIZE / 4);
+
+    // End of the batch of strokes starting at begin; a batch has at least one stroke
+    size_t strokeBatchEnd(const std::vector<Stroke>& strokes, size_t begin)
+    {
+        size_t bytes = 0;
+        size_t end = begin;
+        while (end < strokes.size()) {
+            bytes += encodedSizeBound(strokes[end]);
+            if (bytes > MAX_BATCH_BYTES && end > begin) {
+                break;
+            }
+            end++;
+        }
+        return end;
+    }
+
+    // Heap allocations a steady frame may make on the UI thread, in builds that count them
+    const uint64_t FRAME_ALLOCATION_BUDGET = 4;
+}
 
 Application::Application()
     : m_Window(nullptr)
@@ -26,28 +64,518 @@ Application::~Application()
     cleanup();
 }
 
-void Application::handleNetworkMessage(const std::string& message) {
-    std::lock_guard<std::mutex> lock(m_MessageQueueMutex);
-    m_MessageQueue.push_back(message);
-    // Forward the message to whiteboard
-    m_Whiteboard.handleNetworkMessage(message);
+void Application::handleNetworkMessage(ClientId client, std::string_view message) {
+    // The whiteboard is only touched on the UI thread; the queue copies the message into a pooled buffer
+    m_Inbound.push(InboundQueue::Event::Type::Message, client, message);
+}
+
+void Application::handleClientConnection(ClientId client) {
+    std::cout << "Client " << client << " connected to application" << std::endl;
+    m_Inbound.push(InboundQueue::Event::Type::Connected, client);
+}
+
+void Application::handleClientDisconnection(ClientId client) {
+    std::cout << "Client " << client << " disconnected from application" << std::endl;
+    m_Inbound.push(InboundQueue::Event::Type::Disconnected, client);
+}
+
+void Application::processNetworkEvents() {
+    AllocationScope scope(AllocationSubsystem::Inbound);
+
+    // Whatever is left over waits for the next frame, so a burst never stalls drawing
+    auto deadline = std::chrono::steady_clock::now() + APPLY_BUDGET;
+    do {
+        if (m_StreamedStrokes < m_Streaming.strokes.size()) {
+            applyStreamedSlice();
+            continue;
+        }
+        InboundQueue::Event event;
+        if (!m_Inbound.pop(event)) {
+            break;
+        }
+        auto start = std::chrono::steady_clock::now();
+        handleNetworkEvent(event);
+        if (event.type == InboundQueue::Event::Type::Message) {
+            m_MessageLatency.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        m_Inbound.recycle(event);
+    } while (std::chrono::steady_clock::now() < deadline);
+}
+
+void Application::applyStreamedSlice() {
+    BoardOp slice;
+    slice.type = OpType::AddStrokes;
+    size_t end = std::min(m_StreamedStrokes + SLICE_STROKES, m_Streaming.strokes.size());
+    std::move(m_Streaming.strokes.begin() + m_StreamedStrokes, m_Streaming.strokes.begin() + end, std::back_inserter(slice.strokes));
+    m_StreamedStrokes = end;
+    m_Whiteboard.applyRemoteOp(slice);
+    if (m_StreamedStrokes == m_Streaming.strokes.size()) {
+        m_Streaming = BoardOp();
+        m_StreamedStrokes = 0;
+    }
+}
+
+void Application::handleNetworkEvent(InboundQueue::Event& event) {
+    switch (event.type) {
+    case InboundQueue::Event::Type::Connected:
+        if (!m_IsHost && m_Networking) {
+            // Ask to pick up where the last connection left off
+            BoardOp hello;
+            hello.type = OpType::Hello;
+            hello.sessionToken = m_SessionToken;
+            hello.lastSeq = m_LastSeq;
+            m_Networking->sendMessage(encodeOp(hello));
+            m_SessionReady = false;
+            m_AwaitingSnapshot = false;
+            m_PublishedViewport = Rect();
+            m_DigestPending = false;
+        }
+        break;
+
+    case InboundQueue::Event::Type::Disconnected:
+        m_BlobTransfer.removeClient(event.client);
+        if (m_IsHost) {
+            // The client keeps its area of interest in case it comes back
+            m_Sessions.detach(event.client);
+        }
+        else if (!m_Networking || !m_Networking->isConnected()) {
+            m_SessionReady = false;
+        }
+        break;
+
+    case InboundQueue::Event::Type::Message: {
+        // Recorded here rather than on the socket thread so the order matches what was applied
+        m_Recorder.record(RecordKind::Inbound, event.client, event.payload);
+
+        if (!event.decoded) {
+            event.valid = decodeOp(event.payload, event.op);
+        }
+        if (!event.valid) {
+            break;
+        }
+        BoardOp& op = event.op;
+
+        if (op.type == OpType::Hello) {
+            if (m_IsHost) {
+                handleHello(event.client, op);
+            }
+            break;
+        }
+        if (op.type == OpType::Welcome) {
+            if (!m_IsHost) {
+                std::cout << (op.resumed ? "Resumed session " : "Joined session ") << op.sessionToken << std::endl;
+                m_SessionToken = op.sessionToken;
+                // Without a resume the host follows up with a snapshot
+                m_SessionReady = op.resumed;
+                m_AwaitingSnapshot = !op.resumed;
+                m_ResendUnacked = op.resumed;
+            }
+            break;
+        }
+        if (!m_IsHost && op.seq != 0) {
+            if (op.seq <= m_LastSeq) {
+                break; // Already applied before the reconnect
+            }
+            m_LastSeq = op.seq;
+        }
+
+        if (op.type == OpType::Viewport) {
+            if (m_IsHost && m_Networking) {
+                BoardOp missing;
+                missing.type = OpType::AddStrokes;
+                missing.strokes = m_Interest.updateViewport(event.client, op.viewport, m_Whiteboard.publish()->strokes);
+                if (!missing.strokes.empty()) {
+                    sendToClient(event.client, missing);
+                }
+            }
+            break;
+        }
+
+        if (op.type == OpType::DigestQuery || op.type == OpType::StrokeRequest) {
+            if (m_IsHost && m_Networking) {
+                if (op.type == OpType::DigestQuery) {
+                    // Not logged with the session; after a reconnect the client starts over
+                    m_Networking->sendTo(event.client, encodeOp(m_Interest.answerDigestQuery(event.client, op)));
+                }
+                else {
+                    resendStrokes(event.client, op.strokeIds);
+                }
+            }
+            break;
+        }
+        if (op.type == OpType::Digest) {
+            if (!m_IsHost) {
+                handleDigest(op);
+            }
+            break;
+        }
+
+        if (op.type == OpType::BlobRequest || op.type == OpType::BlobChunk) {
+            m_BlobTransfer.handleOp(event.client, op);
+            break;
+        }
+
+        if (!m_IsHost) {
+            if (op.type == OpType::Ack) {
+                m_Whiteboard.acknowledge(op.clientSeq);
+                break;
+            }
+
+            // Pending local edits are kept on top of whatever the host decided
+            if (event.staged) {
+                m_Whiteboard.applyRemoteSnapshot(std::move(*event.staged));
+            }
+            else if (op.type == OpType::AddStrokes && op.strokes.size() > SLICE_STROKES) {
+                m_Streaming = std::move(op);
+                m_StreamedStrokes = 0;
+                applyStreamedSlice();
+            }
+            else {
+                m_Whiteboard.applyRemoteOp(op);
+            }
+            if (op.type == OpType::Snapshot && m_AwaitingSnapshot) {
+                m_AwaitingSnapshot = false;
+                m_SessionReady = true;
+                m_ResendUnacked = true;
+            }
+            break;
+        }
+
+        // A resent op that already made it before a reconnect is only acknowledged again
+        if (op.clientSeq == 0 || m_Sessions.acceptClientOp(event.client, op.clientSeq)) {
+            m_Whiteboard.applyOp(op);
+            // The host keeps every image so it can serve all clients
+            for (const auto& image : op.images) {
+                m_BlobTransfer.want(image.blobHash, image.blobSize, event.client);
+            }
+            m_Interest.markKnown(event.client, op);
+            forwardOp(op, event.client);
+        }
+        if (op.clientSeq != 0) {
+            // Sent in order with the forwarded ops, so the client knows which remote ops came first
+            BoardOp ack;
+            ack.type = OpType::Ack;
+            ack.clientSeq = op.clientSeq;
+            sendToClient(event.client, ack);
+        }
+        break;
+    }
+    }
+}
+
+void Application::forwardOp(const BoardOp& op, ClientId origin) {
+    if (!m_Networking) {
+        return;
+    }
+
+    // Disconnected sessions are still filtered for, so their logs stay complete
+    BoardOp filtered;
+    for (ClientId client : m_Interest.getClients()) {
+        if (client != origin && m_Interest.filterForClient(client, op, filtered)) {
+            sendToClient(client, filtered);
+        }
+    }
+}
+
+void Application::sendToClient(ClientId client, BoardOp& op) {
+    // Too many strokes for one message go out over several; a snapshot carries
+    // the first batch and the rest follow it as additions
+    size_t end = strokeBatchEnd(op.strokes, 0);
+    if (end < op.strokes.size()) {
+        std::vector<Stroke> strokes = std::move(op.strokes);
+        op.strokes.assign(std::make_move_iterator(strokes.begin()), std::make_move_iterator(strokes.begin() + end));
+        sendStamped(client, op);
+
+        BoardOp batch;
+        batch.type = OpType::AddStrokes;
+        for (size_t begin = end; begin < strokes.size(); begin = end) {
+            end = strokeBatchEnd(strokes, begin);
+            batch.strokes.assign(std::make_move_iterator(strokes.begin() + begin), std::make_move_iterator(strokes.begin() + end));
+            sendStamped(client, batch);
+        }
+        return;
+    }
+    sendStamped(client, op);
+}
+
+void Application::sendStamped(ClientId client, BoardOp& op) {
+    std::string message = m_Sessions.stamp(client, op);
+    if (m_Sessions.isConnected(client)) {
+        m_Networking->sendTo(client, message);
+    }
+}
+
+void Application::handleHello(ClientId client, const BoardOp& hello) {
+    if (!m_Networking) {
+        return;
+    }
+
+    ClientId previous = client;
+    std::vector<std::string> replay;
+    SessionManager::Resume result = m_Sessions.attach(client, hello.sessionToken, hello.lastSeq, previous, replay);
+
+    BoardOp welcome;
+    welcome.type = OpType::Welcome;
+    welcome.sessionToken = m_Sessions.getToken(client);
+    welcome.resumed = result == SessionManager::Resume::Replayed;
+    m_Networking->sendTo(client, encodeOp(welcome));
+
+    switch (result) {
+    case SessionManager::Resume::Replayed:
+        // Exactly what the client missed, in the order it was sent
+        m_Interest.renameClient(previous, client);
+        for (const auto& message : replay) {
+            m_Networking->sendTo(client, message);
+        }
+        break;
+
+    case SessionManager::Resume::Snapshot: {
+        // Too far behind for the log: resend the board within its known area
+        m_Interest.renameClient(previous, client);
+        DocumentPtr document = m_Whiteboard.publish();
+        BoardOp snapshot;
+        snapshot.type = OpType::Snapshot;
+        for (const auto& stroke : document->strokes) {
+            snapshot.strokes.push_back(*stroke);
+        }
+        snapshot.images = document->images;
+        snapshot.canvasColor = document->canvasColor;
+        BoardOp filtered;
+        if (m_Interest.filterForClient(client, snapshot, filtered)) {
+            sendToClient(client, filtered);
+        }
+        break;
+    }
+
+    case SessionManager::Resume::NewSession: {
+        // Strokes follow once the client tells us where it is looking
+        m_Interest.addClient(client);
+        BoardOp start;
+        start.type = OpType::Snapshot;
+        start.images = m_Whiteboard.getImages();
+        start.canvasColor = m_Whiteboard.getCanvasColor();
+        sendToClient(client, start);
+        break;
+    }
+    }
+}
+
+bool Application::resendUnacked() {
+    for (const auto& op : m_Whiteboard.getUnackedOps()) {
+        if (!m_Networking->sendMessage(encodeOp(op))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Application::publishViewport() {
+    Rect viewport = m_Whiteboard.getViewportRect();
+    if (viewport.isEmpty()) {
+        return;
+    }
+
+    // Only resend once the view moved or resized by a noticeable fraction
+    float toleranceX = 0.1f * viewport.width();
+    float toleranceY = 0.1f * viewport.height();
+    if (!m_PublishedViewport.isEmpty() &&
+        std::abs(viewport.minX - m_PublishedViewport.minX) < toleranceX &&
+        std::abs(viewport.maxX - m_PublishedViewport.maxX) < toleranceX &&
+        std::abs(viewport.minY - m_PublishedViewport.minY) < toleranceY &&
+        std::abs(viewport.maxY - m_PublishedViewport.maxY) < toleranceY) {
+        return;
+    }
+
+    BoardOp op;
+    op.type = OpType::Viewport;
+    op.viewport = viewport;
+    if (m_Networking->sendMessage(encodeOp(op))) {
+        m_PublishedViewport = viewport;
+    }
+}
+
+void Application::checkDigest() {
+    // Only compare once our own edits have all landed, or the boards differ by design
+    auto now = std::chrono::steady_clock::now();
+    if (now - m_DigestSent < (m_DigestPending ? DIGEST_TIMEOUT : DIGEST_INTERVAL) ||
+        !m_Whiteboard.getUnackedOps().empty()) {
+        return;
+    }
+
+    BoardOp query;
+    query.type = OpType::DigestQuery;
+    query.digestNodes.push_back(BoardDigest::ROOT);
+    query.digestHashes.push_back(m_Whiteboard.getDigest().hashOf(BoardDigest::ROOT));
+    sendDigestQuery(query);
+}
+
+void Application::sendDigestQuery(BoardOp& query) {
+    m_DigestLeaves.clear();
+    for (uint32_t node : query.digestNodes) {
+        if (BoardDigest::isLeaf(node)) {
+            m_DigestLeaves.push_back(node);
+        }
+    }
+    m_DigestPending = m_Networking->sendMessage(encodeOp(query));
+    m_DigestSent = std::chrono::steady_clock::now();
+}
+
+void Application::handleDigest(const BoardOp& reply) {
+    if (!m_DigestPending) {
+        return;
+    }
+    m_DigestPending = false;
+    if (!m_Whiteboard.getUnackedOps().empty()) {
+        return; // We edited since asking; the next round starts over
+    }
+
+    // The reply comes after every op the host sent before it, so what still
+    // differs now is real
+    const BoardDigest& digest = m_Whiteboard.getDigest();
+    std::vector<uint64_t> wanted;
+    std::vector<uint64_t> extra;
+    if (!m_DigestLeaves.empty()) {
+        digest.compare(m_DigestLeaves, reply.strokeIds, reply.strokeHashes, wanted, extra);
+    }
+    if (!wanted.empty() || !extra.empty()) {
+        std::cout << "Board diverged from the host: fetching " << wanted.size()
+            << " strokes, dropping " << extra.size() << std::endl;
+    }
+    if (!extra.empty()) {
+        BoardOp remove;
+        remove.type = OpType::RemoveStrokes;
+        remove.strokeIds = std::move(extra);
+        m_Whiteboard.applyRemoteOp(remove);
+    }
+    if (!wanted.empty()) {
+        BoardOp request;
+        request.type = OpType::StrokeRequest;
+        request.strokeIds = std::move(wanted);
+        m_Networking->sendMessage(encodeOp(request));
+    }
+
+    BoardOp query;
+    query.type = OpType::DigestQuery;
+    for (uint32_t node : digest.differing(reply.digestNodes, reply.digestHashes)) {
+        query.digestNodes.push_back(node);
+        query.digestHashes.push_back(digest.hashOf(node));
+    }
+    if (!query.digestNodes.empty()) {
+        sendDigestQuery(query);
+    }
 }
 
-void Application::handleClientConnection() {
-    std::cout << "Client connected to application" << std::endl;
-    // Add any specific client connection handling here
+void Application::resendStrokes(ClientId client, const std::vector<uint64_t>& ids) {
+    // What the board no longer has, the client should not have either. Paged
+    // out strokes follow once they have been read back.
+    BoardOp found;
+    found.type = OpType::AddStrokes;
+    BoardOp gone;
+    gone.type = OpType::RemoveStrokes;
+    std::vector<uint64_t> paged;
+    m_Whiteboard.findStrokes(ids, found.strokes, gone.strokeIds, paged);
+    for (uint64_t id : paged) {
+        std::vector<ClientId>& clients = m_PendingResends[id];
+        if (std::find(clients.begin(), clients.end(), client) == clients.end()) {
+            clients.push_back(client);
+        }
+    }
+    sendResent(client, found, gone);
 }
 
-void Application::handleClientDisconnection() {
-    std::cout << "Client disconnected from application" << std::endl;
-    // Add any specific client disconnection handling here
+void Application::resendFetched() {
+    std::vector<Stroke> fetched;
+    std::vector<uint64_t> missing;
+    m_Whiteboard.takeFetched(fetched, missing);
+    if (fetched.empty() && missing.empty()) {
+        return;
+    }
+
+    std::map<ClientId, std::pair<BoardOp, BoardOp>> replies; // Found and gone, per client
+    for (auto& stroke : fetched) {
+        auto pending = m_PendingResends.find(stroke.id);
+        if (pending == m_PendingResends.end()) {
+            continue;
+        }
+        for (ClientId client : pending->second) {
+            replies[client].first.strokes.push_back(stroke);
+        }
+        m_PendingResends.erase(pending);
+    }
+    for (uint64_t id : missing) {
+        auto pending = m_PendingResends.find(id);
+        if (pending == m_PendingResends.end()) {
+            continue;
+        }
+        for (ClientId client : pending->second) {
+            replies[client].second.strokeIds.push_back(id);
+        }
+        m_PendingResends.erase(pending);
+    }
+    for (auto& [client, ops] : replies) {
+        ops.first.type = OpType::AddStrokes;
+        ops.second.type = OpType::RemoveStrokes;
+        sendResent(client, ops.first, ops.second);
+    }
+}
+
+void Application::sendResent(ClientId client, BoardOp& found, BoardOp& gone) {
+    for (BoardOp* op : { &found, &gone }) {
+        if (!op->strokes.empty() || !op->strokeIds.empty()) {
+            m_Interest.markKnown(client, *op);
+            sendToClient(client, *op);
+        }
+    }
+}
+
+void Application::pumpBlobs() {
+    if (!m_IsHost) {
+        // Clients only fetch what is on screen
+        for (const auto& image : m_Whiteboard.getMissingBlobs(true)) {
+            m_BlobTransfer.want(image.blobHash, image.blobSize, NetworkManager::HOST_ID);
+        }
+    }
+    m_BlobTransfer.pump(*m_Networking);
+}
+
+std::string Application::renderMetrics()
+{
+    MetricsWriter writer;
+    writer.histogram("linkvue_message_apply_seconds", "Time to decode and apply one received message on the UI thread", m_MessageLatency);
+    writer.gauge("linkvue_inbound_queue_depth", "Network events waiting for the UI thread", double(m_Inbound.size()));
+    {
+        std::lock_guard<std::mutex> lock(m_NetworkingMutex);
+        if (m_Networking) {
+            m_Networking->writeMetrics(writer);
+        }
+    }
+    m_Whiteboard.writeMetrics(writer);
+    if (isCountingAllocations()) {
+        AllocationCounts counts = getAllocationCounts();
+        writer.family("linkvue_allocations_total", "counter", "Heap allocations by subsystem");
+        for (size_t i = 0; i < ALLOCATION_SUBSYSTEMS; i++) {
+            writer.sample("linkvue_allocations_total", double(counts.allocations[i]),
+                std::string("subsystem=\"") + getAllocationSubsystemName(static_cast<AllocationSubsystem>(i)) + "\"");
+        }
+        writer.family("linkvue_allocated_bytes_total", "counter", "Heap bytes allocated by subsystem");
+        for (size_t i = 0; i < ALLOCATION_SUBSYSTEMS; i++) {
+            writer.sample("linkvue_allocated_bytes_total", double(counts.bytes[i]),
+                std::string("subsystem=\"") + getAllocationSubsystemName(static_cast<AllocationSubsystem>(i)) + "\"");
+        }
+    }
+    return writer.text();
 }
 
 void Application::cleanup()
 {
+    m_MetricsServer.stop();
     stopNetworkingThread();
+    if (m_Recorder.isOpen()) {
+        m_Recorder.close(m_Whiteboard.getChecksum());
+    }
 
     if (m_Window) {
+        m_Whiteboard.shutdown();
         ImGui_ImplOpenGL3_Shutdown();
         ImGui_ImplGlfw_Shutdown();
         ImGui::DestroyContext();
@@ -79,18 +607,24 @@ void Application::startNetworkingThread()
             auto newNetworking = std::make_unique<NetworkManager>(m_Port);
 
             // Set up callbacks
-            newNetworking->setOnMessageReceived([this](const std::string& msg) {
-                handleNetworkMessage(msg);
+            newNetworking->setOnMessageReceived([this](ClientId client, std::string_view msg) {
+                handleNetworkMessage(client, msg);
+                });
+
+            newNetworking->setOnClientConnected([this](ClientId client) {
+                handleClientConnection(client);
                 });
 
-            newNetworking->setOnClientConnected([this]() {
-                handleClientConnection();
+            newNetworking->setOnClientDisconnected([this](ClientId client) {
+                handleClientDisconnection(client);
                 });
 
-            newNetworking->setOnClientDisconnected([this]() {
-                handleClientDisconnection();
+            newNetworking->setOnMessageSent([this](ClientId client, const std::string& msg) {
+                m_Recorder.record(RecordKind::Outbound, client, msg);
                 });
 
+            newNetworking->setCompression(m_Compress);
+
             bool initialized = false;
             if (m_IsHost) {
                 initialized = newNetworking->initializeHost();
@@ -99,7 +633,8 @@ void Application::startNetworkingThread()
                 initialized = newNetworking->initializeClient(m_IP);
             }
 
-            if (initialized) {
+            // A client that cannot reach the host yet keeps trying below
+            if (initialized || !m_IsHost) {
                 {
                     std::lock_guard<std::mutex> lock(m_NetworkingMutex);
                     m_Networking = std::move(newNetworking);
@@ -108,23 +643,38 @@ void Application::startNetworkingThread()
                 m_NetworkingThreadRunning = true;
 
                 // Start the network manager
-                m_Networking->start();
+                if (initialized) {
+                    m_Networking->start();
+                }
+
+                // Messages are handled on the UI thread; this thread only redials a lost host,
+                // backing off exponentially with some jitter so clients do not retry in lockstep
+                const auto minBackoff = std::chrono::milliseconds(250);
+                const auto maxBackoff = std::chrono::milliseconds(8000);
+                auto backoff = minBackoff;
+                auto nextAttempt = std::chrono::steady_clock::now() + (initialized ? std::chrono::milliseconds(0) : backoff);
+                std::minstd_rand jitter(std::random_device{}());
 
-                // Network message loop
                 while (m_NetworkingThreadRunning) {
-                    // Process any pending messages in the queue
-                    std::vector<std::string> messages;
-                    {
-                        std::lock_guard<std::mutex> lock(m_MessageQueueMutex);
-                        messages.swap(m_MessageQueue);
+                    std::this_thread::sleep_for(std::chrono::milliseconds(16));
+                    if (m_IsHost || m_Networking->isConnected()) {
+                        backoff = minBackoff;
+                        continue;
                     }
 
-                    // Process messages
-                    for (const auto& msg : messages) {
-                        m_Whiteboard.handleNetworkMessage(msg);
+                    auto now = std::chrono::steady_clock::now();
+                    if (now < nextAttempt) {
+                        continue;
+                    }
+                    if (m_Networking->reconnect()) {
+                        std::cout << "Reconnected to host" << std::endl;
+                        backoff = minBackoff;
+                    }
+                    else {
+                        auto spread = std::chrono::milliseconds(jitter() % (backoff.count() / 2 + 1));
+                        nextAttempt = now + backoff + spread;
+                        backoff = std::min(backoff * 2, maxBackoff);
                     }
-
-                    std::this_thread::sleep_for(std::chrono::milliseconds(16));
                 }
             }
             else {
@@ -161,7 +711,28 @@ void Application::renderModeSelectionWindow() {
     ImGui::InputInt("Port", &m_Port);
     m_Port = std::clamp(m_Port, 1024, 65535);
 
+    ImGui::Checkbox("Compress Traffic", &m_Compress);
+
+    ImGui::Checkbox("Serve Metrics", &m_ServeMetrics);
+    if (m_ServeMetrics) {
+        ImGui::InputInt("Metrics Port", &m_MetricsPort);
+        m_MetricsPort = std::clamp(m_MetricsPort, 1024, 65535);
+    }
+
+    ImGui::Checkbox("Record Session", &m_RecordSession);
+    if (m_RecordSession) {
+        ImGui::InputText("Recording File", m_RecordPath, sizeof(m_RecordPath));
+    }
+
     if (ImGui::Button("Start")) {
+        m_Whiteboard.setPredicting(!m_IsHost);
+        m_Inbound.setStageSnapshots(!m_IsHost);
+        if (m_RecordSession) {
+            m_Recorder.open(m_RecordPath);
+        }
+        if (m_ServeMetrics) {
+            m_MetricsServer.start(m_MetricsPort, [this]() { return renderMetrics(); });
+        }
         m_ShowModeSelection = false;
         startNetworkingThread();
     }
@@ -170,34 +741,162 @@ void Application::renderModeSelectionWindow() {
 }
 
 void Application::renderMainApplication() {
-    // Check if we have any network messages to process
-    std::vector<std::string> messages;
-    {
-        std::lock_guard<std::mutex> lock(m_MessageQueueMutex);
-        messages.swap(m_MessageQueue);
-    }
+    // Apply whatever arrived from the network since the last frame
+    processNetworkEvents();
 
-    // Process any pending messages
-    for (const auto& msg : messages) {
-        m_Whiteboard.handleNetworkMessage(msg);
+    // Keep what anyone looks at in memory and page the rest of a large board out
+    {
+        AllocationScope scope(AllocationSubsystem::Board);
+        if (m_IsHost) {
+            std::pmr::vector<Rect> areas(&m_FrameArena);
+            m_Interest.getAreas(areas);
+            m_Whiteboard.setActiveAreas(areas);
+        }
+        m_Whiteboard.updatePaging();
     }
 
     // Render whiteboard components
-    m_Whiteboard.renderCanvas();
-    m_Whiteboard.drawToolWindow();
+    {
+        AllocationScope scope(AllocationSubsystem::Render);
+        m_Whiteboard.renderCanvas();
+    }
+    {
+        AllocationScope scope(AllocationSubsystem::Interface);
+        m_Whiteboard.drawToolWindow();
+        renderInboundProgress();
+        renderAllocationStats();
+    }
 
-    // If you need to send whiteboard updates over the network
+    // Send local edits as ops; the host routes them by area of interest
+    AllocationScope scope(AllocationSubsystem::Board);
+    std::vector<BoardOp>& ops = m_LocalOps;
+    m_Whiteboard.takeLocalOps(ops);
+    if (m_Recorder.isOpen()) {
+        for (const auto& op : ops) {
+            m_Recorder.record(RecordKind::LocalOp, NetworkManager::HOST_ID, encodeOp(op));
+        }
+    }
+    std::vector<StrokePtr> moved = m_Whiteboard.takeMoved();
     if (m_NetworkingInitialized && m_Networking) {
-        std::string update = m_Whiteboard.getUpdateData();
-        if (!update.empty()) {
-            if (m_IsHost) {
-                m_Networking->broadcastMessage(update);
+        if (m_IsHost) {
+            for (const auto& op : ops) {
+                forwardOp(op, NetworkManager::HOST_ID);
             }
-            else {
-                m_Networking->sendMessage(update);
+            for (ClientId client : m_Sessions.expire()) {
+                m_Interest.removeClient(client);
+            }
+            resendFetched();
+            // Strokes moved into a client's area that it was never sent
+            if (!moved.empty()) {
+                for (ClientId client : m_Interest.getClients()) {
+                    BoardOp missing;
+                    missing.type = OpType::AddStrokes;
+                    missing.strokes = m_Interest.refresh(client, moved);
+                    if (!missing.strokes.empty()) {
+                        sendToClient(client, missing);
+                    }
+                }
+            }
+            if (m_Whiteboard.takePagedIn()) {
+                // Clients were not sent these while they were on disk
+                DocumentPtr document = m_Whiteboard.publish();
+                for (ClientId client : m_Interest.getClients()) {
+                    BoardOp missing;
+                    missing.type = OpType::AddStrokes;
+                    missing.strokes = m_Interest.refresh(client, document->strokes);
+                    if (!missing.strokes.empty()) {
+                        sendToClient(client, missing);
+                    }
+                }
             }
         }
+        else {
+            // Ops taken while offline are already pending and go out with the resend
+            if (m_SessionReady) {
+                if (m_ResendUnacked) {
+                    m_ResendUnacked = !resendUnacked();
+                }
+                else {
+                    for (const auto& op : ops) {
+                        m_Networking->sendMessage(encodeOp(op));
+                    }
+                }
+                publishViewport();
+                checkDigest();
+            }
+        }
+        pumpBlobs();
+        renderNetworkStats();
+    }
+}
+
+void Application::renderNetworkStats()
+{
+    AllocationScope scope(AllocationSubsystem::Interface);
+    ImGui::Begin("Network");
+
+    std::pmr::vector<std::pair<ClientId, ConnectionStats>> stats(&m_FrameArena);
+    m_Networking->getConnectionStats(stats);
+    if (stats.empty()) {
+        ImGui::Text("No connections");
+    }
+    for (const auto& [client, connection] : stats) {
+        ImGui::Text("%s %u: compression %s", client == NetworkManager::HOST_ID ? "Host" : "Client",
+            client, connection.compressed ? "on" : "off");
+
+        // Ratio of framed message bytes to bytes on the wire, per direction
+        double sentRatio = connection.wireBytesSent > 0 ? double(connection.bytesSent) / connection.wireBytesSent : 1.0;
+        double receivedRatio = connection.wireBytesReceived > 0 ? double(connection.bytesReceived) / connection.wireBytesReceived : 1.0;
+        ImGui::Text("  Sent %.1f KB -> %.1f KB (%.2fx), %.2f ms",
+            connection.bytesSent / 1024.0, connection.wireBytesSent / 1024.0, sentRatio, connection.compressSeconds * 1000.0);
+        ImGui::Text("  Received %.1f KB <- %.1f KB (%.2fx), %.2f ms",
+            connection.bytesReceived / 1024.0, connection.wireBytesReceived / 1024.0, receivedRatio, connection.decompressSeconds * 1000.0);
     }
+
+    ImGui::End();
+}
+
+void Application::renderAllocationStats()
+{
+    if (!isCountingAllocations()) {
+        return;
+    }
+
+    ImGui::Begin("Allocations");
+    ImGui::Text("Last frame, by subsystem:");
+    for (size_t i = 0; i < ALLOCATION_SUBSYSTEMS; i++) {
+        ImGui::Text("  %-10s %6llu allocations, %8.1f KB", getAllocationSubsystemName(static_cast<AllocationSubsystem>(i)),
+            static_cast<unsigned long long>(m_FrameAllocations.allocations[i]), m_FrameAllocations.bytes[i] / 1024.0);
+    }
+    ImGui::Text("Frames over the budget of %llu: %llu", static_cast<unsigned long long>(FRAME_ALLOCATION_BUDGET),
+        static_cast<unsigned long long>(m_FramesOverBudget));
+    ImGui::Text("Frame arena: %.1f of %.1f KB", m_FrameArena.getUsed() / 1024.0, m_FrameArena.getCapacity() / 1024.0);
+    ImGui::End();
+}
+
+void Application::renderInboundProgress()
+{
+    size_t done = 0;
+    size_t total = 0;
+    bool queued = m_Inbound.getProgress(done, total);
+    bool streaming = m_StreamedStrokes < m_Streaming.strokes.size();
+    if (!queued && !streaming && !m_AwaitingSnapshot) {
+        return;
+    }
+
+    ImGui::Begin("Loading Board", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoCollapse);
+    if (streaming) {
+        ImGui::ProgressBar(float(m_StreamedStrokes) / float(m_Streaming.strokes.size()), ImVec2(240.0f, 0.0f));
+        ImGui::Text("%zu of %zu strokes", m_StreamedStrokes, m_Streaming.strokes.size());
+    }
+    else if (queued && total > 0) {
+        ImGui::ProgressBar(float(done) / float(total), ImVec2(240.0f, 0.0f));
+        ImGui::Text("%.1f of %.1f MB", done / (1024.0 * 1024.0), total / (1024.0 * 1024.0));
+    }
+    else {
+        ImGui::Text("Waiting for the board...");
+    }
+    ImGui::End();
 }
 
 
@@ -249,6 +948,7 @@ bool Application::init()
     }
 
     SetDarkThemeColors();
+    m_Whiteboard.init();
     return true;
 }
 
@@ -276,6 +976,23 @@ void Application::Run() {
 
 
 void Application::renderFrame() {
+    m_FrameArena.reset();
+
+    // Drawing the UI should not touch the heap once the board is steady. Network
+    // threads and applying received messages are counted but not held to it.
+    if (isCountingAllocations()) {
+        AllocationCounts totals = getAllocationCounts();
+        m_FrameAllocations = totals.since(m_AllocationTotals);
+        m_AllocationTotals = totals;
+        uint64_t uiAllocations = 0;
+        for (AllocationSubsystem subsystem : { AllocationSubsystem::Board, AllocationSubsystem::Render, AllocationSubsystem::Interface }) {
+            uiAllocations += m_FrameAllocations.allocations[static_cast<size_t>(subsystem)];
+        }
+        if (uiAllocations > FRAME_ALLOCATION_BUDGET) {
+            m_FramesOverBudget++;
+        }
+    }
+
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
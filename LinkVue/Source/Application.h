@@ -6,6 +6,15 @@
 #include <mutex>
 #include "Networking.h"
 #include "Whiteboard.h"
+#include "InterestManager.h"
+#include "InboundQueue.h"
+#include "BlobTransfer.h"
+#include "SessionManager.h"
+#include "SessionRecording.h"
+#include "Metrics.h"
+#include "MetricsServer.h"
+#include "FrameArena.h"
+#include "AllocationStats.h"
 
 class Application {
 public:
@@ -30,17 +39,46 @@ private:
     void renderFrame();
     void renderModeSelectionWindow();
     void renderMainApplication();
+    void renderNetworkStats();
+    void renderAllocationStats();
 
     // Networking
     void startNetworkingThread();
     void stopNetworkingThread();
-    void handleNetworkMessage(const std::string& message);
-    void handleClientConnection();
-    void handleClientDisconnection();
+    void handleNetworkMessage(ClientId client, std::string_view message);
+    void handleClientConnection(ClientId client);
+    void handleClientDisconnection(ClientId client);
+    void processNetworkEvents();
+    void handleNetworkEvent(InboundQueue::Event& event);
+    void applyStreamedSlice();
+    void renderInboundProgress();
+    void forwardOp(const BoardOp& op, ClientId origin);
+    void sendToClient(ClientId client, BoardOp& op);
+    void sendStamped(ClientId client, BoardOp& op);
+    void handleHello(ClientId client, const BoardOp& hello);
+    bool resendUnacked();
+    void publishViewport();
+    void pumpBlobs();
+    void checkDigest();
+    void sendDigestQuery(BoardOp& query);
+    void handleDigest(const BoardOp& reply);
+    void resendStrokes(ClientId client, const std::vector<uint64_t>& ids);
+    void resendFetched();
+    void sendResent(ClientId client, BoardOp& found, BoardOp& gone);
+    std::string renderMetrics();
 
     // Window and rendering
     GLFWwindow* m_Window;
 
+    // Scratch memory for the current frame, reset when it starts
+    FrameArena m_FrameArena;
+    std::vector<BoardOp> m_LocalOps; // Reused every frame
+
+    // Allocations made during the last frame, by subsystem, when the build counts them
+    AllocationCounts m_AllocationTotals;
+    AllocationCounts m_FrameAllocations;
+    uint64_t m_FramesOverBudget = 0;
+
     // Networking members
     std::mutex m_NetworkingMutex;
     std::unique_ptr<NetworkManager> m_Networking;
@@ -51,11 +89,55 @@ private:
     bool m_IsHost = true;  // Replaced Mode enum with boolean
     char m_IP[16];  // Buffer for IP address
     int m_Port;
+    bool m_Compress = true;  // Offer stream compression when connecting
+
+    // Optional recording of the session for offline replay
+    bool m_RecordSession = false;
+    char m_RecordPath[260] = "session.lvrec";
+    SessionRecorder m_Recorder;
+
+    // Events from the socket threads, applied on the UI thread within a time budget per frame
+    InboundQueue m_Inbound;
+
+    // Client: a large batch of strokes from the host, applied a slice per frame.
+    // Later events wait until it is done.
+    BoardOp m_Streaming;
+    size_t m_StreamedStrokes = 0;
+
+    // Host: per-client areas of interest. Client: the viewport last sent to the host.
+    InterestManager m_Interest;
+    Rect m_PublishedViewport;
 
-    // Message queue for network messages
-    std::mutex m_MessageQueueMutex;
-    std::vector<std::string> m_MessageQueue;
+    // Host: sessions that survive reconnects, each with a log of what it was sent
+    SessionManager m_Sessions;
+
+    // Host: strokes clients asked for that are being read back from the page file
+    std::unordered_map<uint64_t, std::vector<ClientId>> m_PendingResends;
+
+    // Client: the session to resume and the last host message applied from it.
+    // Unacknowledged local ops are sent again whenever a session becomes ready.
+    std::string m_SessionToken;
+    uint64_t m_LastSeq = 0;
+    bool m_SessionReady = false;
+    bool m_AwaitingSnapshot = false;
+    bool m_ResendUnacked = false;
+
+    // Client: anti-entropy against the host's digest of what it sent us. A round
+    // descends from the root to the leaves that differ, one query per level.
+    bool m_DigestPending = false;
+    std::chrono::steady_clock::time_point m_DigestSent;
+    std::vector<uint32_t> m_DigestLeaves; // Leaves asked about by the pending query
 
     // Application components
     Whiteboard m_Whiteboard;
+
+    // Image pixels, streamed apart from the ops
+    BlobTransfer m_BlobTransfer{ m_Whiteboard.getBlobStore() };
+
+    // Prometheus scrape endpoint on localhost. Declared last so it stops before
+    // anything it reads is destroyed.
+    bool m_ServeMetrics = false;
+    int m_MetricsPort = 9464;
+    ShardedHistogram m_MessageLatency{ ShardedHistogram::exponentialBounds(1e-6, 4.0, 10) };
+    MetricsServer m_MetricsServer;
 };
\ No newline at end of file
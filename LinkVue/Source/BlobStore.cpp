@@ -0,0 +1,263 @@
+#include "BlobStore.h"
+
+#include <array>
+#include <fstream>
+#include <iostream>
+
+namespace {
+    // Plain SHA-256 (FIPS 180-4)
+    class Sha256 {
+    public:
+        void update(const uint8_t* data, size_t size)
+        {
+            for (size_t i = 0; i < size; i++) {
+                m_Block[m_BlockSize++] = data[i];
+                if (m_BlockSize == 64) {
+                    transform();
+                    m_BitLength += 512;
+                    m_BlockSize = 0;
+                }
+            }
+        }
+
+        std::array<uint8_t, 32> finish()
+        {
+            uint64_t bitLength = m_BitLength + m_BlockSize * 8ull;
+            m_Block[m_BlockSize++] = 0x80;
+            if (m_BlockSize > 56) {
+                while (m_BlockSize < 64) m_Block[m_BlockSize++] = 0;
+                transform();
+                m_BlockSize = 0;
+            }
+            while (m_BlockSize < 56) m_Block[m_BlockSize++] = 0;
+            for (int i = 7; i >= 0; i--) {
+                m_Block[m_BlockSize++] = static_cast<uint8_t>(bitLength >> (i * 8));
+            }
+            transform();
+
+            std::array<uint8_t, 32> digest;
+            for (int i = 0; i < 8; i++) {
+                digest[i * 4] = static_cast<uint8_t>(m_State[i] >> 24);
+                digest[i * 4 + 1] = static_cast<uint8_t>(m_State[i] >> 16);
+                digest[i * 4 + 2] = static_cast<uint8_t>(m_State[i] >> 8);
+                digest[i * 4 + 3] = static_cast<uint8_t>(m_State[i]);
+            }
+            return digest;
+        }
+
+    private:
+        static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+        void transform()
+        {
+            static const uint32_t k[64] = {
+                0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+                0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+                0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+                0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+                0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+                0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+                0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+                0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+
+            uint32_t w[64];
+            for (int i = 0; i < 16; i++) {
+                w[i] = (uint32_t(m_Block[i * 4]) << 24) | (uint32_t(m_Block[i * 4 + 1]) << 16) |
+                    (uint32_t(m_Block[i * 4 + 2]) << 8) | uint32_t(m_Block[i * 4 + 3]);
+            }
+            for (int i = 16; i < 64; i++) {
+                uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+                uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+                w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+            }
+
+            uint32_t a = m_State[0], b = m_State[1], c = m_State[2], d = m_State[3];
+            uint32_t e = m_State[4], f = m_State[5], g = m_State[6], h = m_State[7];
+            for (int i = 0; i < 64; i++) {
+                uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+                uint32_t choice = (e & f) ^ (~e & g);
+                uint32_t temp1 = h + s1 + choice + k[i] + w[i];
+                uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+                uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+                uint32_t temp2 = s0 + majority;
+                h = g; g = f; f = e; e = d + temp1;
+                d = c; c = b; b = a; a = temp1 + temp2;
+            }
+            m_State[0] += a; m_State[1] += b; m_State[2] += c; m_State[3] += d;
+            m_State[4] += e; m_State[5] += f; m_State[6] += g; m_State[7] += h;
+        }
+
+        uint32_t m_State[8] = {
+            0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+        uint8_t m_Block[64] = {};
+        size_t m_BlockSize = 0;
+        uint64_t m_BitLength = 0;
+    };
+
+    std::string toHex(const std::array<uint8_t, 32>& digest)
+    {
+        static const char* hex = "0123456789abcdef";
+        std::string result;
+        for (uint8_t byte : digest) {
+            result += hex[byte >> 4];
+            result += hex[byte & 0xF];
+        }
+        return result;
+    }
+
+    std::string hashFile(const std::filesystem::path& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        Sha256 sha;
+        std::vector<char> buffer(64 * 1024);
+        while (file) {
+            file.read(buffer.data(), buffer.size());
+            sha.update(reinterpret_cast<const uint8_t*>(buffer.data()), static_cast<size_t>(file.gcount()));
+        }
+        return toHex(sha.finish());
+    }
+}
+
+BlobStore::BlobStore(const std::filesystem::path& directory)
+    : m_Directory(directory)
+{
+    std::error_code error;
+    std::filesystem::create_directories(m_Directory, error);
+
+    // Everything already cached from earlier sessions counts as present
+    for (const auto& entry : std::filesystem::directory_iterator(m_Directory, error)) {
+        std::string name = entry.path().filename().string();
+        if (entry.is_regular_file() && isValidHash(name)) {
+            m_Blobs[name] = entry.file_size();
+        }
+    }
+}
+
+std::string BlobStore::hashOf(const uint8_t* data, size_t size)
+{
+    Sha256 sha;
+    sha.update(data, size);
+    return toHex(sha.finish());
+}
+
+bool BlobStore::isValidHash(const std::string& hash)
+{
+    return hash.size() == 64 && hash.find_first_not_of("0123456789abcdef") == std::string::npos;
+}
+
+std::filesystem::path BlobStore::blobPath(const std::string& hash) const
+{
+    return m_Directory / hash;
+}
+
+std::filesystem::path BlobStore::partialPath(const std::string& hash) const
+{
+    return m_Directory / (hash + ".part");
+}
+
+std::string BlobStore::put(const std::vector<uint8_t>& data)
+{
+    std::string hash = hashOf(data.data(), data.size());
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (m_Blobs.count(hash) != 0) {
+        return hash;
+    }
+
+    std::ofstream file(blobPath(hash), std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(data.data()), data.size());
+    if (!file) {
+        std::cerr << "Failed to write blob " << hash << std::endl;
+        return hash;
+    }
+    m_Blobs[hash] = data.size();
+    return hash;
+}
+
+bool BlobStore::has(const std::string& hash) const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Blobs.count(hash) != 0;
+}
+
+uint64_t BlobStore::getSize(const std::string& hash) const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    auto it = m_Blobs.find(hash);
+    return it != m_Blobs.end() ? it->second : 0;
+}
+
+bool BlobStore::read(const std::string& hash, std::vector<uint8_t>& data) const
+{
+    uint64_t size = getSize(hash);
+    return size > 0 && readChunk(hash, 0, static_cast<size_t>(size), data);
+}
+
+bool BlobStore::readChunk(const std::string& hash, uint64_t offset, size_t size, std::vector<uint8_t>& data) const
+{
+    if (!has(hash)) {
+        return false;
+    }
+
+    std::ifstream file(blobPath(hash), std::ios::binary);
+    file.seekg(static_cast<std::streamoff>(offset));
+    data.resize(size);
+    file.read(reinterpret_cast<char*>(data.data()), size);
+    data.resize(static_cast<size_t>(file.gcount()));
+    return !data.empty() || size == 0;
+}
+
+uint64_t BlobStore::getPartialSize(const std::string& hash) const
+{
+    if (!isValidHash(hash)) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::error_code error;
+    uint64_t size = std::filesystem::file_size(partialPath(hash), error);
+    return error ? 0 : size;
+}
+
+bool BlobStore::appendChunk(const std::string& hash, uint64_t offset, const std::vector<uint8_t>& data, uint64_t totalSize)
+{
+    if (!isValidHash(hash) || totalSize > MAX_BLOB_SIZE || has(hash)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::filesystem::path partial = partialPath(hash);
+
+    std::error_code error;
+    uint64_t received = std::filesystem::file_size(partial, error);
+    if (error) {
+        received = 0;
+    }
+    if (offset != received || received + data.size() > totalSize) {
+        return false;
+    }
+
+    {
+        std::ofstream file(partial, std::ios::binary | std::ios::app);
+        file.write(reinterpret_cast<const char*>(data.data()), data.size());
+        if (!file) {
+            return false;
+        }
+    }
+    received += data.size();
+    if (received < totalSize) {
+        return false;
+    }
+
+    if (hashFile(partial) != hash) {
+        std::cerr << "Blob " << hash << " failed verification, discarding" << std::endl;
+        std::filesystem::remove(partial, error);
+        return false;
+    }
+
+    std::filesystem::rename(partial, blobPath(hash), error);
+    if (error) {
+        return false;
+    }
+    m_Blobs[hash] = totalSize;
+    return true;
+}
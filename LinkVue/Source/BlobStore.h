@@ -0,0 +1,47 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#include <filesystem>
+#include <unordered_map>
+
+// Content-addressed blob cache on local disk.
+// Blobs are keyed by the hex SHA-256 of their bytes, so the same image pasted
+// twice (or by two peers) is stored and transferred once. Partial downloads
+// are kept next to the cache as <hash>.part and resume where they stopped.
+class BlobStore {
+public:
+    // Largest blob accepted from a peer: an image at ImageCache's largest
+    // dimensions, 16384 x 16384 RGBA8, and its 12-byte header
+    static constexpr uint64_t MAX_BLOB_SIZE = 12 + 16384ull * 16384 * 4;
+
+    explicit BlobStore(const std::filesystem::path& directory = "blobcache");
+
+    static std::string hashOf(const uint8_t* data, size_t size);
+
+    // Stores data and returns its hash; storing the same bytes again is a no-op
+    std::string put(const std::vector<uint8_t>& data);
+
+    bool has(const std::string& hash) const;
+    uint64_t getSize(const std::string& hash) const;
+    bool read(const std::string& hash, std::vector<uint8_t>& data) const;
+    bool readChunk(const std::string& hash, uint64_t offset, size_t size, std::vector<uint8_t>& data) const;
+
+    // Bytes of hash received so far, i.e. where a download has to resume
+    uint64_t getPartialSize(const std::string& hash) const;
+
+    // Appends a downloaded chunk. Chunks must arrive in order and totalSize be
+    // at most MAX_BLOB_SIZE; anything else is ignored. Once totalSize bytes are in, the blob is verified against its hash
+    // and moved into the cache. Returns true when that happened.
+    bool appendChunk(const std::string& hash, uint64_t offset, const std::vector<uint8_t>& data, uint64_t totalSize);
+
+private:
+    std::filesystem::path blobPath(const std::string& hash) const;
+    std::filesystem::path partialPath(const std::string& hash) const;
+    static bool isValidHash(const std::string& hash);
+
+    std::filesystem::path m_Directory;
+    mutable std::mutex m_Mutex;
+    std::unordered_map<std::string, uint64_t> m_Blobs; // Complete blobs and their sizes
+};
@@ -0,0 +1,122 @@
+#include "BlobTransfer.h"
+
+#include <algorithm>
+
+namespace {
+    // A download that went quiet for this long is asked for again
+    const auto RETRY_INTERVAL = std::chrono::seconds(3);
+}
+
+BlobTransfer::BlobTransfer(BlobStore& store, size_t bytesPerSecond, size_t chunkSize)
+    : m_Store(store), m_BytesPerSecond(bytesPerSecond), m_ChunkSize(chunkSize)
+{
+}
+
+void BlobTransfer::want(const std::string& hash, uint64_t size, ClientId source)
+{
+    if (size == 0 || size > BlobStore::MAX_BLOB_SIZE || m_Store.has(hash) || m_Downloads.count(hash) != 0) {
+        return;
+    }
+    m_Downloads[hash] = { source, size, Clock::now(), false };
+}
+
+bool BlobTransfer::handleOp(ClientId client, const BoardOp& op)
+{
+    if (op.type == OpType::BlobRequest) {
+        if (!m_Store.has(op.blobHash)) {
+            return false; // The requester retries once we have it ourselves
+        }
+
+        // A repeated request restarts the stream where the receiver says it is
+        auto existing = std::find_if(m_Uploads.begin(), m_Uploads.end(), [&](const Upload& upload) {
+            return upload.client == client && upload.hash == op.blobHash;
+        });
+        if (existing != m_Uploads.end()) {
+            existing->offset = op.blobOffset;
+        }
+        else {
+            m_Uploads.push_back({ client, op.blobHash, op.blobOffset });
+        }
+        return false;
+    }
+
+    if (op.type != OpType::BlobChunk) {
+        return false;
+    }
+
+    auto it = m_Downloads.find(op.blobHash);
+    if (it == m_Downloads.end()) {
+        return false;
+    }
+    it->second.lastActivity = Clock::now();
+
+    if (m_Store.appendChunk(op.blobHash, op.blobOffset, op.blobData, it->second.size)) {
+        m_Downloads.erase(it);
+        return true;
+    }
+    return false;
+}
+
+void BlobTransfer::pump(NetworkManager& network)
+{
+    Clock::time_point now = Clock::now();
+
+    for (auto& [hash, download] : m_Downloads) {
+        if (download.requested && now - download.lastActivity < RETRY_INTERVAL) {
+            continue;
+        }
+
+        BoardOp request;
+        request.type = OpType::BlobRequest;
+        request.blobHash = hash;
+        request.blobOffset = m_Store.getPartialSize(hash);
+        if (network.sendTo(download.source, encodeOp(request))) {
+            download.requested = true;
+            download.lastActivity = now;
+        }
+    }
+
+    // Refill the bucket, holding at most one second of burst
+    double elapsed = std::chrono::duration<double>(now - m_LastRefill).count();
+    m_LastRefill = now;
+    m_Tokens = std::min(m_Tokens + elapsed * m_BytesPerSecond, static_cast<double>(m_BytesPerSecond));
+
+    while (!m_Uploads.empty() && m_Tokens >= static_cast<double>(m_ChunkSize)) {
+        Upload upload = m_Uploads.front();
+        m_Uploads.pop_front();
+
+        BoardOp chunk;
+        chunk.type = OpType::BlobChunk;
+        chunk.blobHash = upload.hash;
+        chunk.blobOffset = upload.offset;
+        chunk.blobSize = m_Store.getSize(upload.hash);
+        if (upload.offset >= chunk.blobSize ||
+            !m_Store.readChunk(upload.hash, upload.offset, m_ChunkSize, chunk.blobData) ||
+            !network.sendTo(upload.client, encodeOp(chunk))) {
+            continue;
+        }
+
+        m_Tokens -= static_cast<double>(chunk.blobData.size());
+        upload.offset += chunk.blobData.size();
+        if (upload.offset < chunk.blobSize) {
+            m_Uploads.push_back(upload);
+        }
+    }
+}
+
+void BlobTransfer::removeClient(ClientId client)
+{
+    m_Uploads.erase(std::remove_if(m_Uploads.begin(), m_Uploads.end(), [&](const Upload& upload) {
+        return upload.client == client;
+    }), m_Uploads.end());
+
+    // Downloads from a peer that left wait for someone to want them again
+    for (auto it = m_Downloads.begin(); it != m_Downloads.end();) {
+        if (it->second.source == client) {
+            it = m_Downloads.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
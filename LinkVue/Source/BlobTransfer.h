@@ -0,0 +1,58 @@
+#pragma once
+#include <string>
+#include <deque>
+#include <map>
+#include <chrono>
+#include <cstdint>
+
+#include "Networking.h"
+#include "Protocol.h"
+#include "BlobStore.h"
+
+// Moves blobs between peers in chunks, apart from the board ops.
+// The receiver asks for a blob from the first byte it lacks; the sender streams
+// chunks round-robin across all requests under one shared byte rate, so a big
+// image never holds up strokes. Stalled downloads are asked for again from
+// wherever they stopped, which also resumes them after a reconnect.
+class BlobTransfer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit BlobTransfer(BlobStore& store, size_t bytesPerSecond = 1024 * 1024, size_t chunkSize = 32 * 1024);
+
+    // Fetches hash from source unless it is stored or already on its way
+    void want(const std::string& hash, uint64_t size, ClientId source);
+
+    // Handles BlobRequest and BlobChunk ops. Returns true when a blob completed.
+    bool handleOp(ClientId client, const BoardOp& op);
+
+    // Sends due requests and as many chunks as the rate allows. Call once per frame.
+    void pump(NetworkManager& network);
+
+    void removeClient(ClientId client);
+
+private:
+    struct Upload {
+        ClientId client;
+        std::string hash;
+        uint64_t offset;
+    };
+
+    struct Download {
+        ClientId source;
+        uint64_t size;
+        Clock::time_point lastActivity;
+        bool requested = false;
+    };
+
+    BlobStore& m_Store;
+    size_t m_BytesPerSecond;
+    size_t m_ChunkSize;
+
+    // Token bucket for outgoing chunk bytes
+    double m_Tokens = 0.0;
+    Clock::time_point m_LastRefill = Clock::now();
+
+    std::deque<Upload> m_Uploads;
+    std::map<std::string, Download> m_Downloads;
+};
@@ -0,0 +1,225 @@
+#include "BoardDigest.h"
+
+#include <algorithm>
+#include <unordered_set>
+#include <cstring>
+
+namespace {
+    // Index of the first node of a level in m_Nodes
+    constexpr size_t levelOffset(int level)
+    {
+        return ((size_t(1) << (BoardDigest::FANOUT_BITS * level)) - 1) / (BoardDigest::FANOUT - 1);
+    }
+
+    constexpr size_t NODE_COUNT = levelOffset(BoardDigest::DEPTH + 1);
+
+    uint64_t finalize(uint64_t value)
+    {
+        // splitmix64, so ids and FNV hashes spread over every bit
+        value ^= value >> 30;
+        value *= 0xBF58476D1CE4E5B9ull;
+        value ^= value >> 27;
+        value *= 0x94D049BB133111EBull;
+        value ^= value >> 31;
+        return value;
+    }
+
+    BoardDigest::Node makeNode(int level, uint32_t index)
+    {
+        return (static_cast<uint32_t>(level) << 24) | index;
+    }
+}
+
+bool BoardDigest::isValid(Node node)
+{
+    int level = levelOf(node);
+    return level <= DEPTH && indexOf(node) < (1u << (FANOUT_BITS * level));
+}
+
+BoardDigest::Node BoardDigest::leafOf(uint64_t id)
+{
+    return makeNode(DEPTH, static_cast<uint32_t>(finalize(id) >> (64 - FANOUT_BITS * DEPTH)));
+}
+
+std::array<BoardDigest::Node, BoardDigest::FANOUT> BoardDigest::children(Node node)
+{
+    std::array<Node, FANOUT> result;
+    for (uint32_t i = 0; i < FANOUT; i++) {
+        result[i] = makeNode(levelOf(node) + 1, (indexOf(node) << FANOUT_BITS) | i);
+    }
+    return result;
+}
+
+uint64_t BoardDigest::hashStroke(const Stroke& stroke)
+{
+    return combine(hashContent(stroke), stroke.transform);
+}
+
+uint64_t BoardDigest::hashContent(const Stroke& stroke)
+{
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](const void* data, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+    };
+
+    mix(&stroke.id, sizeof(stroke.id));
+    mix(&stroke.kind, sizeof(stroke.kind));
+    mix(&stroke.tileX, sizeof(stroke.tileX));
+    mix(&stroke.tileY, sizeof(stroke.tileY));
+    mix(&stroke.scale, sizeof(stroke.scale));
+    mix(stroke.color.data(), sizeof(float) * 3);
+    mix(&stroke.thickness, sizeof(float));
+    for (const auto& point : stroke.points) {
+        mix(&point.x, sizeof(point.x));
+        mix(&point.y, sizeof(point.y));
+    }
+    return hash;
+}
+
+uint64_t BoardDigest::combine(uint64_t content, const StrokeTransform& transform)
+{
+    uint64_t hash = content;
+    if (!transform.isIdentity()) {
+        for (double value : { transform.scale, transform.offsetX, transform.offsetY }) {
+            uint64_t bits = 0;
+            std::memcpy(&bits, &value, sizeof(bits));
+            hash = finalize(hash ^ bits);
+        }
+    }
+    // Zero would vanish from every XOR it is in
+    return finalize(hash) | 1;
+}
+
+void BoardDigest::add(const Stroke& stroke)
+{
+    Entry entry;
+    entry.content = hashContent(stroke);
+    entry.transform = stroke.transform;
+    entry.hash = combine(entry.content, entry.transform);
+    auto [it, inserted] = m_Hashes.try_emplace(stroke.id, entry);
+    if (!inserted) {
+        if (it->second.hash == entry.hash) {
+            return;
+        }
+        toggle(stroke.id, it->second.hash);
+        it->second = entry;
+    }
+    toggle(stroke.id, entry.hash);
+    if (inserted) {
+        m_Leaves[indexOf(leafOf(stroke.id))].push_back(stroke.id);
+    }
+}
+
+void BoardDigest::remove(uint64_t id)
+{
+    auto it = m_Hashes.find(id);
+    if (it != m_Hashes.end()) {
+        toggle(id, it->second.hash);
+        unlink(id);
+        m_Hashes.erase(it);
+    }
+}
+
+void BoardDigest::setTransform(uint64_t id, const StrokeTransform& transform)
+{
+    auto it = m_Hashes.find(id);
+    if (it == m_Hashes.end()) {
+        return;
+    }
+    Entry& entry = it->second;
+    toggle(id, entry.hash);
+    entry.transform = transform;
+    entry.hash = combine(entry.content, transform);
+    toggle(id, entry.hash);
+}
+
+void BoardDigest::clear()
+{
+    m_Hashes.clear();
+    m_Nodes.clear();
+    m_Leaves.clear();
+}
+
+void BoardDigest::toggle(uint64_t id, uint64_t hash)
+{
+    if (m_Nodes.empty()) {
+        m_Nodes.resize(NODE_COUNT, 0);
+        m_Leaves.resize(size_t(1) << (FANOUT_BITS * DEPTH));
+    }
+    uint32_t leaf = indexOf(leafOf(id));
+    for (int level = DEPTH; level >= 0; level--) {
+        m_Nodes[levelOffset(level) + (leaf >> (FANOUT_BITS * (DEPTH - level)))] ^= hash;
+    }
+}
+
+void BoardDigest::unlink(uint64_t id)
+{
+    // Leaves hold a handful of ids each, so order is not kept
+    std::vector<uint64_t>& bucket = m_Leaves[indexOf(leafOf(id))];
+    auto it = std::find(bucket.begin(), bucket.end(), id);
+    if (it != bucket.end()) {
+        *it = bucket.back();
+        bucket.pop_back();
+    }
+}
+
+uint64_t BoardDigest::hashOf(Node node) const
+{
+    if (m_Nodes.empty() || !isValid(node)) {
+        return 0;
+    }
+    return m_Nodes[levelOffset(levelOf(node)) + indexOf(node)];
+}
+
+std::vector<BoardDigest::Node> BoardDigest::differing(const std::vector<Node>& nodes, const std::vector<uint64_t>& hashes) const
+{
+    std::vector<Node> result;
+    for (size_t i = 0; i < nodes.size() && i < hashes.size(); i++) {
+        if (isValid(nodes[i]) && hashOf(nodes[i]) != hashes[i]) {
+            result.push_back(nodes[i]);
+        }
+    }
+    return result;
+}
+
+void BoardDigest::list(const std::vector<Node>& leaves, std::vector<uint64_t>& ids, std::vector<uint64_t>& hashes) const
+{
+    if (m_Leaves.empty()) {
+        return;
+    }
+    std::unordered_set<Node> listed;
+    for (Node leaf : leaves) {
+        if (!isValid(leaf) || !isLeaf(leaf) || !listed.insert(leaf).second) {
+            continue;
+        }
+        for (uint64_t id : m_Leaves[indexOf(leaf)]) {
+            ids.push_back(id);
+            hashes.push_back(m_Hashes.at(id).hash);
+        }
+    }
+}
+
+void BoardDigest::compare(const std::vector<Node>& leaves, const std::vector<uint64_t>& ids, const std::vector<uint64_t>& hashes,
+    std::vector<uint64_t>& wanted, std::vector<uint64_t>& extra) const
+{
+    std::unordered_set<uint64_t> listed;
+    for (size_t i = 0; i < ids.size() && i < hashes.size(); i++) {
+        listed.insert(ids[i]);
+        auto it = m_Hashes.find(ids[i]);
+        if (it == m_Hashes.end() || it->second.hash != hashes[i]) {
+            wanted.push_back(ids[i]);
+        }
+    }
+
+    std::vector<uint64_t> mine;
+    std::vector<uint64_t> mineHashes;
+    list(leaves, mine, mineHashes);
+    for (uint64_t id : mine) {
+        if (listed.count(id) == 0) {
+            extra.push_back(id);
+        }
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <cstdint>
+
+#include "Stroke.h"
+
+// Hash tree over the strokes of a board, for finding out cheaply where two
+// copies differ. Strokes are bucketed into the leaves of a fixed tree by a hash
+// of their id. Every node holds the XOR of the hashes of the strokes below it,
+// so adding or removing a stroke only touches the nodes on its path, and two
+// boards agree below a node exactly when its hashes agree.
+class BoardDigest {
+public:
+    static constexpr int FANOUT_BITS = 4;
+    static constexpr uint32_t FANOUT = 1u << FANOUT_BITS;
+    static constexpr int DEPTH = 4; // Leaves are at this level, the root at level 0
+
+    // A node is named by its level in the top byte and its index within the level
+    using Node = uint32_t;
+    static constexpr Node ROOT = 0;
+    static int levelOf(Node node) { return static_cast<int>(node >> 24); }
+    static uint32_t indexOf(Node node) { return node & 0xFFFFFF; }
+    static bool isLeaf(Node node) { return levelOf(node) == DEPTH; }
+    static bool isValid(Node node);
+    static Node leafOf(uint64_t id);
+    static std::array<Node, FANOUT> children(Node node);
+
+    // Covers everything peers must agree on; the local stacking order is left out.
+    // The transform is mixed in last, so a moved stroke is rehashed without its points.
+    static uint64_t hashStroke(const Stroke& stroke);
+    static uint64_t hashContent(const Stroke& stroke);
+    static uint64_t combine(uint64_t content, const StrokeTransform& transform);
+
+    // A stroke with the same id is replaced
+    void add(const Stroke& stroke);
+    void remove(uint64_t id);
+    void clear();
+
+    // Gives a stroke a new transform; unknown ids are ignored
+    void setTransform(uint64_t id, const StrokeTransform& transform);
+
+    bool contains(uint64_t id) const { return m_Hashes.count(id) != 0; }
+    size_t size() const { return m_Hashes.size(); }
+    uint64_t hashOf(Node node) const;
+
+    // Of nodes, those whose hash here is not the one given for them
+    std::vector<Node> differing(const std::vector<Node>& nodes, const std::vector<uint64_t>& hashes) const;
+
+    // Ids and hashes of every stroke in leaves
+    void list(const std::vector<Node>& leaves, std::vector<uint64_t>& ids, std::vector<uint64_t>& hashes) const;
+
+    // Compares another copy's listing of leaves with ours: ids it has that we
+    // lack or hold a different version of, and ids in those leaves only we have
+    void compare(const std::vector<Node>& leaves, const std::vector<uint64_t>& ids, const std::vector<uint64_t>& hashes,
+        std::vector<uint64_t>& wanted, std::vector<uint64_t>& extra) const;
+
+private:
+    struct Entry {
+        uint64_t content = 0;
+        StrokeTransform transform;
+        uint64_t hash = 0;
+    };
+
+    void toggle(uint64_t id, uint64_t hash);
+    void unlink(uint64_t id);
+
+    std::unordered_map<uint64_t, Entry> m_Hashes; // Stroke id -> hash
+    std::vector<uint64_t> m_Nodes; // Every level back to back, root first; allocated on first add
+    std::vector<std::vector<uint64_t>> m_Leaves; // Ids in each leaf, so listing one skips the rest; allocated with m_Nodes
+};
@@ -0,0 +1,53 @@
+#include "BoardDocument.h"
+
+#include <algorithm>
+
+DocumentHandoff::DocumentHandoff(DocumentPtr initial)
+    : m_Current(std::make_unique<const DocumentPtr>(std::move(initial)))
+{
+    m_Latest.store(m_Current.get());
+}
+
+DocumentPtr DocumentHandoff::load() const
+{
+    // Registering counts only if the epoch did not move on meanwhile, or the
+    // writer may already have looked at this epoch's count
+    uint64_t epoch;
+    while (true) {
+        epoch = m_Epoch.load();
+        m_Readers[epoch & 1].fetch_add(1);
+        if (m_Epoch.load() == epoch) {
+            break;
+        }
+        m_Readers[epoch & 1].fetch_sub(1);
+    }
+    DocumentPtr document = *m_Latest.load();
+    m_Readers[epoch & 1].fetch_sub(1);
+    return document;
+}
+
+void DocumentHandoff::publish(DocumentPtr document)
+{
+    auto published = std::make_unique<const DocumentPtr>(std::move(document));
+    m_Latest.store(published.get());
+    m_Retired.emplace_back(m_Epoch.load(std::memory_order_relaxed), std::move(m_Current));
+    m_Current = std::move(published);
+    reclaim();
+}
+
+void DocumentHandoff::reclaim()
+{
+    // The epoch after next shares its count with the one before this; it can
+    // only start once every reader that registered back then is done
+    uint64_t epoch = m_Epoch.load(std::memory_order_relaxed);
+    for (int step = 0; step < 2 && m_Readers[(epoch + 1) & 1].load() == 0; step++) {
+        m_Epoch.store(++epoch);
+    }
+
+    // Readers that saw a replaced document registered no later than the epoch it
+    // was replaced in, so they are gone once two more epochs have begun
+    auto done = std::remove_if(m_Retired.begin(), m_Retired.end(), [epoch](const auto& retired) {
+        return retired.first + 2 <= epoch;
+    });
+    m_Retired.erase(done, m_Retired.end());
+}
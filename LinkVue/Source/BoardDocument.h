@@ -0,0 +1,58 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <array>
+#include <atomic>
+#include <utility>
+#include <cstdint>
+
+#include "Stroke.h"
+
+// Committed strokes never change, so versions of the board share them
+using StrokePtr = std::shared_ptr<const Stroke>;
+
+// Immutable copy of the board at one version.
+// The Whiteboard publishes a new one after edits; readers on other threads
+// (exporter, serializers) hold on to the one they loaded for as long as they need it.
+struct BoardDocument {
+    uint64_t version = 0;
+    uint64_t revision = 0; // Changes whenever strokes were edited other than by appending
+    std::vector<StrokePtr> strokes;
+    std::vector<BoardImage> images;
+    std::array<float, 3> canvasColor = { 1.0f, 1.0f, 1.0f };
+};
+
+using DocumentPtr = std::shared_ptr<const BoardDocument>;
+
+// Hands the latest document from the one thread that edits the board to readers
+// on any other thread without a lock. std::atomic<std::shared_ptr> is not
+// lock-free on the standard libraries we build with (it guards the pointer with
+// a spinlock), so this is a small epoch scheme instead: readers register in the
+// current epoch while they copy the pointer, and the writer frees a replaced
+// document only after two epoch changes, which it makes on later publishes once
+// the readers of the epoch before have left. The writer never waits.
+class DocumentHandoff {
+public:
+    explicit DocumentHandoff(DocumentPtr initial);
+
+    DocumentHandoff(const DocumentHandoff&) = delete;
+    DocumentHandoff& operator=(const DocumentHandoff&) = delete;
+
+    // Latest published document. Safe from any thread.
+    DocumentPtr load() const;
+
+    // Writer only
+    const DocumentPtr& current() const { return *m_Current; }
+    void publish(DocumentPtr document);
+
+private:
+    void reclaim();
+
+    std::atomic<const DocumentPtr*> m_Latest;
+    std::atomic<uint64_t> m_Epoch{ 0 };
+    mutable std::array<std::atomic<uint32_t>, 2> m_Readers{}; // Readers in even and odd epochs
+
+    // Writer only: the published document and those replaced, with the epoch they were replaced in
+    std::unique_ptr<const DocumentPtr> m_Current;
+    std::vector<std::pair<uint64_t, std::unique_ptr<const DocumentPtr>>> m_Retired;
+};
@@ -0,0 +1,646 @@
+#include "BoardPager.h"
+
+#include <iostream>
+#include <random>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+namespace {
+    // Compacting rewrites the live pages, so only do it once enough is garbage
+    const uint64_t MIN_COMPACT_BYTES = 16 * 1024 * 1024;
+
+    template<typename T>
+    void put(std::string& out, const T& value)
+    {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template<typename T>
+    bool get(const std::string& in, size_t& offset, T& value)
+    {
+        if (in.size() - offset < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, in.data() + offset, sizeof(T));
+        offset += sizeof(T);
+        return true;
+    }
+
+    // Page: stroke count, then the strokes. The file never leaves this machine,
+    // so everything is in native byte order.
+    std::string encodePage(const std::vector<StrokePtr>& strokes)
+    {
+        std::string page;
+        put(page, static_cast<uint32_t>(strokes.size()));
+        for (const auto& stroke : strokes) {
+            put(page, stroke->id);
+            put(page, stroke->kind);
+            put(page, stroke->tileX);
+            put(page, stroke->tileY);
+            put(page, stroke->scale);
+            put(page, stroke->color);
+            put(page, stroke->thickness);
+            put(page, stroke->transform);
+            put(page, stroke->bounds);
+            put(page, stroke->order);
+            put(page, static_cast<uint32_t>(stroke->points.size()));
+            page.append(reinterpret_cast<const char*>(stroke->points.data()), stroke->points.size() * sizeof(Point));
+        }
+        return page;
+    }
+
+    bool decodePage(const std::string& page, std::vector<StrokePtr>& strokes)
+    {
+        size_t offset = 0;
+        uint32_t count = 0;
+        if (!get(page, offset, count)) {
+            return false;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            Stroke stroke;
+            uint32_t points = 0;
+            if (!get(page, offset, stroke.id) || !get(page, offset, stroke.kind) ||
+                !get(page, offset, stroke.tileX) || !get(page, offset, stroke.tileY) ||
+                !get(page, offset, stroke.scale) || !get(page, offset, stroke.color) ||
+                !get(page, offset, stroke.thickness) || !get(page, offset, stroke.transform) ||
+                !get(page, offset, stroke.bounds) ||
+                !get(page, offset, stroke.order) ||
+                !get(page, offset, points) || (page.size() - offset) / sizeof(Point) < points) {
+                return false;
+            }
+            stroke.points.resize(points);
+            std::memcpy(stroke.points.data(), page.data() + offset, points * sizeof(Point));
+            offset += points * sizeof(Point);
+            strokes.push_back(std::make_shared<const Stroke>(std::move(stroke)));
+        }
+        return true;
+    }
+}
+
+BoardPager::BoardPager()
+{
+    std::random_device device;
+    std::error_code error;
+    std::filesystem::path directory = std::filesystem::temp_directory_path(error);
+    m_Path = directory / ("linkvue-" + std::to_string(device()) + ".pages");
+    m_File.open(m_Path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!m_File) {
+        std::cerr << "Cannot create page file " << m_Path.string() << "; the board stays in memory" << std::endl;
+        m_Available = false;
+    }
+    m_Thread = std::thread(&BoardPager::ioLoop, this);
+}
+
+BoardPager::~BoardPager()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Running = false;
+    }
+    m_Wake.notify_one();
+    if (m_Thread.joinable()) {
+        m_Thread.join();
+    }
+    m_File.close();
+    std::error_code ignored;
+    std::filesystem::remove(m_Path, ignored);
+}
+
+BoardPager::RegionKey BoardPager::regionOf(const Stroke& stroke)
+{
+    double centerX = (stroke.bounds.minX + stroke.bounds.maxX) * 0.5;
+    double centerY = (stroke.bounds.minY + stroke.bounds.maxY) * 0.5;
+    return { static_cast<int64_t>(std::floor(centerX / REGION_SIZE)), static_cast<int64_t>(std::floor(centerY / REGION_SIZE)) };
+}
+
+void BoardPager::pageOut(RegionKey key, std::vector<StrokePtr> strokes)
+{
+    if (strokes.empty()) {
+        return;
+    }
+    uint64_t page = m_NextPage++;
+    Region& region = m_Live.regions[key];
+    for (const auto& stroke : strokes) {
+        region.bounds.include(stroke->bounds);
+        auto location = m_Live.locations.find(stroke->id);
+        if (location != m_Live.locations.end()) {
+            markStale(m_Live, stroke->id, location->second);
+            location->second = { key, page };
+        }
+        else {
+            m_Live.locations.emplace(stroke->id, Location{ key, page });
+        }
+    }
+    region.pages++;
+
+    Job job;
+    job.type = Job::Type::Write;
+    job.key = key;
+    job.generation = m_Generation;
+    job.page = page;
+    job.strokes = std::move(strokes);
+    push(std::move(job));
+}
+
+bool BoardPager::isLoading(RegionKey key) const
+{
+    auto it = m_Live.regions.find(key);
+    return it != m_Live.regions.end() && it->second.loading;
+}
+
+void BoardPager::pageIn(const Rect& area)
+{
+    for (auto& [key, region] : m_Live.regions) {
+        if (region.bounds.intersects(area)) {
+            load(key);
+        }
+    }
+}
+
+void BoardPager::load(RegionKey key)
+{
+    auto region = m_Live.regions.find(key);
+    if (region == m_Live.regions.end() || region->second.loading) {
+        return;
+    }
+    region->second.loading = true;
+    region->second.loadingPages = region->second.pages;
+    Job job;
+    job.type = Job::Type::Read;
+    job.key = key;
+    job.generation = m_Generation;
+    push(std::move(job));
+}
+
+bool BoardPager::locate(uint64_t id, RegionKey& key) const
+{
+    auto location = m_Live.locations.find(id);
+    if (location == m_Live.locations.end()) {
+        return false;
+    }
+    key = location->second.key;
+    return true;
+}
+
+std::vector<StrokePtr> BoardPager::takeLoaded()
+{
+    std::vector<Loaded> loaded;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        loaded.swap(m_Loaded);
+    }
+
+    std::vector<StrokePtr> strokes;
+    for (auto& entry : loaded) {
+        if (entry.generation != m_Generation) {
+            continue; // Read before a clear; its pages went with it
+        }
+        auto region = m_Live.regions.find(entry.key);
+        if (entry.returned) {
+            // A failed write returns only its own strokes; whatever else the region has stays paged
+            if (region != m_Live.regions.end()) {
+                region->second.pages -= std::min<size_t>(region->second.pages, 1);
+                if (region->second.loading && region->second.loadingPages > 0) {
+                    region->second.loadingPages--;
+                }
+            }
+        }
+        else {
+            // Pages put back by a restore while this was loading stay paged
+            if (region != m_Live.regions.end()) {
+                region->second.pages -= std::min(region->second.pages, region->second.loadingPages);
+                region->second.loadingPages = 0;
+                region->second.loading = false;
+            }
+            Job job;
+            job.type = Job::Type::Release;
+            job.key = entry.key;
+            job.pages = entry.pages;
+            push(std::move(job));
+        }
+        if (region != m_Live.regions.end() && region->second.pages == 0 && !region->second.loading) {
+            m_Live.regions.erase(region);
+            m_Live.stale.erase(entry.key);
+        }
+        else if (auto stale = m_Live.stale.find(entry.key); stale != m_Live.stale.end() && !entry.returned) {
+            std::erase_if(stale->second, [&](const std::pair<uint64_t, uint64_t>& copy) {
+                return std::find(entry.pages.begin(), entry.pages.end(), copy.second) != entry.pages.end();
+            });
+        }
+
+        // Only the current copy of each stroke comes back
+        for (size_t i = 0; i < entry.strokes.size(); i++) {
+            auto location = m_Live.locations.find(entry.strokes[i]->id);
+            if (location != m_Live.locations.end() && location->second.key == entry.key &&
+                location->second.page == entry.strokePages[i]) {
+                m_Live.locations.erase(location);
+                strokes.push_back(std::move(entry.strokes[i]));
+            }
+        }
+    }
+    return strokes;
+}
+
+void BoardPager::forget(const std::vector<uint64_t>& ids)
+{
+    for (uint64_t id : ids) {
+        auto location = m_Live.locations.find(id);
+        if (location != m_Live.locations.end()) {
+            markStale(m_Live, id, location->second);
+            m_Live.locations.erase(location);
+        }
+    }
+}
+
+void BoardPager::markStale(PageSet& pages, uint64_t id, const Location& location)
+{
+    pages.stale[location.key].insert({ id, location.page });
+}
+
+void BoardPager::clear()
+{
+    m_Live = PageSet();
+    m_Generation++;
+
+    Job job;
+    job.type = Job::Type::Clear;
+    push(std::move(job));
+}
+
+uint64_t BoardPager::setAside(const std::vector<StrokePtr>& resident)
+{
+    std::map<RegionKey, std::vector<StrokePtr>> byRegion;
+    for (const auto& stroke : resident) {
+        byRegion[regionOf(*stroke)].push_back(stroke);
+    }
+    for (auto& [key, strokes] : byRegion) {
+        pageOut(key, std::move(strokes));
+    }
+
+    // Reads still pending belong to the old generation and are dropped, so
+    // what they read stays with the set
+    uint64_t set = m_NextSet++;
+    PageSet& kept = m_Kept[set];
+    kept = std::move(m_Live);
+    for (auto& [key, region] : kept.regions) {
+        region.loading = false;
+        region.loadingPages = 0;
+    }
+    m_Live = PageSet();
+    m_Generation++;
+
+    Job job;
+    job.type = Job::Type::SetAside;
+    job.set = set;
+    push(std::move(job));
+    return set;
+}
+
+std::vector<uint64_t> BoardPager::restore(uint64_t set)
+{
+    auto kept = m_Kept.find(set);
+    if (kept == m_Kept.end()) {
+        return {};
+    }
+
+    PageSet& from = kept->second;
+    std::vector<uint64_t> ids;
+    for (const auto& [id, location] : from.locations) {
+        if (m_Live.locations.count(id) != 0) {
+            markStale(m_Live, id, location);
+            continue;
+        }
+        m_Live.locations.emplace(id, location);
+        ids.push_back(id);
+    }
+    for (const auto& [key, region] : from.regions) {
+        Region& live = m_Live.regions[key];
+        live.bounds.include(region.bounds);
+        live.pages += region.pages;
+    }
+    for (const auto& [key, stale] : from.stale) {
+        m_Live.stale[key].insert(stale.begin(), stale.end());
+    }
+    m_Kept.erase(kept);
+
+    Job job;
+    job.type = Job::Type::Restore;
+    job.set = set;
+    push(std::move(job));
+    return ids;
+}
+
+void BoardPager::drop(uint64_t set)
+{
+    if (m_Kept.erase(set) == 0) {
+        return;
+    }
+    Job job;
+    job.type = Job::Type::Drop;
+    job.set = set;
+    push(std::move(job));
+}
+
+size_t BoardPager::getSetBytes(uint64_t set) const
+{
+    auto kept = m_Kept.find(set);
+    if (kept == m_Kept.end()) {
+        return 0;
+    }
+    // Hash and tree nodes are a few pointers each
+    size_t bytes = kept->second.locations.size() * (sizeof(uint64_t) + sizeof(Location) + 2 * sizeof(void*));
+    bytes += kept->second.regions.size() * (sizeof(RegionKey) + sizeof(Region) + 4 * sizeof(void*));
+    for (const auto& [key, stale] : kept->second.stale) {
+        bytes += stale.size() * (2 * sizeof(uint64_t) + 4 * sizeof(void*));
+    }
+    return bytes;
+}
+
+std::future<std::vector<StrokePtr>> BoardPager::readPaged()
+{
+    auto result = std::make_shared<std::promise<std::vector<StrokePtr>>>();
+    std::future<std::vector<StrokePtr>> future = result->get_future();
+    if (m_Live.regions.empty()) {
+        result->set_value({});
+        return future;
+    }
+
+    auto strokes = std::make_shared<std::vector<StrokePtr>>();
+    Job job;
+    job.type = Job::Type::Visit;
+    job.stale = m_Live.stale;
+    job.visit = [strokes](std::vector<StrokePtr> region) {
+        strokes->insert(strokes->end(), std::make_move_iterator(region.begin()), std::make_move_iterator(region.end()));
+    };
+    job.done = [result, strokes]() { result->set_value(std::move(*strokes)); };
+    push(std::move(job));
+    return future;
+}
+
+void BoardPager::visitPaged(const std::function<void(std::vector<StrokePtr>)>& visit)
+{
+    if (m_Live.regions.empty()) {
+        return;
+    }
+
+    std::promise<void> finished;
+    std::future<void> future = finished.get_future();
+    Job job;
+    job.type = Job::Type::Visit;
+    job.stale = m_Live.stale;
+    job.visit = visit;
+    job.done = [&finished]() { finished.set_value(); };
+    push(std::move(job));
+    future.wait();
+}
+
+Rect BoardPager::getPagedBounds() const
+{
+    Rect bounds;
+    for (const auto& [key, region] : m_Live.regions) {
+        bounds.include(region.bounds);
+    }
+    return bounds;
+}
+
+void BoardPager::push(Job job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Jobs.push_back(std::move(job));
+    }
+    m_Wake.notify_one();
+}
+
+void BoardPager::ioLoop()
+{
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_Wake.wait(lock, [this]() { return !m_Running || !m_Jobs.empty(); });
+            if (!m_Running) {
+                return;
+            }
+            job = std::move(m_Jobs.front());
+            m_Jobs.pop_front();
+        }
+
+        switch (job.type) {
+        case Job::Type::Write:
+            write(job);
+            break;
+
+        case Job::Type::Read: {
+            // The pages stay in the file until the board takes the strokes and releases them
+            Loaded loaded{ job.key, job.generation, {}, {}, {} };
+            auto it = m_Extents.find(job.key);
+            if (it != m_Extents.end()) {
+                read(it->second, loaded.strokes, loaded.strokePages);
+                for (const auto& extent : it->second) {
+                    loaded.pages.push_back(extent.page);
+                }
+            }
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Loaded.push_back(std::move(loaded));
+            break;
+        }
+
+        case Job::Type::Release:
+            release(job.key, job.pages);
+            compact();
+            break;
+
+        case Job::Type::Visit:
+            visit(job);
+            break;
+
+        case Job::Type::SetAside:
+            m_KeptExtents[job.set] = std::move(m_Extents);
+            m_Extents.clear();
+            break;
+
+        case Job::Type::Restore: {
+            auto kept = m_KeptExtents.find(job.set);
+            if (kept == m_KeptExtents.end()) {
+                break;
+            }
+            for (auto& [key, extents] : kept->second) {
+                std::vector<Extent>& live = m_Extents[key];
+                live.insert(live.end(), extents.begin(), extents.end());
+                std::sort(live.begin(), live.end(), [](const Extent& a, const Extent& b) { return a.page < b.page; });
+            }
+            m_KeptExtents.erase(kept);
+            break;
+        }
+
+        case Job::Type::Drop: {
+            auto kept = m_KeptExtents.find(job.set);
+            if (kept == m_KeptExtents.end()) {
+                break;
+            }
+            for (const auto& [key, extents] : kept->second) {
+                for (const auto& extent : extents) {
+                    m_LiveBytes -= extent.size;
+                }
+            }
+            m_KeptExtents.erase(kept);
+            compact();
+            break;
+        }
+
+        case Job::Type::Clear:
+            for (const auto& [key, extents] : m_Extents) {
+                for (const auto& extent : extents) {
+                    m_LiveBytes -= extent.size;
+                }
+            }
+            m_Extents.clear();
+            if (!m_KeptExtents.empty()) {
+                compact();
+                break;
+            }
+            m_LiveBytes = 0;
+            m_FileSize = 0;
+            m_File.close();
+            m_File.open(m_Path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+            break;
+        }
+    }
+}
+
+void BoardPager::write(const Job& job)
+{
+    std::string page = encodePage(job.strokes);
+    m_File.clear();
+    m_File.seekp(static_cast<std::streamoff>(m_FileSize));
+    m_File.write(page.data(), static_cast<std::streamsize>(page.size()));
+    m_File.flush();
+    if (!m_File) {
+        // Hand the strokes straight back rather than lose them
+        std::cerr << "Cannot write page file " << m_Path.string() << std::endl;
+        m_Available = false;
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Loaded.push_back({ job.key, job.generation, job.strokes, std::vector<uint64_t>(job.strokes.size(), job.page), { job.page }, true });
+        return;
+    }
+
+    m_Extents[job.key].push_back({ m_FileSize, page.size(), job.page });
+    m_FileSize += page.size();
+    m_LiveBytes += page.size();
+}
+
+void BoardPager::read(const std::vector<Extent>& extents, std::vector<StrokePtr>& strokes, std::vector<uint64_t>& pages)
+{
+    std::string page;
+    for (const auto& extent : extents) {
+        page.resize(extent.size);
+        m_File.clear();
+        m_File.seekg(static_cast<std::streamoff>(extent.offset));
+        m_File.read(page.data(), static_cast<std::streamsize>(page.size()));
+        if (!m_File || !decodePage(page, strokes)) {
+            std::cerr << "Page file " << m_Path.string() << " is unreadable at " << extent.offset << std::endl;
+            m_Available = false;
+        }
+        pages.resize(strokes.size(), extent.page);
+    }
+}
+
+void BoardPager::visit(const Job& job)
+{
+    std::vector<StrokePtr> strokes;
+    std::vector<uint64_t> pages;
+    for (const auto& [key, extents] : m_Extents) {
+        strokes.clear();
+        pages.clear();
+        read(extents, strokes, pages);
+
+        auto stale = job.stale.find(key);
+        std::vector<StrokePtr> current;
+        for (size_t i = 0; i < strokes.size(); i++) {
+            if (stale == job.stale.end() || stale->second.count({ strokes[i]->id, pages[i] }) == 0) {
+                current.push_back(std::move(strokes[i]));
+            }
+        }
+        if (!current.empty()) {
+            job.visit(std::move(current));
+        }
+    }
+    job.done();
+}
+
+void BoardPager::release(RegionKey key, const std::vector<uint64_t>& pages)
+{
+    auto it = m_Extents.find(key);
+    if (it == m_Extents.end()) {
+        return;
+    }
+    std::vector<Extent>& extents = it->second;
+    extents.erase(std::remove_if(extents.begin(), extents.end(), [&](const Extent& extent) {
+        if (std::find(pages.begin(), pages.end(), extent.page) == pages.end()) {
+            return false;
+        }
+        m_LiveBytes -= extent.size;
+        return true;
+    }), extents.end());
+    if (extents.empty()) {
+        m_Extents.erase(it);
+    }
+}
+
+void BoardPager::compact()
+{
+    if (m_FileSize < MIN_COMPACT_BYTES || m_LiveBytes * 2 > m_FileSize) {
+        return;
+    }
+
+    // Pages put aside are live too
+    std::filesystem::path compacted = m_Path;
+    compacted += ".tmp";
+    std::ofstream out(compacted, std::ios::binary | std::ios::trunc);
+    uint64_t size = 0;
+    std::string page;
+    auto copy = [&](Extents& moved) {
+        for (auto& [key, extents] : moved) {
+            for (auto& extent : extents) {
+                page.resize(extent.size);
+                m_File.clear();
+                m_File.seekg(static_cast<std::streamoff>(extent.offset));
+                m_File.read(page.data(), static_cast<std::streamsize>(page.size()));
+                out.write(page.data(), static_cast<std::streamsize>(page.size()));
+                extent.offset = size;
+                size += extent.size;
+            }
+        }
+    };
+    auto moved = m_Extents;
+    auto movedKept = m_KeptExtents;
+    copy(moved);
+    for (auto& [set, extents] : movedKept) {
+        copy(extents);
+    }
+    out.close();
+    if (!m_File || !out) {
+        std::error_code ignored;
+        std::filesystem::remove(compacted, ignored);
+        return; // Keep using the old file
+    }
+
+    m_File.close();
+    std::error_code error;
+    std::filesystem::rename(compacted, m_Path, error);
+    m_File.open(m_Path, std::ios::in | std::ios::out | std::ios::binary);
+    if (!m_File) {
+        std::cerr << "Cannot reopen page file " << m_Path.string() << std::endl;
+        m_Available = false;
+        return;
+    }
+    if (error) {
+        std::filesystem::remove(compacted, error);
+        return; // Still the old file
+    }
+    m_Extents = std::move(moved);
+    m_KeptExtents = std::move(movedKept);
+    m_FileSize = size;
+}
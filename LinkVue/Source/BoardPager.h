@@ -0,0 +1,180 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <cstdint>
+
+#include "BoardDocument.h"
+
+// Keeps cold regions of the board in a page file on local disk.
+// Strokes are grouped into square regions of the canvas by their center; a
+// region is paged out whole and comes back whole. All file access happens on
+// one I/O thread in the order it was asked for, so a region can be read back
+// while its write is still queued. Everything but that thread runs on the
+// board's thread.
+class BoardPager {
+public:
+    using RegionKey = std::pair<int64_t, int64_t>;
+    static constexpr double REGION_SIZE = 4096.0; // Canvas units
+
+    // The page file is created next to other temporary files and removed again
+    BoardPager();
+    ~BoardPager();
+
+    BoardPager(const BoardPager&) = delete;
+    BoardPager& operator=(const BoardPager&) = delete;
+
+    static RegionKey regionOf(const Stroke& stroke);
+
+    // Writes strokes out in the background; the caller drops them afterwards.
+    // Regions that are being loaded cannot be paged out.
+    void pageOut(RegionKey key, std::vector<StrokePtr> strokes);
+    bool isLoading(RegionKey key) const;
+
+    // Starts loading every paged region that overlaps area
+    void pageIn(const Rect& area);
+
+    // Starts loading one paged region, unless it is loading already
+    void load(RegionKey key);
+
+    // Region a paged out stroke is in; false if the stroke is not paged out
+    bool locate(uint64_t id, RegionKey& key) const;
+    bool isPaged(uint64_t id) const { return m_Live.locations.count(id) != 0; }
+
+    // Strokes of regions that finished loading since the last call. Their
+    // regions are no longer paged.
+    std::vector<StrokePtr> takeLoaded();
+
+    // Strokes removed while paged out are dropped when they come back
+    void forget(const std::vector<uint64_t>& ids);
+
+    // Forgets every page, e.g. because the board was cleared. Sets put aside stay.
+    void clear();
+
+    // Moves every page, and the resident strokes given, into a set of its own
+    // that is no longer paged in, e.g. for a clear that may be undone. Returns its id.
+    uint64_t setAside(const std::vector<StrokePtr>& resident);
+    // Makes a set paged out again and returns the ids of its strokes. Strokes
+    // paged out since keep their newer copy.
+    std::vector<uint64_t> restore(uint64_t set);
+    void drop(uint64_t set);
+    // Memory a set takes on this side of the page file
+    size_t getSetBytes(uint64_t set) const;
+
+    // Every paged stroke as of now, read on the I/O thread. The board can go on
+    // meanwhile; the result is for whoever waits on the future.
+    std::future<std::vector<StrokePtr>> readPaged();
+
+    // Hands every paged stroke to visit, a region at a time so memory stays
+    // bounded. visit runs on the I/O thread while this waits for it.
+    void visitPaged(const std::function<void(std::vector<StrokePtr>)>& visit);
+
+    // False once the page file failed; nothing should be paged out then
+    bool isAvailable() const { return m_Available; }
+
+    bool empty() const { return m_Live.regions.empty(); }
+    size_t getPagedStrokes() const { return m_Live.locations.size(); }
+    size_t getPagedRegions() const { return m_Live.regions.size(); }
+    Rect getPagedBounds() const;
+
+private:
+    // Pages are numbered in the order they are written, so copies of a stroke
+    // can be told apart without knowing where in the file they are
+    struct Extent {
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        uint64_t page = 0;
+    };
+    using Extents = std::map<RegionKey, std::vector<Extent>>;
+
+    // The copy of a stroke that is current
+    struct Location {
+        RegionKey key;
+        uint64_t page = 0;
+    };
+
+    // Board-thread view of a paged region
+    struct Region {
+        Rect bounds;
+        size_t pages = 0;
+        size_t loadingPages = 0; // Pages the pending read returns
+        bool loading = false;
+    };
+
+    // Board-thread view of the live pages or of a set put aside. Copies in the
+    // file that are no longer current are listed per region as (id, page).
+    struct PageSet {
+        std::map<RegionKey, Region> regions;
+        std::unordered_map<uint64_t, Location> locations;
+        std::map<RegionKey, std::set<std::pair<uint64_t, uint64_t>>> stale;
+    };
+
+    struct Job {
+        enum class Type { Write, Read, Release, Visit, SetAside, Restore, Drop, Clear };
+        Type type;
+        RegionKey key;
+        std::vector<StrokePtr> strokes;
+        uint64_t generation = 0;
+        uint64_t page = 0;               // Write
+        uint64_t set = 0;                // SetAside, Restore and Drop
+        std::vector<uint64_t> pages;     // Release
+        std::map<RegionKey, std::set<std::pair<uint64_t, uint64_t>>> stale; // Visit
+        std::function<void(std::vector<StrokePtr>)> visit;                 // Visit
+        std::function<void()> done;                                         // Visit
+    };
+
+    struct Loaded {
+        RegionKey key;
+        uint64_t generation;
+        std::vector<StrokePtr> strokes;
+        std::vector<uint64_t> strokePages; // Page of each stroke
+        std::vector<uint64_t> pages;       // Pages read
+        bool returned = false;             // From a write that failed, not a read
+    };
+
+    void ioLoop();
+    void write(const Job& job);
+    void read(const std::vector<Extent>& extents, std::vector<StrokePtr>& strokes, std::vector<uint64_t>& pages);
+    void visit(const Job& job);
+    void release(RegionKey key, const std::vector<uint64_t>& pages);
+    void compact();
+    void push(Job job);
+    void markStale(PageSet& pages, uint64_t id, const Location& location);
+
+    // Board thread
+    PageSet m_Live;
+    std::map<uint64_t, PageSet> m_Kept;
+    uint64_t m_NextPage = 1;
+    uint64_t m_NextSet = 1;
+    uint64_t m_Generation = 0;
+
+    // Shared with the I/O thread
+    std::mutex m_Mutex;
+    std::condition_variable m_Wake;
+    std::deque<Job> m_Jobs;
+    std::vector<Loaded> m_Loaded;
+    bool m_Running = true;
+    std::atomic<bool> m_Available{ true };
+
+    // I/O thread. Read pages stay in the file until the board takes them, so
+    // a visit in between still finds them.
+    std::filesystem::path m_Path;
+    std::fstream m_File;
+    uint64_t m_FileSize = 0;
+    uint64_t m_LiveBytes = 0;
+    Extents m_Extents;
+    std::map<uint64_t, Extents> m_KeptExtents;
+
+    std::thread m_Thread;
+};
@@ -0,0 +1,61 @@
+#include "Clipboard.h"
+
+#ifdef LV_PLATFORM_WINDOWS
+#include <windows.h>
+
+bool readClipboardImage(uint32_t& width, uint32_t& height, std::vector<uint8_t>& rgba)
+{
+    if (!IsClipboardFormatAvailable(CF_DIB) || !OpenClipboard(nullptr)) {
+        return false;
+    }
+
+    bool ok = false;
+    HANDLE handle = GetClipboardData(CF_DIB);
+    const BITMAPINFOHEADER* header = handle ? static_cast<const BITMAPINFOHEADER*>(GlobalLock(handle)) : nullptr;
+    if (header) {
+        // Screenshots come as 24 or 32 bit uncompressed DIBs; anything else is skipped
+        bool supported = (header->biBitCount == 24 || header->biBitCount == 32) &&
+            (header->biCompression == BI_RGB || header->biCompression == BI_BITFIELDS) &&
+            header->biWidth > 0 && header->biHeight != 0;
+        if (supported) {
+            width = static_cast<uint32_t>(header->biWidth);
+            height = static_cast<uint32_t>(header->biHeight < 0 ? -header->biHeight : header->biHeight);
+            bool bottomUp = header->biHeight > 0;
+            size_t bytesPerPixel = header->biBitCount / 8;
+            size_t stride = (static_cast<size_t>(width) * bytesPerPixel + 3) & ~size_t(3);
+
+            const uint8_t* pixels = reinterpret_cast<const uint8_t*>(header) + header->biSize;
+            if (header->biCompression == BI_BITFIELDS && header->biSize == sizeof(BITMAPINFOHEADER)) {
+                pixels += 3 * sizeof(DWORD); // Color masks follow the header
+            }
+
+            rgba.resize(static_cast<size_t>(width) * height * 4);
+            for (uint32_t y = 0; y < height; y++) {
+                const uint8_t* row = pixels + stride * (bottomUp ? height - 1 - y : y);
+                uint8_t* out = rgba.data() + static_cast<size_t>(y) * width * 4;
+                for (uint32_t x = 0; x < width; x++) {
+                    const uint8_t* pixel = row + x * bytesPerPixel;
+                    out[x * 4] = pixel[2];
+                    out[x * 4 + 1] = pixel[1];
+                    out[x * 4 + 2] = pixel[0];
+                    out[x * 4 + 3] = 255; // Most apps leave the DIB alpha byte unset
+                }
+            }
+            ok = true;
+        }
+        GlobalUnlock(handle);
+    }
+
+    CloseClipboard();
+    return ok;
+}
+
+#else
+
+bool readClipboardImage(uint32_t& /*width*/, uint32_t& /*height*/, std::vector<uint8_t>& /*rgba*/)
+{
+    // GLFW only exposes text on the clipboard
+    return false;
+}
+
+#endif
@@ -0,0 +1,7 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+// Reads a bitmap from the system clipboard as top-down RGBA8 rows.
+// Returns false if the clipboard holds no image or the platform is unsupported.
+bool readClipboardImage(uint32_t& width, uint32_t& height, std::vector<uint8_t>& rgba);
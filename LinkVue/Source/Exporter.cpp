@@ -0,0 +1,579 @@
+#include "Exporter.h"
+#include "PngWriter.h"
+#include "Shapes.h"
+#include "ImageCache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+    // Upper bound for the band of rows held in memory while rasterizing
+    const size_t BAND_BUDGET_BYTES = 64 * 1024 * 1024;
+    const uint32_t MAX_EXPORT_DIMENSION = 1u << 18;
+
+    struct PixelSegment {
+        float ax, ay, bx, by;
+        float halfWidth;
+        float r, g, b;
+        float minX, minY, maxX, maxY;
+    };
+
+    // An image placed on the output, in pixel space
+    struct PixelImage {
+        size_t index; // Into the document's images
+        float minX, minY, maxX, maxY;
+    };
+
+    struct DecodedImage {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<uint8_t> rgba; // Empty if the blob is missing or unreadable
+    };
+
+    Rect boardBounds(const std::vector<StrokePtr>& strokes, const std::vector<BoardImage>& images, double margin,
+        const Rect& alsoCovering = Rect())
+    {
+        Rect bounds = alsoCovering;
+        for (const auto& stroke : strokes) {
+            bounds.include(stroke->bounds);
+        }
+        for (const auto& image : images) {
+            bounds.include(image.bounds);
+        }
+        if (bounds.isEmpty()) {
+            bounds.include(0.0f, 0.0f);
+        }
+        return bounds.expanded(margin);
+    }
+
+    // Coverage-based capsule rasterization of one segment, clipped to a tile of the band
+    void rasterizeSegment(const PixelSegment& segment, std::vector<uint8_t>& band, uint32_t width,
+        uint32_t bandY, int tileX0, int tileX1, int tileY0, int tileY1)
+    {
+        int x0 = std::max(tileX0, static_cast<int>(std::floor(segment.minX)));
+        int x1 = std::min(tileX1, static_cast<int>(std::ceil(segment.maxX)) + 1);
+        int y0 = std::max(tileY0, static_cast<int>(std::floor(segment.minY)));
+        int y1 = std::min(tileY1, static_cast<int>(std::ceil(segment.maxY)) + 1);
+        if (x0 >= x1 || y0 >= y1) {
+            return;
+        }
+
+        float dx = segment.bx - segment.ax;
+        float dy = segment.by - segment.ay;
+        float lengthSquared = dx * dx + dy * dy;
+
+        for (int y = y0; y < y1; y++) {
+            uint8_t* row = band.data() + static_cast<size_t>(y - bandY) * width * 3;
+            float py = y + 0.5f;
+            for (int x = x0; x < x1; x++) {
+                float px = x + 0.5f;
+                float t = lengthSquared > 0.0f ? ((px - segment.ax) * dx + (py - segment.ay) * dy) / lengthSquared : 0.0f;
+                t = std::clamp(t, 0.0f, 1.0f);
+                float cx = segment.ax + t * dx - px;
+                float cy = segment.ay + t * dy - py;
+                float distance = std::sqrt(cx * cx + cy * cy);
+
+                float coverage = std::clamp(segment.halfWidth + 0.5f - distance, 0.0f, 1.0f);
+                if (coverage <= 0.0f) {
+                    continue;
+                }
+
+                uint8_t* pixel = row + static_cast<size_t>(x) * 3;
+                pixel[0] = static_cast<uint8_t>(pixel[0] + (segment.r - pixel[0]) * coverage + 0.5f);
+                pixel[1] = static_cast<uint8_t>(pixel[1] + (segment.g - pixel[1]) * coverage + 0.5f);
+                pixel[2] = static_cast<uint8_t>(pixel[2] + (segment.b - pixel[2]) * coverage + 0.5f);
+            }
+        }
+    }
+
+    // Nearest texel, blended by its alpha, for each pixel of the band the image covers
+    void drawImage(const DecodedImage& image, const PixelImage& placed, std::vector<uint8_t>& band,
+        uint32_t width, uint32_t bandY, uint32_t rows)
+    {
+        int x0 = std::max(0, static_cast<int>(std::floor(placed.minX)));
+        int x1 = std::min(static_cast<int>(width), static_cast<int>(std::ceil(placed.maxX)));
+        int y0 = std::max(static_cast<int>(bandY), static_cast<int>(std::floor(placed.minY)));
+        int y1 = std::min(static_cast<int>(bandY + rows), static_cast<int>(std::ceil(placed.maxY)));
+        if (x0 >= x1 || y0 >= y1) {
+            return;
+        }
+
+        float texelsX = image.width / (placed.maxX - placed.minX);
+        float texelsY = image.height / (placed.maxY - placed.minY);
+        for (int y = y0; y < y1; y++) {
+            float py = y + 0.5f;
+            if (py < placed.minY || py >= placed.maxY) {
+                continue;
+            }
+            uint32_t texelY = std::min(image.height - 1, static_cast<uint32_t>((py - placed.minY) * texelsY));
+            const uint8_t* texels = image.rgba.data() + static_cast<size_t>(texelY) * image.width * 4;
+            uint8_t* row = band.data() + static_cast<size_t>(y - bandY) * width * 3;
+            for (int x = x0; x < x1; x++) {
+                float px = x + 0.5f;
+                if (px < placed.minX || px >= placed.maxX) {
+                    continue;
+                }
+                uint32_t texelX = std::min(image.width - 1, static_cast<uint32_t>((px - placed.minX) * texelsX));
+                const uint8_t* texel = texels + static_cast<size_t>(texelX) * 4;
+                float alpha = texel[3] / 255.0f;
+                uint8_t* pixel = row + static_cast<size_t>(x) * 3;
+                for (int c = 0; c < 3; c++) {
+                    pixel[c] = static_cast<uint8_t>(pixel[c] + (texel[c] - pixel[c]) * alpha + 0.5f);
+                }
+            }
+        }
+    }
+
+    bool writeImagePng(const std::string& path, uint32_t width, uint32_t height, const std::vector<uint8_t>& rgba)
+    {
+        PngWriter png;
+        if (!png.open(path, width, height, true)) {
+            return false;
+        }
+        for (uint32_t row = 0; row < height; row++) {
+            if (!png.writeRow(rgba.data() + static_cast<size_t>(row) * width * 4)) {
+                return false;
+            }
+        }
+        return png.finish();
+    }
+
+    std::string escapeXml(const std::string& text)
+    {
+        std::string escaped;
+        for (char c : text) {
+            switch (c) {
+            case '&': escaped += "&amp;"; break;
+            case '<': escaped += "&lt;"; break;
+            case '>': escaped += "&gt;"; break;
+            case '"': escaped += "&quot;"; break;
+            default: escaped += c; break;
+            }
+        }
+        return escaped;
+    }
+
+    uint8_t toByte(float value)
+    {
+        return static_cast<uint8_t>(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+}
+
+Exporter::~Exporter()
+{
+    cancel();
+    if (m_Thread.joinable()) {
+        m_Thread.join();
+    }
+}
+
+bool Exporter::start(DocumentPtr document, const ExportSettings& settings,
+    std::future<std::vector<StrokePtr>> paged)
+{
+    if (m_Running) {
+        return false;
+    }
+    if (m_Thread.joinable()) {
+        m_Thread.join();
+    }
+
+    m_Document = std::move(document);
+    m_Paged = std::move(paged);
+    m_Settings = settings;
+    m_MissingImages = 0;
+    m_Written.clear();
+    m_Cancel = false;
+    m_Progress = 0.0f;
+    m_Running = true;
+    setStatus("Exporting " + settings.path);
+
+    m_Thread = std::thread(&Exporter::run, this);
+    return true;
+}
+
+void Exporter::cancel()
+{
+    m_Cancel = true;
+}
+
+void Exporter::getStatus(std::string& status) const
+{
+    std::lock_guard<std::mutex> lock(m_StatusMutex);
+    status = m_Status;
+}
+
+void Exporter::setStatus(const std::string& status)
+{
+    std::lock_guard<std::mutex> lock(m_StatusMutex);
+    m_Status = status;
+}
+
+void Exporter::measure(const std::vector<StrokePtr>& strokes, const std::vector<BoardImage>& images,
+    const ExportSettings& settings, uint32_t& width, uint32_t& height, const Rect& alsoCovering)
+{
+    Rect bounds = boardBounds(strokes, images, settings.margin, alsoCovering);
+    width = static_cast<uint32_t>(std::min(4e9, std::max(1.0, std::ceil(bounds.width() * settings.scale))));
+    height = static_cast<uint32_t>(std::min(4e9, std::max(1.0, std::ceil(bounds.height() * settings.scale))));
+}
+
+void Exporter::addPaged()
+{
+    std::vector<StrokePtr> paged;
+    try {
+        paged = m_Paged.get();
+    }
+    catch (const std::future_error&) {
+        return; // The board went away first
+    }
+    if (paged.empty()) {
+        return;
+    }
+
+    // A stroke sent again while paged out is in the document already
+    auto whole = std::make_shared<BoardDocument>(*m_Document);
+    std::unordered_set<uint64_t> ids;
+    for (const auto& stroke : whole->strokes) {
+        ids.insert(stroke->id);
+    }
+    for (auto& stroke : paged) {
+        if (ids.insert(stroke->id).second) {
+            whole->strokes.push_back(std::move(stroke));
+        }
+    }
+    std::sort(whole->strokes.begin(), whole->strokes.end(), [](const StrokePtr& a, const StrokePtr& b) {
+        return a->order < b->order;
+    });
+    m_Document = std::move(whole);
+}
+
+void Exporter::run()
+{
+    if (m_Paged.valid()) {
+        addPaged();
+    }
+
+    std::string error;
+    bool ok = m_Settings.format == ExportFormat::Png ? exportPng(error) : exportSvg(error);
+
+    if (m_Cancel) {
+        std::error_code ignored;
+        std::filesystem::remove(m_Settings.path, ignored);
+        for (const auto& path : m_Written) {
+            std::filesystem::remove(path, ignored);
+        }
+        setStatus("Export cancelled");
+    }
+    else if (ok) {
+        m_Progress = 1.0f;
+        if (m_MissingImages > 0) {
+            setStatus("Exported " + m_Settings.path + " without " + std::to_string(m_MissingImages) +
+                " image(s) not downloaded yet");
+        }
+        else {
+            setStatus("Exported " + m_Settings.path);
+        }
+    }
+    else {
+        std::cerr << "Export failed: " << error << std::endl;
+        setStatus("Export failed: " + error);
+    }
+
+    m_Document.reset();
+    m_Running = false;
+}
+
+bool Exporter::readImage(const BoardImage& image, uint32_t& width, uint32_t& height, std::vector<uint8_t>& rgba)
+{
+    std::vector<uint8_t> blob;
+    if (!m_Blobs.read(image.blobHash, blob) || !ImageCache::decodeImage(blob, width, height, rgba)) {
+        m_MissingImages++;
+        rgba.clear();
+        return false;
+    }
+    return true;
+}
+
+bool Exporter::exportPng(std::string& error)
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    const auto& strokes = m_Document->strokes;
+    const auto& images = m_Document->images;
+    measure(strokes, images, m_Settings, width, height);
+    if (width > MAX_EXPORT_DIMENSION || height > MAX_EXPORT_DIMENSION) {
+        error = "image would be " + std::to_string(width) + "x" + std::to_string(height) + " pixels";
+        return false;
+    }
+
+    PngWriter png;
+    if (!png.open(m_Settings.path, width, height)) {
+        error = "cannot open " + m_Settings.path;
+        return false;
+    }
+
+    Rect bounds = boardBounds(strokes, images, m_Settings.margin);
+    const float scale = m_Settings.scale;
+    const int tileSize = std::max(16, m_Settings.tileSize);
+    const uint32_t bandHeight = static_cast<uint32_t>(std::clamp<size_t>(
+        BAND_BUDGET_BYTES / (static_cast<size_t>(width) * 3), 1, static_cast<size_t>(tileSize)));
+
+    std::array<uint8_t, 3> background = {
+        toByte(m_Settings.background[0]), toByte(m_Settings.background[1]), toByte(m_Settings.background[2]) };
+
+    std::vector<uint8_t> band(static_cast<size_t>(width) * bandHeight * 3);
+    std::vector<PixelSegment> bandSegments;
+    std::vector<const PixelSegment*> tileSegments;
+    std::vector<OutlinePoint> outline;
+
+    // A blob is decoded when the first band reaches an image of it and dropped
+    // after the last, so only images crossing the band are held decoded
+    std::vector<PixelImage> pixelImages;
+    std::unordered_map<std::string, float> lastRows;
+    for (size_t i = 0; i < images.size(); i++) {
+        const Rect& placed = images[i].bounds;
+        PixelImage pixels = { i,
+            static_cast<float>((placed.minX - bounds.minX) * scale), static_cast<float>((placed.minY - bounds.minY) * scale),
+            static_cast<float>((placed.maxX - bounds.minX) * scale), static_cast<float>((placed.maxY - bounds.minY) * scale) };
+        if (pixels.maxX > pixels.minX && pixels.maxY > pixels.minY) {
+            pixelImages.push_back(pixels);
+            float& lastRow = lastRows[images[i].blobHash];
+            lastRow = std::max(lastRow, pixels.maxY);
+        }
+    }
+    std::unordered_map<std::string, DecodedImage> decoded;
+
+    for (uint32_t bandY = 0; bandY < height; bandY += bandHeight) {
+        uint32_t rows = std::min(bandHeight, height - bandY);
+        for (size_t i = 0; i < static_cast<size_t>(width) * rows; i++) {
+            std::copy(background.begin(), background.end(), band.begin() + i * 3);
+        }
+
+        // Images go underneath the strokes
+        for (const auto& placed : pixelImages) {
+            if (placed.maxY <= bandY || placed.minY >= bandY + rows) {
+                continue;
+            }
+            const BoardImage& image = images[placed.index];
+            auto it = decoded.find(image.blobHash);
+            if (it == decoded.end()) {
+                DecodedImage pixels;
+                readImage(image, pixels.width, pixels.height, pixels.rgba);
+                it = decoded.emplace(image.blobHash, std::move(pixels)).first;
+            }
+            if (!it->second.rgba.empty()) {
+                drawImage(it->second, placed, band, width, bandY, rows);
+            }
+        }
+        for (auto it = decoded.begin(); it != decoded.end();) {
+            it = lastRows[it->first] <= bandY + rows ? decoded.erase(it) : std::next(it);
+        }
+
+        // Segments touching this band, in pixel space
+        double bandTop = bounds.minY + bandY / scale;
+        double bandBottom = bounds.minY + (bandY + rows) / scale;
+        bandSegments.clear();
+        for (const auto& stroke : strokes) {
+            if (stroke->bounds.maxY < bandTop || stroke->bounds.minY > bandBottom) {
+                continue;
+            }
+            // Pixel position of the stroke's tile origin; the offsets from it are small
+            CanvasPoint origin = stroke->origin();
+            float baseX = static_cast<float>((origin.x - bounds.minX) * scale);
+            float baseY = static_cast<float>((origin.y - bounds.minY) * scale);
+            float step = static_cast<float>(stroke->step() * scale);
+
+            // Shapes are outlined at the export resolution; freehand strokes are their points
+            outline.clear();
+            if (stroke->isShape()) {
+                appendShapeOutline(*stroke, stroke->step() * scale, outline);
+            }
+            else {
+                for (const auto& point : stroke->points) {
+                    outline.push_back({ static_cast<float>(point.x), static_cast<float>(point.y) });
+                }
+            }
+
+            for (size_t i = 1; i < outline.size(); i++) {
+                const auto& p1 = outline[i - 1];
+                const auto& p2 = outline[i];
+                PixelSegment segment;
+                segment.ax = baseX + p1.x * step;
+                segment.ay = baseY + p1.y * step;
+                segment.bx = baseX + p2.x * step;
+                segment.by = baseY + p2.y * step;
+                segment.halfWidth = std::max(static_cast<float>(stroke->width()) * scale, 1.0f) * 0.5f;
+                segment.r = stroke->color[0] * 255.0f;
+                segment.g = stroke->color[1] * 255.0f;
+                segment.b = stroke->color[2] * 255.0f;
+                segment.minX = std::min(segment.ax, segment.bx) - segment.halfWidth - 1.0f;
+                segment.maxX = std::max(segment.ax, segment.bx) + segment.halfWidth + 1.0f;
+                segment.minY = std::min(segment.ay, segment.by) - segment.halfWidth - 1.0f;
+                segment.maxY = std::max(segment.ay, segment.by) + segment.halfWidth + 1.0f;
+                if (segment.maxY >= bandY && segment.minY <= bandY + rows) {
+                    bandSegments.push_back(segment);
+                }
+            }
+        }
+
+        // Tile by tile across the band, in stroke order within each tile
+        for (uint32_t tileX = 0; tileX < width; tileX += tileSize) {
+            if (m_Cancel) {
+                png.abort();
+                return false;
+            }
+
+            int tileX1 = static_cast<int>(std::min<uint32_t>(width, tileX + tileSize));
+            tileSegments.clear();
+            for (const auto& segment : bandSegments) {
+                if (segment.maxX >= tileX && segment.minX <= tileX1) {
+                    tileSegments.push_back(&segment);
+                }
+            }
+            for (const PixelSegment* segment : tileSegments) {
+                rasterizeSegment(*segment, band, width, bandY,
+                    static_cast<int>(tileX), tileX1, static_cast<int>(bandY), static_cast<int>(bandY + rows));
+            }
+        }
+
+        for (uint32_t row = 0; row < rows; row++) {
+            if (!png.writeRow(band.data() + static_cast<size_t>(row) * width * 3)) {
+                error = "write failed";
+                return false;
+            }
+        }
+        m_Progress = static_cast<float>(bandY + rows) / height;
+    }
+
+    if (!png.finish()) {
+        error = "write failed";
+        return false;
+    }
+    return true;
+}
+
+bool Exporter::exportSvg(std::string& error)
+{
+    std::ofstream file(m_Settings.path, std::ios::trunc);
+    if (!file) {
+        error = "cannot open " + m_Settings.path;
+        return false;
+    }
+
+    const auto& strokes = m_Document->strokes;
+    const auto& images = m_Document->images;
+    Rect bounds = boardBounds(strokes, images, m_Settings.margin);
+    std::vector<OutlinePoint> outline;
+    auto colorString = [](const std::array<float, 3>& color) {
+        return "rgb(" + std::to_string(toByte(color[0])) + "," + std::to_string(toByte(color[1])) + "," +
+            std::to_string(toByte(color[2])) + ")";
+    };
+
+    // Coordinates are written relative to the board's corner, so they stay short
+    // and exact however far out the board is
+    file << "<svg xmlns=\"http://www.w3.org/2000/svg\""
+        << " width=\"" << bounds.width() * m_Settings.scale << "\""
+        << " height=\"" << bounds.height() * m_Settings.scale << "\""
+        << " viewBox=\"0 0 " << bounds.width() << " " << bounds.height() << "\">\n";
+    file << "<rect x=\"0\" y=\"0\" width=\"" << bounds.width()
+        << "\" height=\"" << bounds.height() << "\" fill=\"" << colorString(m_Settings.background) << "\"/>\n";
+
+    // Images go underneath the strokes. Each blob is written once, as a PNG
+    // named after the SVG and the blob's hash, and linked by its file name.
+    std::filesystem::path svgPath(m_Settings.path);
+    std::unordered_map<std::string, std::string> imageFiles; // Empty for blobs that are missing
+    for (const auto& image : images) {
+        if (m_Cancel) {
+            return false;
+        }
+
+        auto [imageFile, added] = imageFiles.try_emplace(image.blobHash);
+        if (added) {
+            uint32_t width = 0;
+            uint32_t height = 0;
+            std::vector<uint8_t> rgba;
+            if (readImage(image, width, height, rgba)) {
+                std::string name = svgPath.stem().string() + "-" + image.blobHash.substr(0, 16) + ".png";
+                std::string path = (svgPath.parent_path() / name).string();
+                if (!writeImagePng(path, width, height, rgba)) {
+                    error = "cannot write " + path;
+                    return false;
+                }
+                m_Written.push_back(path);
+                imageFile->second = name;
+            }
+        }
+        if (imageFile->second.empty()) {
+            continue;
+        }
+
+        file << "<image x=\"" << image.bounds.minX - bounds.minX << "\" y=\"" << image.bounds.minY - bounds.minY
+            << "\" width=\"" << image.bounds.width() << "\" height=\"" << image.bounds.height()
+            << "\" preserveAspectRatio=\"none\" href=\"" << escapeXml(imageFile->second) << "\"/>\n";
+    }
+
+    for (size_t s = 0; s < strokes.size(); s++) {
+        if (m_Cancel) {
+            return false;
+        }
+
+        const Stroke& stroke = *strokes[s];
+        if (stroke.points.size() < 2) {
+            continue;
+        }
+
+        CanvasPoint origin = stroke.origin();
+        double baseX = origin.x - bounds.minX;
+        double baseY = origin.y - bounds.minY;
+        double step = stroke.step();
+        auto x = [&](const Point& point) { return baseX + point.x * step; };
+        auto y = [&](const Point& point) { return baseY + point.y * step; };
+        const Point& a = stroke.points[0];
+        const Point& b = stroke.points[1];
+
+        file << "<";
+        switch (stroke.kind) {
+        case StrokeKind::Rectangle:
+            file << "rect x=\"" << std::min(x(a), x(b)) << "\" y=\"" << std::min(y(a), y(b))
+                << "\" width=\"" << std::abs(x(b) - x(a)) << "\" height=\"" << std::abs(y(b) - y(a)) << "\"";
+            break;
+        case StrokeKind::Ellipse:
+            file << "ellipse cx=\"" << 0.5 * (x(a) + x(b)) << "\" cy=\"" << 0.5 * (y(a) + y(b))
+                << "\" rx=\"" << 0.5 * std::abs(x(b) - x(a)) << "\" ry=\"" << 0.5 * std::abs(y(b) - y(a)) << "\"";
+            break;
+        case StrokeKind::Arrow: {
+            outline.clear();
+            appendShapeOutline(stroke, 1.0, outline);
+            file << "path d=\"";
+            for (size_t i = 0; i < outline.size(); i++) {
+                file << (i == 0 ? "M" : " L") << baseX + outline[i].x * step << " " << baseY + outline[i].y * step;
+            }
+            file << "\"";
+            break;
+        }
+        default:
+            file << "path d=\"";
+            for (size_t i = 0; i < stroke.points.size(); i++) {
+                file << (i == 0 ? "M" : " L") << x(stroke.points[i]) << " " << y(stroke.points[i]);
+            }
+            file << "\"";
+            break;
+        }
+        file << " fill=\"none\" stroke-linecap=\"round\" stroke-linejoin=\"round\""
+            << " stroke=\"" << colorString(stroke.color) << "\""
+            << " stroke-width=\"" << stroke.width() << "\"/>\n";
+
+        m_Progress = static_cast<float>(s + 1) / strokes.size();
+    }
+
+    file << "</svg>\n";
+    if (!file) {
+        error = "write failed";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <array>
+#include <future>
+
+#include "BoardDocument.h"
+#include "BlobStore.h"
+
+enum class ExportFormat { Png, Svg };
+
+struct ExportSettings {
+    std::string path;
+    ExportFormat format = ExportFormat::Png;
+    float scale = 1.0f;        // Output pixels per canvas unit
+    float margin = 16.0f;      // Canvas units around the strokes
+    int tileSize = 256;        // Raster tile edge in pixels
+    std::array<float, 3> background = { 1.0f, 1.0f, 1.0f };
+};
+
+// Exports one published version of the board on a background thread.
+// PNGs are rasterized tile by tile into a band of rows that is streamed to the
+// encoder, so memory stays bounded at any resolution; SVGs write one path per stroke
+// and native elements for shapes. Images are read from the blob store on the
+// export thread; an SVG links to them as PNG files written next to it.
+class Exporter {
+public:
+    explicit Exporter(const BlobStore& blobs) : m_Blobs(blobs) {}
+    ~Exporter();
+
+    Exporter(const Exporter&) = delete;
+    Exporter& operator=(const Exporter&) = delete;
+
+    // Returns false if an export is already running. The document is shared,
+    // not copied, so drawing goes on meanwhile without touching it. Strokes
+    // not in it, e.g. paged out ones, can follow through paged; the export
+    // thread waits for them.
+    bool start(DocumentPtr document, const ExportSettings& settings,
+        std::future<std::vector<StrokePtr>> paged = {});
+    void cancel();
+
+    bool isRunning() const { return m_Running; }
+    float getProgress() const { return m_Progress; }
+    // Copies the status into status, reusing its memory
+    void getStatus(std::string& status) const;
+
+    // Pixel size a PNG export of strokes and images would have. alsoCovering is
+    // included too, e.g. for strokes that are not in memory.
+    static void measure(const std::vector<StrokePtr>& strokes, const std::vector<BoardImage>& images,
+        const ExportSettings& settings, uint32_t& width, uint32_t& height, const Rect& alsoCovering = Rect());
+
+private:
+    void run();
+    void addPaged();
+    bool exportPng(std::string& error);
+    bool exportSvg(std::string& error);
+    bool readImage(const BoardImage& image, uint32_t& width, uint32_t& height, std::vector<uint8_t>& rgba);
+    void setStatus(const std::string& status);
+
+    const BlobStore& m_Blobs;
+    std::thread m_Thread;
+    std::atomic<bool> m_Running{ false };
+    std::atomic<bool> m_Cancel{ false };
+    std::atomic<float> m_Progress{ 0.0f };
+
+    mutable std::mutex m_StatusMutex;
+    std::string m_Status;
+
+    // Owned by the export thread while it runs
+    DocumentPtr m_Document;
+    std::future<std::vector<StrokePtr>> m_Paged;
+    ExportSettings m_Settings;
+    size_t m_MissingImages = 0;        // Images whose blobs have not arrived yet
+    std::vector<std::string> m_Written; // Files next to an SVG, removed again on cancel
+};
@@ -0,0 +1,51 @@
+#include "FrameArena.h"
+#include <algorithm>
+
+FrameArena::FrameArena(size_t blockBytes)
+    : m_BlockBytes(blockBytes)
+{
+    addBlock(m_BlockBytes);
+}
+
+void FrameArena::reset()
+{
+    // A frame that spilled into more blocks gets them as one from now on, so
+    // the next frame like it fits without allocating
+    if (m_Blocks.size() > 1) {
+        size_t total = m_Capacity;
+        m_Blocks.clear();
+        m_Capacity = 0;
+        addBlock(total);
+    }
+    m_Current = 0;
+    m_Offset = 0;
+    m_Used = 0;
+}
+
+void* FrameArena::do_allocate(size_t bytes, size_t alignment)
+{
+    while (true) {
+        Block& block = m_Blocks[m_Current];
+        void* at = block.data.get() + m_Offset;
+        size_t space = block.size - m_Offset;
+        if (std::align(alignment, bytes, at, space) != nullptr) {
+            m_Offset = block.size - space + bytes;
+            m_Used += bytes;
+            return at;
+        }
+        if (m_Current + 1 == m_Blocks.size()) {
+            addBlock(std::max(m_BlockBytes, bytes + alignment));
+        }
+        m_Current++;
+        m_Offset = 0;
+    }
+}
+
+void FrameArena::addBlock(size_t bytes)
+{
+    Block block;
+    block.data = std::make_unique<std::byte[]>(bytes);
+    block.size = bytes;
+    m_Blocks.push_back(std::move(block));
+    m_Capacity += bytes;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <memory_resource>
+#include <memory>
+#include <vector>
+#include <cstddef>
+
+// Bump allocator for data that only lives until the end of the frame, handed to
+// std::pmr containers. Allocating is a pointer bump and nothing is freed on its
+// own; reset() at the start of a frame takes everything back at once. Memory is
+// kept between frames, so once a frame's needs are known it never touches the heap.
+class FrameArena : public std::pmr::memory_resource {
+public:
+    explicit FrameArena(size_t blockBytes = 64 * 1024);
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    // Invalidates everything allocated since the last reset
+    void reset();
+
+    // Bytes handed out since the last reset, and held in total
+    size_t getUsed() const { return m_Used; }
+    size_t getCapacity() const { return m_Capacity; }
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void*, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    void addBlock(size_t bytes);
+
+    struct Block {
+        std::unique_ptr<std::byte[]> data;
+        size_t size = 0;
+    };
+
+    size_t m_BlockBytes;
+    std::vector<Block> m_Blocks;
+    size_t m_Current = 0;  // Block being bumped through
+    size_t m_Offset = 0;   // Next free byte in it
+    size_t m_Used = 0;
+    size_t m_Capacity = 0;
+};
@@ -0,0 +1,460 @@
+#include "Geometry.h"
+#include "Stroke.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <limits>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define LV_GEOMETRY_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC takes any intrinsic in any function
+#define LV_TARGET_SSE2
+#define LV_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define LV_TARGET_SSE2 __attribute__((target("sse2")))
+#define LV_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+static_assert(sizeof(Point) == 4, "kernels load points as 32-bit x, y pairs");
+
+namespace {
+    // Scalar reference. The vector kernels below do exactly these operations per
+    // lane and fall back to these for whatever is left over at the end.
+
+    void transformScalar(const Point* points, size_t count, float baseX, float baseY, float step, float* out)
+    {
+        for (size_t i = 0; i < count; i++) {
+            out[2 * i] = baseX + static_cast<float>(points[i].x) * step;
+            out[2 * i + 1] = baseY + static_cast<float>(points[i].y) * step;
+        }
+    }
+
+    void boundsScalar(const Point* points, size_t count, Point& min, Point& max)
+    {
+        for (size_t i = 0; i < count; i++) {
+            min.x = std::min(min.x, points[i].x);
+            min.y = std::min(min.y, points[i].y);
+            max.x = std::max(max.x, points[i].x);
+            max.y = std::max(max.y, points[i].y);
+        }
+    }
+
+    float segmentDistanceSquared(float ax, float ay, float bx, float by, float x, float y)
+    {
+        float dx = bx - ax;
+        float dy = by - ay;
+        float wx = x - ax;
+        float wy = y - ay;
+        float length = dx * dx + dy * dy;
+        float t = 0.0f;
+        if (length > 0.0f) {
+            // Clamped the way the vector max/min do, so signed zeros come out alike
+            t = (wx * dx + wy * dy) / length;
+            t = t > 0.0f ? t : 0.0f;
+            t = t < 1.0f ? t : 1.0f;
+        }
+        float cx = wx - t * dx;
+        float cy = wy - t * dy;
+        return cx * cx + cy * cy;
+    }
+
+    // Segments from first on; count is at least 2
+    float distanceScalar(const Point* points, size_t first, size_t count, float x, float y, float best)
+    {
+        for (size_t k = first; k + 1 < count; k++) {
+            best = std::min(best, segmentDistanceSquared(
+                static_cast<float>(points[k].x), static_cast<float>(points[k].y),
+                static_cast<float>(points[k + 1].x), static_cast<float>(points[k + 1].y), x, y));
+        }
+        return best;
+    }
+
+    float distanceScalar(const Point* points, size_t count, float x, float y)
+    {
+        return distanceScalar(points, 0, count, x, y, std::numeric_limits<float>::infinity());
+    }
+
+    // Coordinate differences saturate at +-32767, so the squared distance fits an int32
+    int32_t clampedDistanceSquared(const Point& a, const Point& b)
+    {
+        int32_t dx = std::clamp(int32_t(b.x) - int32_t(a.x), -32767, 32767);
+        int32_t dy = std::clamp(int32_t(b.y) - int32_t(a.y), -32767, 32767);
+        return dx * dx + dy * dy;
+    }
+
+    // First index in [from, end) at least limit (squared) away from anchor, or end
+    size_t findFarScalar(const Point* points, size_t from, size_t end, const Point& anchor, int32_t limit)
+    {
+        for (; from < end; from++) {
+            if (clampedDistanceSquared(anchor, points[from]) >= limit) {
+                return from;
+            }
+        }
+        return end;
+    }
+
+#ifdef LV_GEOMETRY_X86
+    // A point as the 32-bit lane it loads into: x in the low half, y in the high
+    int32_t packPoint(const Point& point)
+    {
+        return static_cast<int32_t>(static_cast<uint16_t>(point.x) | (static_cast<uint32_t>(static_cast<uint16_t>(point.y)) << 16));
+    }
+
+    Point unpackPoint(int32_t packed)
+    {
+        return { static_cast<int16_t>(packed & 0xFFFF), static_cast<int16_t>(packed >> 16) };
+    }
+
+    LV_TARGET_SSE2 void transformSse2(const Point* points, size_t count, float baseX, float baseY, float step, float* out)
+    {
+        __m128 scale = _mm_set1_ps(step);
+        __m128 base = _mm_setr_ps(baseX, baseY, baseX, baseY);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(points + i));
+            // Each 16-bit coordinate doubled up, then shifted down with its sign
+            __m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(packed, packed), 16);
+            __m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(packed, packed), 16);
+            _mm_storeu_ps(out + 2 * i, _mm_add_ps(base, _mm_mul_ps(_mm_cvtepi32_ps(low), scale)));
+            _mm_storeu_ps(out + 2 * i + 4, _mm_add_ps(base, _mm_mul_ps(_mm_cvtepi32_ps(high), scale)));
+        }
+        transformScalar(points + i, count - i, baseX, baseY, step, out + 2 * i);
+    }
+
+    LV_TARGET_SSE2 void boundsSse2(const Point* points, size_t count, Point& min, Point& max)
+    {
+        __m128i low = _mm_set1_epi32(packPoint(min));
+        __m128i high = _mm_set1_epi32(packPoint(max));
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(points + i));
+            low = _mm_min_epi16(low, packed);
+            high = _mm_max_epi16(high, packed);
+        }
+        // Fold the four x, y pairs into one
+        low = _mm_min_epi16(low, _mm_shuffle_epi32(low, _MM_SHUFFLE(1, 0, 3, 2)));
+        low = _mm_min_epi16(low, _mm_shuffle_epi32(low, _MM_SHUFFLE(2, 3, 0, 1)));
+        high = _mm_max_epi16(high, _mm_shuffle_epi32(high, _MM_SHUFFLE(1, 0, 3, 2)));
+        high = _mm_max_epi16(high, _mm_shuffle_epi32(high, _MM_SHUFFLE(2, 3, 0, 1)));
+        min = unpackPoint(_mm_cvtsi128_si32(low));
+        max = unpackPoint(_mm_cvtsi128_si32(high));
+        boundsScalar(points + i, count - i, min, max);
+    }
+
+    LV_TARGET_SSE2 float distanceSse2(const Point* points, size_t count, float x, float y)
+    {
+        __m128 px = _mm_set1_ps(x);
+        __m128 py = _mm_set1_ps(y);
+        __m128 zero = _mm_setzero_ps();
+        __m128 one = _mm_set1_ps(1.0f);
+        __m128 best = _mm_set1_ps(std::numeric_limits<float>::infinity());
+        size_t k = 0;
+        // Four segments: points k..k+3 to k+1..k+4
+        for (; k + 5 <= count; k += 4) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(points + k));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(points + k + 1));
+            __m128 ax = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16));
+            __m128 ay = _mm_cvtepi32_ps(_mm_srai_epi32(a, 16));
+            __m128 bx = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+            __m128 by = _mm_cvtepi32_ps(_mm_srai_epi32(b, 16));
+
+            __m128 dx = _mm_sub_ps(bx, ax);
+            __m128 dy = _mm_sub_ps(by, ay);
+            __m128 wx = _mm_sub_ps(px, ax);
+            __m128 wy = _mm_sub_ps(py, ay);
+            __m128 length = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+            __m128 t = _mm_div_ps(_mm_add_ps(_mm_mul_ps(wx, dx), _mm_mul_ps(wy, dy)), length);
+            t = _mm_min_ps(_mm_max_ps(t, zero), one);
+            t = _mm_and_ps(t, _mm_cmpgt_ps(length, zero));
+            __m128 cx = _mm_sub_ps(wx, _mm_mul_ps(t, dx));
+            __m128 cy = _mm_sub_ps(wy, _mm_mul_ps(t, dy));
+            best = _mm_min_ps(best, _mm_add_ps(_mm_mul_ps(cx, cx), _mm_mul_ps(cy, cy)));
+        }
+        float lanes[4];
+        _mm_storeu_ps(lanes, best);
+        float result = std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+        return distanceScalar(points, k, count, x, y, result);
+    }
+
+    LV_TARGET_SSE2 size_t findFarSse2(const Point* points, size_t from, size_t end, const Point& anchor, int32_t limit)
+    {
+        __m128i center = _mm_set1_epi32(packPoint(anchor));
+        __m128i floor = _mm_set1_epi16(-32767);
+        __m128i threshold = _mm_set1_epi32(limit - 1);
+        for (; from + 4 <= end; from += 4) {
+            __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(points + from));
+            __m128i delta = _mm_max_epi16(_mm_subs_epi16(packed, center), floor);
+            __m128i squared = _mm_madd_epi16(delta, delta); // dx * dx + dy * dy per point
+            int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(squared, threshold)));
+            if (mask != 0) {
+                return from + std::countr_zero(static_cast<unsigned>(mask));
+            }
+        }
+        return findFarScalar(points, from, end, anchor, limit);
+    }
+
+    LV_TARGET_AVX2 void transformAvx2(const Point* points, size_t count, float baseX, float baseY, float step, float* out)
+    {
+        __m256 scale = _mm256_set1_ps(step);
+        __m256 base = _mm256_setr_ps(baseX, baseY, baseX, baseY, baseX, baseY, baseX, baseY);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(points + i));
+            __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(points + i + 4));
+            __m256 lowXY = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(low));
+            __m256 highXY = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(high));
+            _mm256_storeu_ps(out + 2 * i, _mm256_add_ps(base, _mm256_mul_ps(lowXY, scale)));
+            _mm256_storeu_ps(out + 2 * i + 8, _mm256_add_ps(base, _mm256_mul_ps(highXY, scale)));
+        }
+        transformScalar(points + i, count - i, baseX, baseY, step, out + 2 * i);
+    }
+
+    LV_TARGET_AVX2 void boundsAvx2(const Point* points, size_t count, Point& min, Point& max)
+    {
+        __m256i low = _mm256_set1_epi32(packPoint(min));
+        __m256i high = _mm256_set1_epi32(packPoint(max));
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256i packed = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(points + i));
+            low = _mm256_min_epi16(low, packed);
+            high = _mm256_max_epi16(high, packed);
+        }
+        __m128i low4 = _mm_min_epi16(_mm256_castsi256_si128(low), _mm256_extracti128_si256(low, 1));
+        __m128i high4 = _mm_max_epi16(_mm256_castsi256_si128(high), _mm256_extracti128_si256(high, 1));
+        low4 = _mm_min_epi16(low4, _mm_shuffle_epi32(low4, _MM_SHUFFLE(1, 0, 3, 2)));
+        low4 = _mm_min_epi16(low4, _mm_shuffle_epi32(low4, _MM_SHUFFLE(2, 3, 0, 1)));
+        high4 = _mm_max_epi16(high4, _mm_shuffle_epi32(high4, _MM_SHUFFLE(1, 0, 3, 2)));
+        high4 = _mm_max_epi16(high4, _mm_shuffle_epi32(high4, _MM_SHUFFLE(2, 3, 0, 1)));
+        min = unpackPoint(_mm_cvtsi128_si32(low4));
+        max = unpackPoint(_mm_cvtsi128_si32(high4));
+        boundsScalar(points + i, count - i, min, max);
+    }
+
+    LV_TARGET_AVX2 float distanceAvx2(const Point* points, size_t count, float x, float y)
+    {
+        __m256 px = _mm256_set1_ps(x);
+        __m256 py = _mm256_set1_ps(y);
+        __m256 zero = _mm256_setzero_ps();
+        __m256 one = _mm256_set1_ps(1.0f);
+        __m256 best = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+        size_t k = 0;
+        for (; k + 9 <= count; k += 8) {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(points + k));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(points + k + 1));
+            __m256 ax = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16));
+            __m256 ay = _mm256_cvtepi32_ps(_mm256_srai_epi32(a, 16));
+            __m256 bx = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16));
+            __m256 by = _mm256_cvtepi32_ps(_mm256_srai_epi32(b, 16));
+
+            __m256 dx = _mm256_sub_ps(bx, ax);
+            __m256 dy = _mm256_sub_ps(by, ay);
+            __m256 wx = _mm256_sub_ps(px, ax);
+            __m256 wy = _mm256_sub_ps(py, ay);
+            __m256 length = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+            __m256 t = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(wx, dx), _mm256_mul_ps(wy, dy)), length);
+            t = _mm256_min_ps(_mm256_max_ps(t, zero), one);
+            t = _mm256_and_ps(t, _mm256_cmp_ps(length, zero, _CMP_GT_OQ));
+            __m256 cx = _mm256_sub_ps(wx, _mm256_mul_ps(t, dx));
+            __m256 cy = _mm256_sub_ps(wy, _mm256_mul_ps(t, dy));
+            best = _mm256_min_ps(best, _mm256_add_ps(_mm256_mul_ps(cx, cx), _mm256_mul_ps(cy, cy)));
+        }
+        float lanes[8];
+        _mm256_storeu_ps(lanes, best);
+        float result = *std::min_element(lanes, lanes + 8);
+        return distanceScalar(points, k, count, x, y, result);
+    }
+
+    LV_TARGET_AVX2 size_t findFarAvx2(const Point* points, size_t from, size_t end, const Point& anchor, int32_t limit)
+    {
+        __m256i center = _mm256_set1_epi32(packPoint(anchor));
+        __m256i floor = _mm256_set1_epi16(-32767);
+        __m256i threshold = _mm256_set1_epi32(limit - 1);
+        for (; from + 8 <= end; from += 8) {
+            __m256i packed = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(points + from));
+            __m256i delta = _mm256_max_epi16(_mm256_subs_epi16(packed, center), floor);
+            __m256i squared = _mm256_madd_epi16(delta, delta);
+            int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(squared, threshold)));
+            if (mask != 0) {
+                return from + std::countr_zero(static_cast<unsigned>(mask));
+            }
+        }
+        return findFarScalar(points, from, end, anchor, limit);
+    }
+#endif
+
+    struct Kernels {
+        void (*transform)(const Point*, size_t, float, float, float, float*);
+        void (*bounds)(const Point*, size_t, Point&, Point&);
+        float (*distance)(const Point*, size_t, float, float);
+        size_t (*findFar)(const Point*, size_t, size_t, const Point&, int32_t);
+    };
+
+    const Kernels SCALAR_KERNELS = { transformScalar, boundsScalar, distanceScalar, findFarScalar };
+#ifdef LV_GEOMETRY_X86
+    const Kernels SSE2_KERNELS = { transformSse2, boundsSse2, distanceSse2, findFarSse2 };
+    const Kernels AVX2_KERNELS = { transformAvx2, boundsAvx2, distanceAvx2, findFarAvx2 };
+#endif
+
+    SimdLevel detectSimdLevel()
+    {
+#ifdef LV_GEOMETRY_X86
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        int maxLeaf = info[0];
+        __cpuid(info, 1);
+        bool sse2 = (info[3] & (1 << 26)) != 0;
+        // AVX registers also need saving by the OS
+        bool avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+        bool avx2 = false;
+        if (avx && maxLeaf >= 7) {
+            __cpuidex(info, 7, 0);
+            avx2 = (info[1] & (1 << 5)) != 0;
+        }
+#else
+        unsigned int eax = 0;
+        unsigned int ebx = 0;
+        unsigned int ecx = 0;
+        unsigned int edx = 0;
+        if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0) {
+            return SimdLevel::Scalar;
+        }
+        bool sse2 = (edx & (1u << 26)) != 0;
+        // AVX registers also need saving by the OS; xgetbv is only there with OSXSAVE
+        bool avx = false;
+        if ((ecx & (1u << 27)) != 0 && (ecx & (1u << 28)) != 0) {
+            unsigned int xcr0Low = 0;
+            unsigned int xcr0High = 0;
+            __asm__("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+            avx = (xcr0Low & 6) == 6;
+        }
+        bool avx2 = false;
+        if (avx && __get_cpuid_max(0, nullptr) >= 7) {
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            avx2 = (ebx & (1u << 5)) != 0;
+        }
+#endif
+        if (avx2) {
+            return SimdLevel::Avx2;
+        }
+        if (sse2) {
+            return SimdLevel::Sse2;
+        }
+#endif
+        return SimdLevel::Scalar;
+    }
+
+    const Kernels& kernelsFor(SimdLevel level)
+    {
+        switch (level) {
+#ifdef LV_GEOMETRY_X86
+        case SimdLevel::Avx2:
+            return AVX2_KERNELS;
+        case SimdLevel::Sse2:
+            return SSE2_KERNELS;
+#endif
+        default:
+            return SCALAR_KERNELS;
+        }
+    }
+
+    std::atomic<const Kernels*> g_Kernels{ nullptr };
+    std::atomic<SimdLevel> g_Level{ SimdLevel::Scalar };
+
+    const Kernels& kernels()
+    {
+        const Kernels* current = g_Kernels.load(std::memory_order_acquire);
+        if (current == nullptr) {
+            setSimdLevel(getSupportedSimdLevel());
+            current = g_Kernels.load(std::memory_order_acquire);
+        }
+        return *current;
+    }
+}
+
+SimdLevel getSupportedSimdLevel()
+{
+    static const SimdLevel supported = detectSimdLevel();
+    return supported;
+}
+
+SimdLevel getSimdLevel()
+{
+    kernels();
+    return g_Level.load(std::memory_order_relaxed);
+}
+
+void setSimdLevel(SimdLevel level)
+{
+    level = std::min(level, getSupportedSimdLevel());
+    g_Level.store(level, std::memory_order_relaxed);
+    g_Kernels.store(&kernelsFor(level), std::memory_order_release);
+}
+
+const char* getSimdLevelName(SimdLevel level)
+{
+    switch (level) {
+    case SimdLevel::Scalar: return "scalar";
+    case SimdLevel::Sse2: return "sse2";
+    case SimdLevel::Avx2: return "avx2";
+    }
+    return "";
+}
+
+void transformPoints(const Point* points, size_t count, float baseX, float baseY, float step, float* out)
+{
+    kernels().transform(points, count, baseX, baseY, step, out);
+}
+
+void pointBounds(const Point* points, size_t count, Point& min, Point& max)
+{
+    min = points[0];
+    max = points[0];
+    kernels().bounds(points, count, min, max);
+}
+
+float polylineDistanceSquared(const Point* points, size_t count, float x, float y)
+{
+    if (count == 0) {
+        return std::numeric_limits<float>::infinity();
+    }
+    if (count == 1) {
+        float px = static_cast<float>(points[0].x);
+        float py = static_cast<float>(points[0].y);
+        return segmentDistanceSquared(px, py, px, py, x, y);
+    }
+    return kernels().distance(points, count, x, y);
+}
+
+size_t filterByDistance(const Point* points, size_t count, int minDistance, Point* out)
+{
+    if (count == 0) {
+        return 0;
+    }
+    auto findFar = kernels().findFar;
+    int32_t limit = minDistance * minDistance;
+    Point anchor = points[0];
+    out[0] = anchor;
+    size_t kept = 1;
+    // The last point is kept anyway, so the search stops short of it
+    size_t i = 1;
+    while (i + 1 < count) {
+        size_t far = findFar(points, i, count - 1, anchor, limit);
+        if (far == count - 1) {
+            break;
+        }
+        anchor = points[far];
+        out[kept++] = anchor;
+        i = far + 1;
+    }
+    if (count > 1) {
+        out[kept++] = points[count - 1];
+    }
+    return kept;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+
+struct Point;
+
+// Batch kernels over the stored points of a stroke, run with SSE2 or AVX2 when
+// the CPU has them. Every level performs the same float operations in the same
+// order as the scalar code, so results agree bit for bit whichever one runs.
+enum class SimdLevel { Scalar, Sse2, Avx2 };
+
+// Best level this CPU supports, and the one the kernels currently use
+SimdLevel getSupportedSimdLevel();
+SimdLevel getSimdLevel();
+
+// Makes the kernels use level, capped to what the CPU supports. For benchmarks and checks.
+void setSimdLevel(SimdLevel level);
+const char* getSimdLevelName(SimdLevel level);
+
+// Writes x, y pairs of base + point * step to out, 2 * count floats
+void transformPoints(const Point* points, size_t count, float baseX, float baseY, float step, float* out);
+
+// Smallest box around at least one point
+void pointBounds(const Point* points, size_t count, Point& min, Point& max);
+
+// Squared distance from (x, y) to the nearest segment of the polyline, in the
+// points' units. A single point counts as a segment of length 0. Infinity for none.
+float polylineDistanceSquared(const Point* points, size_t count, float x, float y);
+
+// Keeps the first and last point and, in between, every point at least
+// minDistance (at most 32767) from the one kept before it. Writes what is kept to
+// out, which may be points, and returns how many that is.
+size_t filterByDistance(const Point* points, size_t count, int minDistance, Point* out);
@@ -0,0 +1,140 @@
+#include "ImageCache.h"
+
+#include <cstring>
+#include <iostream>
+
+namespace {
+    const char IMAGE_MAGIC[4] = { 'L', 'V', 'I', '1' };
+    const size_t IMAGE_HEADER_SIZE = 12;
+    const uint32_t MAX_IMAGE_DIMENSION = 16384;
+    static_assert(BlobStore::MAX_BLOB_SIZE == IMAGE_HEADER_SIZE + uint64_t(MAX_IMAGE_DIMENSION) * MAX_IMAGE_DIMENSION * 4,
+        "peers must be able to send the largest image we decode");
+
+    void putLittleEndian(uint8_t* out, uint32_t value)
+    {
+        out[0] = static_cast<uint8_t>(value);
+        out[1] = static_cast<uint8_t>(value >> 8);
+        out[2] = static_cast<uint8_t>(value >> 16);
+        out[3] = static_cast<uint8_t>(value >> 24);
+    }
+
+    uint32_t getLittleEndian(const uint8_t* in)
+    {
+        return uint32_t(in[0]) | (uint32_t(in[1]) << 8) | (uint32_t(in[2]) << 16) | (uint32_t(in[3]) << 24);
+    }
+}
+
+ImageCache::~ImageCache()
+{
+    // Decode tasks hold references to this cache
+    std::unique_lock<std::mutex> lock(m_ReadyMutex);
+    m_ReadyCondition.wait(lock, [this]() { return m_InFlight == 0; });
+}
+
+std::vector<uint8_t> ImageCache::encodeImage(uint32_t width, uint32_t height, const std::vector<uint8_t>& rgba)
+{
+    std::vector<uint8_t> blob(IMAGE_HEADER_SIZE + rgba.size());
+    std::memcpy(blob.data(), IMAGE_MAGIC, 4);
+    putLittleEndian(blob.data() + 4, width);
+    putLittleEndian(blob.data() + 8, height);
+    std::copy(rgba.begin(), rgba.end(), blob.begin() + IMAGE_HEADER_SIZE);
+    return blob;
+}
+
+bool ImageCache::decodeImage(const std::vector<uint8_t>& blob, uint32_t& width, uint32_t& height, std::vector<uint8_t>& rgba)
+{
+    if (blob.size() < IMAGE_HEADER_SIZE || std::memcmp(blob.data(), IMAGE_MAGIC, 4) != 0) {
+        return false;
+    }
+
+    width = getLittleEndian(blob.data() + 4);
+    height = getLittleEndian(blob.data() + 8);
+    if (width == 0 || height == 0 || width > MAX_IMAGE_DIMENSION || height > MAX_IMAGE_DIMENSION ||
+        blob.size() != IMAGE_HEADER_SIZE + static_cast<size_t>(width) * height * 4) {
+        return false;
+    }
+
+    rgba.assign(blob.begin() + IMAGE_HEADER_SIZE, blob.end());
+    return true;
+}
+
+GLuint ImageCache::getTexture(const std::string& hash)
+{
+    auto it = m_Textures.find(hash);
+    if (it != m_Textures.end()) {
+        return it->second;
+    }
+    if (m_Loading.count(hash) != 0 || !m_Blobs.has(hash)) {
+        return 0;
+    }
+
+    m_Loading.insert(hash);
+    {
+        std::lock_guard<std::mutex> lock(m_ReadyMutex);
+        m_InFlight++;
+    }
+    m_Decoder.submit([this, hash]() { decode(hash); });
+    return 0;
+}
+
+void ImageCache::decode(const std::string& hash)
+{
+    DecodedImage image;
+    image.hash = hash;
+
+    std::vector<uint8_t> blob;
+    if (!m_Blobs.read(hash, blob) || !decodeImage(blob, image.width, image.height, image.rgba)) {
+        std::cerr << "Could not decode image blob " << hash << std::endl;
+        image.rgba.clear();
+    }
+
+    std::lock_guard<std::mutex> lock(m_ReadyMutex);
+    m_Ready.push_back(std::move(image));
+    m_InFlight--;
+    m_ReadyCondition.notify_all();
+}
+
+void ImageCache::update(int maxUploads)
+{
+    std::vector<DecodedImage> ready;
+    {
+        std::lock_guard<std::mutex> lock(m_ReadyMutex);
+        // Big uploads stall the frame, so the rest waits for the next one
+        size_t count = std::min(m_Ready.size(), static_cast<size_t>(std::max(maxUploads, 0)));
+        ready.assign(std::make_move_iterator(m_Ready.begin()), std::make_move_iterator(m_Ready.begin() + count));
+        m_Ready.erase(m_Ready.begin(), m_Ready.begin() + count);
+    }
+
+    for (auto& image : ready) {
+        m_Loading.erase(image.hash);
+        if (image.rgba.empty()) {
+            m_Textures[image.hash] = 0;
+            continue;
+        }
+
+        GLuint texture = 0;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.rgba.data());
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        m_Textures[image.hash] = texture;
+    }
+}
+
+void ImageCache::shutdown()
+{
+    for (auto& [hash, texture] : m_Textures) {
+        if (texture != 0) {
+            glDeleteTextures(1, &texture);
+        }
+    }
+    m_Textures.clear();
+}
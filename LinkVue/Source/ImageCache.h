@@ -0,0 +1,60 @@
+#pragma once
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+
+#include "BlobStore.h"
+#include "ThreadPool.h"
+
+// Turns image blobs into GL textures.
+// Blobs are read and decoded on the cache's own thread, never on a pool the UI
+// thread helps out in; the UI thread only uploads the finished pixels, a few per
+// frame, and builds mipmaps so zoomed-out images stay smooth.
+class ImageCache {
+public:
+    explicit ImageCache(BlobStore& blobs) : m_Blobs(blobs) {}
+    ~ImageCache();
+
+    ImageCache(const ImageCache&) = delete;
+    ImageCache& operator=(const ImageCache&) = delete;
+
+    // Image blob layout: "LVI1", width and height as little-endian u32, then RGBA8 rows
+    static std::vector<uint8_t> encodeImage(uint32_t width, uint32_t height, const std::vector<uint8_t>& rgba);
+    static bool decodeImage(const std::vector<uint8_t>& blob, uint32_t& width, uint32_t& height, std::vector<uint8_t>& rgba);
+
+    // Texture for the blob, or 0 while it is missing or still being decoded
+    GLuint getTexture(const std::string& hash);
+
+    // Uploads up to maxUploads decoded images. Requires the GL context.
+    void update(int maxUploads = 2);
+    void shutdown();
+
+private:
+    struct DecodedImage {
+        std::string hash;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<uint8_t> rgba; // Empty if the blob was unreadable
+    };
+
+    void decode(const std::string& hash);
+
+    BlobStore& m_Blobs;
+
+    std::unordered_map<std::string, GLuint> m_Textures; // 0 for blobs that failed to decode
+    std::unordered_set<std::string> m_Loading;
+
+    std::mutex m_ReadyMutex;
+    std::condition_variable m_ReadyCondition;
+    std::vector<DecodedImage> m_Ready;
+    size_t m_InFlight = 0; // Guarded by m_ReadyMutex
+
+    // Declared last so the thread finishes before the cache goes away
+    ThreadPool m_Decoder{ 1 };
+};
@@ -0,0 +1,113 @@
+#include "InboundQueue.h"
+
+InboundQueue::InboundQueue(size_t decodeBytes)
+    : m_DecodeBytes(decodeBytes)
+{
+}
+
+void InboundQueue::push(Event::Type type, ClientId client, std::string_view payload)
+{
+    std::shared_ptr<Entry> entry;
+    std::string buffer;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (!m_FreeEntries.empty()) {
+            entry = std::move(m_FreeEntries.back());
+            m_FreeEntries.pop_back();
+        }
+        if (!payload.empty() && !m_FreeBuffers.empty()) {
+            buffer = std::move(m_FreeBuffers.back());
+            m_FreeBuffers.pop_back();
+        }
+    }
+    if (!entry) {
+        entry = std::make_shared<Entry>();
+    }
+    buffer.assign(payload.data(), payload.size());
+    entry->event.type = type;
+    entry->event.client = client;
+    entry->event.payload = std::move(buffer);
+    entry->bytes = entry->event.payload.size();
+
+    bool offThread = type == Event::Type::Message && entry->bytes >= m_DecodeBytes;
+    if (offThread) {
+        entry->ready = false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Entries.push_back(entry);
+        m_BytesIn += entry->bytes;
+    }
+
+    if (offThread) {
+        bool stage = m_StageSnapshots;
+        m_Decoder.submit([entry, stage]() {
+            Event& event = entry->event;
+            event.valid = decodeOp(event.payload, event.op);
+            event.decoded = true;
+            if (event.valid && stage && event.op.type == OpType::Snapshot) {
+                event.staged = std::make_unique<StagedSnapshot>(Whiteboard::stageSnapshot(std::move(event.op)));
+                event.op = BoardOp();
+                event.op.type = OpType::Snapshot;
+                event.op.seq = event.staged->op.seq;
+            }
+            entry->ready.store(true, std::memory_order_release);
+        });
+    }
+}
+
+size_t InboundQueue::size() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Entries.size();
+}
+
+bool InboundQueue::pop(Event& event)
+{
+    std::shared_ptr<Entry> entry;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (m_Entries.empty() || !m_Entries.front()->ready.load(std::memory_order_acquire)) {
+            return false;
+        }
+        entry = std::move(m_Entries.front());
+        m_Entries.pop_front();
+        m_BytesOut += entry->bytes;
+        if (m_Entries.empty()) {
+            m_BytesIn = 0;
+            m_BytesOut = 0;
+        }
+    }
+    event = std::move(entry->event);
+
+    // Unless the decoder still holds on to it, the entry is ready for another message
+    if (entry.use_count() == 1) {
+        entry->event = Event();
+        entry->ready = true;
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (m_FreeEntries.size() < MAX_POOLED) {
+            m_FreeEntries.push_back(std::move(entry));
+        }
+    }
+    return true;
+}
+
+void InboundQueue::recycle(Event& event)
+{
+    if (event.payload.capacity() == 0 || event.payload.capacity() > m_DecodeBytes) {
+        return;
+    }
+    event.payload.clear();
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (m_FreeBuffers.size() < MAX_POOLED) {
+        m_FreeBuffers.push_back(std::move(event.payload));
+    }
+}
+
+bool InboundQueue::getProgress(size_t& done, size_t& total) const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    done = m_BytesOut;
+    total = m_BytesIn;
+    return !m_Entries.empty();
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+#include "Networking.h"
+#include "Protocol.h"
+#include "Whiteboard.h"
+#include "ThreadPool.h"
+
+// Network events on their way from the socket threads to the UI thread.
+// Large messages are decoded on a worker as soon as they arrive, and snapshots
+// are staged for the board there as well, so the UI thread only applies them.
+// Events come out in arrival order; one still being decoded holds back the rest.
+// Queue entries and payload buffers are pooled, so steady traffic of ordinary
+// messages does not allocate.
+class InboundQueue {
+public:
+    struct Event {
+        enum class Type { Connected, Disconnected, Message };
+        Type type = Type::Message;
+        ClientId client = 0;
+        std::string payload;
+
+        // Filled in by the worker for large messages; the UI thread decodes the rest
+        bool decoded = false;
+        bool valid = false;
+        BoardOp op;
+        std::unique_ptr<StagedSnapshot> staged; // Snapshots, when staging is on
+    };
+
+    // Messages at least this big are decoded off the UI thread
+    explicit InboundQueue(size_t decodeBytes = 64 * 1024);
+
+    InboundQueue(const InboundQueue&) = delete;
+    InboundQueue& operator=(const InboundQueue&) = delete;
+
+    // Safe from any thread
+    void push(Event::Type type, ClientId client, std::string_view payload = {});
+    size_t size() const;
+
+    // Clients stage snapshots; the host never applies one
+    void setStageSnapshots(bool stage) { m_StageSnapshots = stage; }
+
+    // UI thread: takes the next event. False when there is none or it is still being decoded.
+    bool pop(Event& event);
+
+    // UI thread: hands a popped event's payload buffer back for later messages
+    void recycle(Event& event);
+
+    // Message bytes taken out and taken in since the queue last ran empty.
+    // Returns false when there is nothing left.
+    bool getProgress(size_t& done, size_t& total) const;
+
+private:
+    struct Entry {
+        Event event;
+        size_t bytes = 0;
+        std::atomic<bool> ready{ true };
+    };
+
+    // Buffers bigger than m_DecodeBytes are rare and not worth holding on to
+    static constexpr size_t MAX_POOLED = 64;
+
+    size_t m_DecodeBytes;
+    std::atomic<bool> m_StageSnapshots{ false };
+
+    mutable std::mutex m_Mutex;
+    std::deque<std::shared_ptr<Entry>> m_Entries;
+    size_t m_BytesIn = 0;
+    size_t m_BytesOut = 0;
+    std::vector<std::shared_ptr<Entry>> m_FreeEntries;
+    std::vector<std::string> m_FreeBuffers;
+
+    // Declared last so workers finish before the queue goes away
+    ThreadPool m_Decoder{ 1 };
+};
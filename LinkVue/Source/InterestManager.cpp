@@ -0,0 +1,247 @@
+#include "InterestManager.h"
+#include <algorithm>
+
+void InterestManager::addClient(ClientId client)
+{
+    m_Clients[client] = ClientInterest();
+}
+
+void InterestManager::removeClient(ClientId client)
+{
+    m_Clients.erase(client);
+}
+
+void InterestManager::renameClient(ClientId from, ClientId to)
+{
+    auto node = m_Clients.extract(from);
+    if (node.empty()) {
+        addClient(to);
+        return;
+    }
+    node.key() = to;
+    m_Clients.insert(std::move(node));
+}
+
+std::vector<ClientId> InterestManager::getClients() const
+{
+    std::vector<ClientId> clients;
+    for (const auto& [client, interest] : m_Clients) {
+        clients.push_back(client);
+    }
+    return clients;
+}
+
+bool InterestManager::isInterested(const ClientInterest& interest, const Stroke& stroke) const
+{
+    return !interest.hasViewport || interest.area.intersects(stroke.bounds);
+}
+
+std::vector<Stroke> InterestManager::updateViewport(ClientId client, const Rect& viewport, const std::vector<StrokePtr>& strokes)
+{
+    std::vector<Stroke> missing;
+    auto it = m_Clients.find(client);
+    if (it == m_Clients.end() || viewport.isEmpty()) {
+        return missing;
+    }
+
+    // No window shows more than this, however far out it zooms
+    double centerX = 0.5 * viewport.minX + 0.5 * viewport.maxX; // No overflow for far out values
+    double centerY = 0.5 * viewport.minY + 0.5 * viewport.maxY;
+    double halfWidth = 0.5 * std::min(viewport.width(), MAX_VIEWPORT_SIZE);
+    double halfHeight = 0.5 * std::min(viewport.height(), MAX_VIEWPORT_SIZE);
+    Rect area = { centerX - halfWidth, centerY - halfHeight, centerX + halfWidth, centerY + halfHeight };
+
+    // Pad by half a screen as well, so a short pan finds its strokes already there
+    ClientInterest& interest = it->second;
+    double padding = m_Padding + std::max(halfWidth, halfHeight);
+    interest.area = area.expanded(padding);
+    interest.hasViewport = true;
+    return collectMissing(interest, strokes);
+}
+
+std::vector<Stroke> InterestManager::refresh(ClientId client, const std::vector<StrokePtr>& strokes)
+{
+    auto it = m_Clients.find(client);
+    if (it == m_Clients.end() || !it->second.hasViewport) {
+        return {};
+    }
+    return collectMissing(it->second, strokes);
+}
+
+std::vector<Stroke> InterestManager::collectMissing(ClientInterest& interest, const std::vector<StrokePtr>& strokes) const
+{
+    std::vector<Stroke> missing;
+    for (const auto& stroke : strokes) {
+        if (isInterested(interest, *stroke) && !interest.knownStrokes.contains(stroke->id)) {
+            interest.knownStrokes.add(*stroke);
+            missing.push_back(*stroke);
+        }
+    }
+    return missing;
+}
+
+void InterestManager::getAreas(std::pmr::vector<Rect>& areas) const
+{
+    areas.clear();
+    for (const auto& [client, interest] : m_Clients) {
+        if (interest.hasViewport) {
+            areas.push_back(interest.area);
+        }
+    }
+}
+
+bool InterestManager::filterForClient(ClientId client, const BoardOp& op, BoardOp& filtered)
+{
+    auto it = m_Clients.find(client);
+    if (it == m_Clients.end()) {
+        return false;
+    }
+    ClientInterest& interest = it->second;
+
+    filtered.type = op.type;
+    filtered.clientSeq = 0;
+    filtered.strokes.clear();
+    filtered.strokeIds.clear();
+    filtered.transforms.clear();
+    filtered.images.clear();
+    filtered.canvasColor = op.canvasColor;
+    filtered.viewport = op.viewport;
+
+    switch (op.type) {
+    case OpType::AddStrokes:
+        for (const auto& stroke : op.strokes) {
+            if (isInterested(interest, stroke)) {
+                interest.knownStrokes.add(stroke);
+                filtered.strokes.push_back(stroke);
+            }
+        }
+        return !filtered.strokes.empty();
+
+    case OpType::RemoveStrokes:
+        // Only clients that were sent a stroke need to hear it is gone
+        for (uint64_t id : op.strokeIds) {
+            if (interest.knownStrokes.contains(id)) {
+                interest.knownStrokes.remove(id);
+                filtered.strokeIds.push_back(id);
+            }
+        }
+        return !filtered.strokeIds.empty();
+
+    case OpType::TransformStrokes:
+        // Strokes moved into view of a client that never had them go out through refresh()
+        for (size_t i = 0; i < op.strokeIds.size() && i < op.transforms.size(); i++) {
+            if (interest.knownStrokes.contains(op.strokeIds[i])) {
+                interest.knownStrokes.setTransform(op.strokeIds[i], op.transforms[i]);
+                filtered.strokeIds.push_back(op.strokeIds[i]);
+                filtered.transforms.push_back(op.transforms[i]);
+            }
+        }
+        return !filtered.strokeIds.empty();
+
+    case OpType::Clear:
+        interest.knownStrokes.clear();
+        return true;
+
+    case OpType::CanvasColor:
+        return true;
+
+    case OpType::AddImages:
+        // Image metadata is small and goes everywhere; pixels are fetched on demand
+        filtered.images = op.images;
+        return true;
+
+    case OpType::Snapshot:
+        filtered.images = op.images;
+        interest.knownStrokes.clear();
+        for (const auto& stroke : op.strokes) {
+            if (isInterested(interest, stroke)) {
+                interest.knownStrokes.add(stroke);
+                filtered.strokes.push_back(stroke);
+            }
+        }
+        return true;
+
+    case OpType::Viewport:
+    case OpType::BlobRequest:
+    case OpType::BlobChunk:
+    case OpType::Hello:
+    case OpType::Welcome:
+    case OpType::Ack:
+    case OpType::DigestQuery:
+    case OpType::Digest:
+    case OpType::StrokeRequest:
+        return false;
+    }
+    return false;
+}
+
+void InterestManager::markKnown(ClientId client, const BoardOp& op)
+{
+    auto it = m_Clients.find(client);
+    if (it == m_Clients.end()) {
+        return;
+    }
+    ClientInterest& interest = it->second;
+
+    switch (op.type) {
+    case OpType::AddStrokes:
+        for (const auto& stroke : op.strokes) {
+            interest.knownStrokes.add(stroke);
+        }
+        break;
+    case OpType::RemoveStrokes:
+        for (uint64_t id : op.strokeIds) {
+            interest.knownStrokes.remove(id);
+        }
+        break;
+    case OpType::TransformStrokes:
+        for (size_t i = 0; i < op.strokeIds.size() && i < op.transforms.size(); i++) {
+            interest.knownStrokes.setTransform(op.strokeIds[i], op.transforms[i]);
+        }
+        break;
+    case OpType::Clear:
+        interest.knownStrokes.clear();
+        break;
+    case OpType::Snapshot:
+        interest.knownStrokes.clear();
+        for (const auto& stroke : op.strokes) {
+            interest.knownStrokes.add(stroke);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+BoardOp InterestManager::answerDigestQuery(ClientId client, const BoardOp& query) const
+{
+    BoardOp reply;
+    reply.type = OpType::Digest;
+    auto it = m_Clients.find(client);
+    if (it == m_Clients.end()) {
+        return reply;
+    }
+    const BoardDigest& known = it->second.knownStrokes;
+
+    // Clients only ask about a leaf after its hash differed, so leaves are listed outright
+    std::vector<BoardDigest::Node> leaves;
+    for (size_t i = 0; i < query.digestNodes.size() && i < query.digestHashes.size(); i++) {
+        BoardDigest::Node node = query.digestNodes[i];
+        if (!BoardDigest::isValid(node)) {
+            continue;
+        }
+        if (BoardDigest::isLeaf(node)) {
+            leaves.push_back(node);
+        }
+        else if (known.hashOf(node) != query.digestHashes[i]) {
+            for (BoardDigest::Node child : BoardDigest::children(node)) {
+                reply.digestNodes.push_back(child);
+                reply.digestHashes.push_back(known.hashOf(child));
+            }
+        }
+    }
+    if (!leaves.empty()) {
+        known.list(leaves, reply.strokeIds, reply.strokeHashes);
+    }
+    return reply;
+}
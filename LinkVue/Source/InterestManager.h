@@ -0,0 +1,65 @@
+#pragma once
+#include <vector>
+#include <memory_resource>
+#include <unordered_map>
+
+#include "Networking.h"
+#include "Protocol.h"
+#include "BoardDocument.h"
+#include "BoardDigest.h"
+
+// Host-side bookkeeping of what each client looks at and what it already has.
+// Ops are only forwarded to clients whose padded viewport they touch; when a
+// viewport moves, the strokes it uncovers are streamed in.
+class InterestManager {
+public:
+    // Largest viewport side a client is taken at its word for: a large window
+    // at the furthest the board zooms out (1e-4). Bigger ones are shrunk around
+    // their centre.
+    static constexpr double MAX_VIEWPORT_SIZE = 16384.0 / 1e-4;
+
+    // padding is added around every viewport, in canvas units
+    explicit InterestManager(float padding = 256.0f) : m_Padding(padding) {}
+
+    void addClient(ClientId client);
+    void removeClient(ClientId client);
+
+    // Moves what from knows and looks at over to a new connection of the same session
+    void renameClient(ClientId from, ClientId to);
+    std::vector<ClientId> getClients() const;
+
+    // Stores the client's viewport and returns the strokes inside its new area
+    // of interest that it has not been sent yet
+    std::vector<Stroke> updateViewport(ClientId client, const Rect& viewport, const std::vector<StrokePtr>& strokes);
+
+    // Strokes inside the client's current area of interest it has not been
+    // sent yet, e.g. because they were paged out when it looked there
+    std::vector<Stroke> refresh(ClientId client, const std::vector<StrokePtr>& strokes);
+
+    // Replaces areas with the padded viewports of every client that sent one
+    void getAreas(std::pmr::vector<Rect>& areas) const;
+
+    // Narrows op down to what client should receive. Returns false when
+    // nothing is left to send.
+    bool filterForClient(ClientId client, const BoardOp& op, BoardOp& filtered);
+
+    // Records that client already has the result of op, e.g. because it sent it
+    void markKnown(ClientId client, const BoardOp& op);
+
+    // Answers a client's DigestQuery from the digest of what it was sent: the
+    // children of every node whose hash differs, and the strokes in every leaf
+    BoardOp answerDigestQuery(ClientId client, const BoardOp& query) const;
+
+private:
+    struct ClientInterest {
+        Rect area;                // Padded viewport; empty until the client sends one
+        bool hasViewport = false; // Clients that never sent a viewport get everything
+        BoardDigest knownStrokes; // What the client should hold, with hashes of the versions sent
+    };
+
+    bool isInterested(const ClientInterest& interest, const Stroke& stroke) const;
+    std::vector<Stroke> collectMissing(ClientInterest& interest, const std::vector<StrokePtr>& strokes) const;
+
+    float m_Padding;
+    std::unordered_map<ClientId, ClientInterest> m_Clients;
+};
@@ -0,0 +1,120 @@
+#include "Metrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+size_t Metrics::currentShard()
+{
+    static std::atomic<size_t> nextShard{ 0 };
+    thread_local size_t shard = nextShard.fetch_add(1, std::memory_order_relaxed) % SHARD_COUNT;
+    return shard;
+}
+
+uint64_t ShardedCounter::value() const
+{
+    uint64_t total = 0;
+    for (const auto& shard : m_Shards) {
+        total += shard.value.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+ShardedHistogram::ShardedHistogram(std::vector<double> bounds)
+    : m_Bounds(std::move(bounds))
+{
+    std::sort(m_Bounds.begin(), m_Bounds.end());
+    for (auto& shard : m_Shards) {
+        shard.counts = std::make_unique<std::atomic<uint64_t>[]>(m_Bounds.size() + 1);
+    }
+}
+
+void ShardedHistogram::observe(double value)
+{
+    size_t bucket = std::lower_bound(m_Bounds.begin(), m_Bounds.end(), value) - m_Bounds.begin();
+    Shard& shard = m_Shards[Metrics::currentShard()];
+    shard.counts[bucket].fetch_add(1, std::memory_order_relaxed);
+    shard.sum.fetch_add(value, std::memory_order_relaxed);
+}
+
+ShardedHistogram::Snapshot ShardedHistogram::snapshot() const
+{
+    Snapshot result;
+    result.bounds = m_Bounds;
+    result.counts.assign(m_Bounds.size() + 1, 0);
+    for (const auto& shard : m_Shards) {
+        for (size_t i = 0; i < result.counts.size(); i++) {
+            result.counts[i] += shard.counts[i].load(std::memory_order_relaxed);
+        }
+        result.sum += shard.sum.load(std::memory_order_relaxed);
+    }
+    for (uint64_t count : result.counts) {
+        result.count += count;
+    }
+    return result;
+}
+
+std::vector<double> ShardedHistogram::exponentialBounds(double start, double factor, size_t count)
+{
+    std::vector<double> bounds;
+    double bound = start;
+    for (size_t i = 0; i < count; i++) {
+        bounds.push_back(bound);
+        bound *= factor;
+    }
+    return bounds;
+}
+
+namespace {
+    std::string formatValue(double value)
+    {
+        if (std::isinf(value)) {
+            return value > 0 ? "+Inf" : "-Inf";
+        }
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.15g", value);
+        return buffer;
+    }
+}
+
+void MetricsWriter::family(const std::string& name, const char* type, const char* help)
+{
+    m_Text += "# HELP " + name + " " + help + "\n";
+    m_Text += "# TYPE " + name + " " + type + "\n";
+}
+
+void MetricsWriter::sample(const std::string& name, double value, const std::string& labels)
+{
+    m_Text += name;
+    if (!labels.empty()) {
+        m_Text += "{" + labels + "}";
+    }
+    m_Text += " " + formatValue(value) + "\n";
+}
+
+void MetricsWriter::counter(const std::string& name, const char* help, double value)
+{
+    family(name, "counter", help);
+    sample(name, value);
+}
+
+void MetricsWriter::gauge(const std::string& name, const char* help, double value)
+{
+    family(name, "gauge", help);
+    sample(name, value);
+}
+
+void MetricsWriter::histogram(const std::string& name, const char* help, const ShardedHistogram& histogram)
+{
+    ShardedHistogram::Snapshot snapshot = histogram.snapshot();
+    family(name, "histogram", help);
+
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < snapshot.counts.size(); i++) {
+        cumulative += snapshot.counts[i];
+        double bound = i < snapshot.bounds.size() ? snapshot.bounds[i] : INFINITY;
+        sample(name + "_bucket", static_cast<double>(cumulative), "le=\"" + formatValue(bound) + "\"");
+    }
+    sample(name + "_sum", snapshot.sum);
+    sample(name + "_count", static_cast<double>(snapshot.count));
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+
+// Counters and histograms that any thread can record into without contending.
+// Every metric is split into shards on separate cache lines and each thread
+// sticks to one of them, so recording is a relaxed add on a line the thread
+// usually owns. Reading sums the shards and is only meant for scrapes.
+namespace Metrics {
+    static constexpr size_t SHARD_COUNT = 16;
+
+    // Shard of the calling thread, handed out round-robin on first use
+    size_t currentShard();
+}
+
+class ShardedCounter {
+public:
+    void add(uint64_t amount = 1) {
+        m_Shards[Metrics::currentShard()].value.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    uint64_t value() const;
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> value{ 0 };
+    };
+
+    std::array<Shard, Metrics::SHARD_COUNT> m_Shards;
+};
+
+// Cumulative histogram with fixed upper bounds, as Prometheus expects
+class ShardedHistogram {
+public:
+    explicit ShardedHistogram(std::vector<double> bounds);
+
+    void observe(double value);
+
+    struct Snapshot {
+        std::vector<double> bounds;
+        std::vector<uint64_t> counts; // Per bucket, not cumulative; the last one is +Inf
+        double sum = 0.0;
+        uint64_t count = 0;
+    };
+    Snapshot snapshot() const;
+
+    // Bounds from start growing by factor, count of them
+    static std::vector<double> exponentialBounds(double start, double factor, size_t count);
+
+private:
+    struct alignas(64) Shard {
+        std::unique_ptr<std::atomic<uint64_t>[]> counts;
+        std::atomic<double> sum{ 0.0 };
+    };
+
+    std::vector<double> m_Bounds;
+    std::array<Shard, Metrics::SHARD_COUNT> m_Shards;
+};
+
+// Builds a scrape in the Prometheus text exposition format
+class MetricsWriter {
+public:
+    // Starts a metric family; its samples follow
+    void family(const std::string& name, const char* type, const char* help);
+
+    // labels are already formatted, e.g. client="3"
+    void sample(const std::string& name, double value, const std::string& labels = "");
+
+    void counter(const std::string& name, const char* help, double value);
+    void gauge(const std::string& name, const char* help, double value);
+    void histogram(const std::string& name, const char* help, const ShardedHistogram& histogram);
+
+    const std::string& text() const { return m_Text; }
+
+private:
+    std::string m_Text;
+};
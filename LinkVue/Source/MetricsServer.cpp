@@ -0,0 +1,127 @@
+#include "MetricsServer.h"
+#include <iostream>
+#include <cstring>
+#include <chrono>
+
+MetricsServer::MetricsServer()
+{
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        throw std::runtime_error("WSAStartup failed");
+    }
+}
+
+MetricsServer::~MetricsServer()
+{
+    stop();
+    WSACleanup();
+}
+
+bool MetricsServer::start(int port, std::function<std::string()> render)
+{
+    stop();
+
+    // Loopback only: the numbers are for a scraper on this machine, not the network
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+
+    m_ListenSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (m_ListenSocket == INVALID_SOCKET) {
+        return false;
+    }
+    if (bind(m_ListenSocket, (struct sockaddr*)&address, sizeof(address)) == SOCKET_ERROR ||
+        listen(m_ListenSocket, 4) == SOCKET_ERROR) {
+        std::cerr << "Cannot serve metrics on port " << port << std::endl;
+        closesocket(m_ListenSocket);
+        m_ListenSocket = INVALID_SOCKET;
+        return false;
+    }
+
+    m_Render = std::move(render);
+    m_Running = true;
+    m_Thread = std::thread(&MetricsServer::serve, this);
+    return true;
+}
+
+void MetricsServer::stop()
+{
+    m_Running = false;
+    if (m_ListenSocket != INVALID_SOCKET) {
+        // Wakes the server thread out of accept()
+        shutdown(m_ListenSocket, SD_BOTH);
+        closesocket(m_ListenSocket);
+        m_ListenSocket = INVALID_SOCKET;
+    }
+    if (m_Thread.joinable()) {
+        m_Thread.join();
+    }
+}
+
+void MetricsServer::serve()
+{
+    while (m_Running) {
+        SOCKET client = accept(m_ListenSocket, nullptr, nullptr);
+        if (client == INVALID_SOCKET) {
+            int error = WSAGetLastError();
+            if (error == WSAEINTR || error == WSAECONNRESET) {
+                continue; // The scraper hung up before we took the connection
+            }
+            if (error == WSAEMFILE || error == WSAENOBUFS) {
+                // Out of sockets for now; retrying at once would only spin
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                continue;
+            }
+            // Anything else will fail again, e.g. the socket was closed by stop()
+            if (m_Running) {
+                std::cerr << "Metrics server stopped, accept failed with error " << error << std::endl;
+                m_Running = false;
+            }
+            break;
+        }
+        // A scraper that stops talking must not wedge stop()
+        DWORD timeout = 2000;
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+        respond(client);
+        closesocket(client);
+    }
+}
+
+void MetricsServer::respond(SOCKET client)
+{
+    // Only the request line matters; read until the headers end
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192) {
+        int received = recv(client, buffer, sizeof(buffer), 0);
+        if (received <= 0) {
+            return;
+        }
+        request.append(buffer, received);
+    }
+
+    std::string status = "200 OK";
+    std::string body;
+    if (request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 6, "GET / ") == 0) {
+        body = m_Render ? m_Render() : std::string();
+    }
+    else {
+        status = "404 Not Found";
+        body = "Try /metrics\n";
+    }
+
+    std::string response = "HTTP/1.0 " + status + "\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: " + std::to_string(body.size()) + "\r\n"
+        "Connection: close\r\n\r\n" + body;
+
+    size_t sent = 0;
+    while (sent < response.size()) {
+        int result = send(client, response.data() + sent, static_cast<int>(response.size() - sent), 0);
+        if (result == SOCKET_ERROR || result == 0) {
+            return;
+        }
+        sent += result;
+    }
+}
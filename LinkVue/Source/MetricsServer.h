@@ -0,0 +1,35 @@
+#pragma once
+#include <string>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+
+// Minimal HTTP endpoint on 127.0.0.1 that answers GET /metrics with whatever
+// render returns, for a Prometheus scraper running on the same machine.
+// One request at a time on its own thread; scrapes are rare and small.
+class MetricsServer {
+public:
+    MetricsServer();
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+    // render runs on the server thread for every scrape
+    bool start(int port, std::function<std::string()> render);
+    void stop();
+
+    bool isRunning() const { return m_Running; }
+
+private:
+    void serve();
+    void respond(SOCKET client);
+
+    SOCKET m_ListenSocket = INVALID_SOCKET;
+    std::thread m_Thread;
+    std::atomic<bool> m_Running{ false };
+    std::function<std::string()> m_Render;
+};
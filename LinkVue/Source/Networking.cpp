@@ -1,10 +1,48 @@
 #include "Networking.h"
+#include "AllocationStats.h"
 #include <iostream>
 #include <thread>
+#include <chrono>
+#include <cstring>
+
+namespace {
+    // Sent by both ends right after connecting: magic, then a flags byte
+    const char HANDSHAKE_MAGIC[4] = { 'L', 'V', 'N', '1' };
+    const uint8_t FLAG_COMPRESSION = 1 << 0;
+    const DWORD HANDSHAKE_TIMEOUT_MS = 5000;
+
+    bool sendAll(SOCKET socket, const char* data, size_t size) {
+        size_t sent = 0;
+        while (sent < size) {
+            int result = send(socket, data + sent, static_cast<int>(size - sent), 0);
+            if (result == SOCKET_ERROR || result == 0) {
+                return false;
+            }
+            sent += result;
+        }
+        return true;
+    }
+
+    bool receiveAll(SOCKET socket, char* data, size_t size) {
+        size_t received = 0;
+        while (received < size) {
+            int result = recv(socket, data + received, static_cast<int>(size - received), 0);
+            if (result <= 0) {
+                return false;
+            }
+            received += result;
+        }
+        return true;
+    }
+
+    int64_t nanosecondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+}
 
 NetworkManager::NetworkManager(int port)
-    : port(port), running(false), hostMode(false),
-    listenSocket(INVALID_SOCKET) {
+    : port(port), running(false), compression(true), hostMode(false),
+    listenSocket(INVALID_SOCKET), nextClientId(HOST_ID + 1) {
     WSADATA wsaData;
     if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
         throw std::runtime_error("WSAStartup failed");
@@ -43,6 +81,7 @@ bool NetworkManager::initializeHost() {
 
 bool NetworkManager::initializeClient(const std::string& hostAddress) {
     hostMode = false;
+    this->hostAddress = hostAddress;
     struct sockaddr_in serverAddr = {};
     serverAddr.sin_family = AF_INET;
     inet_pton(AF_INET, hostAddress.c_str(), &serverAddr.sin_addr);
@@ -58,28 +97,125 @@ bool NetworkManager::initializeClient(const std::string& hostAddress) {
         return false;
     }
 
-    clientSockets.push_back(listenSocket);
+    auto connection = std::make_shared<Connection>();
+    connection->socket = listenSocket;
+    if (!negotiate(*connection)) {
+        std::cerr << "Handshake with host failed" << std::endl;
+        closesocket(listenSocket);
+        listenSocket = INVALID_SOCKET;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(clientsMutex);
+    clientSockets[HOST_ID] = connection;
+    totalConnections.add();
     return true;
 }
 
-void NetworkManager::handleClient(SOCKET clientSocket) {
+bool NetworkManager::negotiate(Connection& connection) {
+    char hello[sizeof(HANDSHAKE_MAGIC) + 1];
+    std::memcpy(hello, HANDSHAKE_MAGIC, sizeof(HANDSHAKE_MAGIC));
+    hello[sizeof(HANDSHAKE_MAGIC)] = static_cast<char>(compression ? FLAG_COMPRESSION : 0);
+
+    // A peer that never answers must not hold the connection forever
+    DWORD timeout = HANDSHAKE_TIMEOUT_MS;
+    setsockopt(connection.socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+
+    char reply[sizeof(hello)];
+    bool ok = sendAll(connection.socket, hello, sizeof(hello)) &&
+        receiveAll(connection.socket, reply, sizeof(reply)) &&
+        std::memcmp(reply, HANDSHAKE_MAGIC, sizeof(HANDSHAKE_MAGIC)) == 0;
+
+    timeout = 0;
+    setsockopt(connection.socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+    if (!ok) {
+        return false;
+    }
+
+    uint8_t flags = static_cast<uint8_t>(hello[sizeof(HANDSHAKE_MAGIC)]) & static_cast<uint8_t>(reply[sizeof(HANDSHAKE_MAGIC)]);
+    connection.compressed = (flags & FLAG_COMPRESSION) != 0;
+    return true;
+}
+
+void NetworkManager::handleClient(ClientId client, std::shared_ptr<Connection> connection) {
+    AllocationScope scope(AllocationSubsystem::Network);
     char buffer[BUFFER_SIZE];
+    std::string pending;
+    size_t readOffset = 0;
+    SOCKET clientSocket = connection->socket;
+
     while (running) {
         int bytesReceived = recv(clientSocket, buffer, BUFFER_SIZE, 0);
-        if (bytesReceived > 0) {
-            buffer[bytesReceived] = '\0';
-            if (onMessageReceived) {
-                onMessageReceived(std::string(buffer));
+        if (bytesReceived <= 0) {
+            break;
+        }
+        connection->wireBytesReceived += bytesReceived;
+        totalWireBytesReceived.add(bytesReceived);
+
+        // Undo the stream compression first; framing sits on top of it
+        if (connection->compressed) {
+            size_t before = pending.size();
+            auto start = std::chrono::steady_clock::now();
+            bool valid = connection->decompressor.feed(buffer, bytesReceived, pending);
+            connection->decompressNanoseconds += nanosecondsSince(start);
+            if (!valid) {
+                std::cerr << "Dropping connection " << client << ": corrupt compressed stream" << std::endl;
+                break;
             }
+            connection->bytesReceived += pending.size() - before;
         }
         else {
-            if (onClientDisconnected) {
-                onClientDisconnected();
+            pending.append(buffer, bytesReceived);
+            connection->bytesReceived += bytesReceived;
+        }
+
+        // Hand out every complete [length][payload] frame
+        bool malformed = false;
+        while (pending.size() - readOffset >= sizeof(uint32_t)) {
+            uint32_t length = 0;
+            std::memcpy(&length, pending.data() + readOffset, sizeof(length));
+            length = ntohl(length);
+            if (length > MAX_MESSAGE_SIZE) {
+                malformed = true;
+                break;
+            }
+            if (pending.size() - readOffset - sizeof(uint32_t) < length) {
+                break;
             }
+
+            connection->messagesReceived++;
+            totalMessagesReceived.add();
+            if (onMessageReceived) {
+                onMessageReceived(client, std::string_view(pending).substr(readOffset + sizeof(uint32_t), length));
+            }
+            readOffset += sizeof(uint32_t) + length;
+        }
+        if (malformed) {
+            std::cerr << "Dropping connection " << client << ": oversized message" << std::endl;
             break;
         }
+
+        if (readOffset > 0) {
+            pending.erase(0, readOffset);
+            readOffset = 0;
+        }
+    }
+
+    bool wasConnected = false;
+    {
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        auto it = clientSockets.find(client);
+        wasConnected = it != clientSockets.end() && it->second == connection;
+        if (wasConnected) {
+            clientSockets.erase(it);
+        }
+    }
+    if (wasConnected) {
+        closesocket(clientSocket);
+    }
+    if (onClientDisconnected) {
+        onClientDisconnected(client);
     }
-    closesocket(clientSocket);
 }
 
 void NetworkManager::clientListenerThread() {
@@ -87,52 +223,192 @@ void NetworkManager::clientListenerThread() {
         if (hostMode) {
             SOCKET clientSocket = accept(listenSocket, nullptr, nullptr);
             if (clientSocket != INVALID_SOCKET) {
-                clientSockets.push_back(clientSocket);
-                if (onClientConnected) {
-                    onClientConnected();
+                ClientId client;
+                {
+                    std::lock_guard<std::mutex> lock(clientsMutex);
+                    client = nextClientId++;
                 }
-                std::thread(&NetworkManager::handleClient, this, clientSocket).detach();
+                auto connection = std::make_shared<Connection>();
+                connection->socket = clientSocket;
+                // The handshake waits on the client, so keep it off the accept loop
+                std::thread(&NetworkManager::acceptClient, this, client, connection).detach();
             }
         }
         else {
-            handleClient(listenSocket);
+            std::shared_ptr<Connection> connection;
+            {
+                std::lock_guard<std::mutex> lock(clientsMutex);
+                auto it = clientSockets.find(HOST_ID);
+                if (it != clientSockets.end()) {
+                    connection = it->second;
+                }
+            }
+            if (!connection) {
+                break;
+            }
+            if (onClientConnected) {
+                onClientConnected(HOST_ID);
+            }
+            handleClient(HOST_ID, connection);
             break;
         }
     }
 }
 
+void NetworkManager::acceptClient(ClientId client, std::shared_ptr<Connection> connection) {
+    if (!negotiate(*connection)) {
+        std::cerr << "Handshake with client " << client << " failed" << std::endl;
+        closesocket(connection->socket);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        if (!running) {
+            closesocket(connection->socket);
+            return;
+        }
+        clientSockets[client] = connection;
+    }
+    totalConnections.add();
+    if (onClientConnected) {
+        onClientConnected(client);
+    }
+    handleClient(client, connection);
+}
+
+bool NetworkManager::sendFrame(Connection& connection, const std::string& message) {
+    // The peer would take it for a broken stream and drop the connection
+    if (message.size() > MAX_MESSAGE_SIZE) {
+        std::cerr << "Not sending a " << message.size() << " byte message, over the "
+            << MAX_MESSAGE_SIZE << " byte limit" << std::endl;
+        totalSendFailures.add();
+        return false;
+    }
+
+    // Compressed blocks must reach the peer in the order they were compressed,
+    // so compressing and sending happen under the same lock
+    connection.sendsInFlight++;
+    std::lock_guard<std::mutex> lock(connection.sendMutex);
+
+    // Header and payload go out in one buffer so Nagle never holds the payload back.
+    // The connection's buffers keep their capacity, so steady traffic does not allocate.
+    uint32_t length = htonl(static_cast<uint32_t>(message.size()));
+    std::string& frame = connection.frame;
+    frame.assign(reinterpret_cast<const char*>(&length), sizeof(length));
+    frame += message;
+    connection.bytesSent += frame.size();
+    const std::string* wire = &frame;
+    if (connection.compressed) {
+        connection.block.clear();
+        auto start = std::chrono::steady_clock::now();
+        connection.compressor.compress(reinterpret_cast<const uint8_t*>(frame.data()), frame.size(), connection.block);
+        connection.compressNanoseconds += nanosecondsSince(start);
+        wire = &connection.block;
+    }
+    bool sent = sendAll(connection.socket, wire->data(), wire->size());
+    size_t wireBytes = wire->size();
+
+    // A snapshot's worth of buffer is not kept around for the small ops after it
+    if (frame.capacity() > MAX_KEPT_SEND_BUFFER) {
+        std::string().swap(frame);
+    }
+    if (connection.block.capacity() > MAX_KEPT_SEND_BUFFER) {
+        std::string().swap(connection.block);
+    }
+    connection.sendsInFlight--;
+    if (!sent) {
+        totalSendFailures.add();
+        return false;
+    }
+    connection.wireBytesSent += wireBytes;
+    connection.messagesSent++;
+    totalWireBytesSent.add(wireBytes);
+    totalMessagesSent.add();
+    return true;
+}
+
 bool NetworkManager::sendMessage(const std::string& message) {
-    if (!running || clientSockets.empty()) {
+    ClientId client = HOST_ID;
+    std::shared_ptr<Connection> connection;
+    {
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        if (!running || clientSockets.empty()) {
+            return false;
+        }
+        client = clientSockets.begin()->first;
+        connection = clientSockets.begin()->second;
+    }
+    if (!sendFrame(*connection, message)) {
         return false;
     }
-    return send(clientSockets[0], message.c_str(), static_cast<int>(message.size()), 0) != SOCKET_ERROR;
+    if (onMessageSent) {
+        onMessageSent(client, message);
+    }
+    return true;
+}
+
+bool NetworkManager::sendTo(ClientId client, const std::string& message) {
+    std::shared_ptr<Connection> connection;
+    {
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        auto it = clientSockets.find(client);
+        if (!running || it == clientSockets.end()) {
+            return false;
+        }
+        connection = it->second;
+    }
+    if (!sendFrame(*connection, message)) {
+        return false;
+    }
+    if (onMessageSent) {
+        onMessageSent(client, message);
+    }
+    return true;
 }
 
 bool NetworkManager::broadcastMessage(const std::string& message) {
     if (!running || !hostMode) {
         return false;
     }
+    std::vector<std::pair<ClientId, std::shared_ptr<Connection>>> connections;
+    {
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        for (const auto& [client, connection] : clientSockets) {
+            connections.emplace_back(client, connection);
+        }
+    }
     bool success = true;
-    for (auto& socket : clientSockets) {
-        if (send(socket, message.c_str(), static_cast<int>(message.size()), 0) == SOCKET_ERROR) {
+    for (const auto& [client, connection] : connections) {
+        if (!sendFrame(*connection, message)) {
             success = false;
         }
+        else if (onMessageSent) {
+            onMessageSent(client, message);
+        }
     }
     return success;
 }
 
-void NetworkManager::setOnMessageReceived(std::function<void(const std::string&)> callback) {
+void NetworkManager::setOnMessageReceived(std::function<void(ClientId, std::string_view)> callback) {
     onMessageReceived = callback;
 }
 
-void NetworkManager::setOnClientConnected(std::function<void()> callback) {
+void NetworkManager::setOnClientConnected(std::function<void(ClientId)> callback) {
     onClientConnected = callback;
 }
 
-void NetworkManager::setOnClientDisconnected(std::function<void()> callback) {
+void NetworkManager::setOnClientDisconnected(std::function<void(ClientId)> callback) {
     onClientDisconnected = callback;
 }
 
+void NetworkManager::setOnMessageSent(std::function<void(ClientId, const std::string&)> callback) {
+    onMessageSent = callback;
+}
+
+void NetworkManager::setCompression(bool enabled) {
+    compression = enabled;
+}
+
 void NetworkManager::start() {
     if (!running) {
         running = true;
@@ -146,14 +422,16 @@ void NetworkManager::stop() {
 }
 
 void NetworkManager::cleanup() {
-    for (auto& socket : clientSockets) {
-        closesocket(socket);
+    std::lock_guard<std::mutex> lock(clientsMutex);
+    for (auto& [client, connection] : clientSockets) {
+        closesocket(connection->socket);
     }
     clientSockets.clear();
-    if (listenSocket != INVALID_SOCKET) {
+    // A client's listenSocket is its connection to the host, already closed above
+    if (listenSocket != INVALID_SOCKET && hostMode) {
         closesocket(listenSocket);
-        listenSocket = INVALID_SOCKET;
     }
+    listenSocket = INVALID_SOCKET;
 }
 
 bool NetworkManager::isRunning() const {
@@ -162,4 +440,76 @@ bool NetworkManager::isRunning() const {
 
 bool NetworkManager::isHost() const {
     return hostMode;
+}
+
+bool NetworkManager::isConnected() const {
+    std::lock_guard<std::mutex> lock(clientsMutex);
+    return running && !clientSockets.empty();
+}
+
+void NetworkManager::getConnectionStats(std::pmr::vector<std::pair<ClientId, ConnectionStats>>& stats) const {
+    stats.clear();
+    std::lock_guard<std::mutex> lock(clientsMutex);
+    for (const auto& [client, connection] : clientSockets) {
+        ConnectionStats& entry = stats.emplace_back(client, ConnectionStats()).second;
+        entry.compressed = connection->compressed;
+        entry.messagesSent = connection->messagesSent;
+        entry.messagesReceived = connection->messagesReceived;
+        entry.sendsInFlight = connection->sendsInFlight;
+        entry.bytesSent = connection->bytesSent;
+        entry.wireBytesSent = connection->wireBytesSent;
+        entry.bytesReceived = connection->bytesReceived;
+        entry.wireBytesReceived = connection->wireBytesReceived;
+        entry.compressSeconds = connection->compressNanoseconds * 1e-9;
+        entry.decompressSeconds = connection->decompressNanoseconds * 1e-9;
+    }
+}
+
+void NetworkManager::writeMetrics(MetricsWriter& writer) const {
+    writer.counter("linkvue_messages_sent_total", "Messages sent on all connections", double(totalMessagesSent.value()));
+    writer.counter("linkvue_messages_received_total", "Messages received on all connections", double(totalMessagesReceived.value()));
+    writer.counter("linkvue_wire_bytes_sent_total", "Bytes written to sockets", double(totalWireBytesSent.value()));
+    writer.counter("linkvue_wire_bytes_received_total", "Bytes read from sockets", double(totalWireBytesReceived.value()));
+    writer.counter("linkvue_connections_total", "Connections that completed the handshake", double(totalConnections.value()));
+    writer.counter("linkvue_send_failures_total", "Messages that could not be sent", double(totalSendFailures.value()));
+
+    std::pmr::vector<std::pair<ClientId, ConnectionStats>> stats;
+    getConnectionStats(stats);
+    writer.gauge("linkvue_connected_clients", "Open connections", double(stats.size()));
+
+    // Per connection; the series end when the connection does
+    auto perClient = [&](const char* name, const char* type, const char* help, auto value) {
+        writer.family(name, type, help);
+        for (const auto& [client, entry] : stats) {
+            writer.sample(name, double(value(entry)), "client=\"" + std::to_string(client) + "\"");
+        }
+    };
+    perClient("linkvue_client_messages_sent", "counter", "Messages sent to the connection",
+        [](const ConnectionStats& entry) { return entry.messagesSent; });
+    perClient("linkvue_client_messages_received", "counter", "Messages received from the connection",
+        [](const ConnectionStats& entry) { return entry.messagesReceived; });
+    perClient("linkvue_client_bytes_sent", "counter", "Framed message bytes sent, before compression",
+        [](const ConnectionStats& entry) { return entry.bytesSent; });
+    perClient("linkvue_client_wire_bytes_sent", "counter", "Bytes written to the socket",
+        [](const ConnectionStats& entry) { return entry.wireBytesSent; });
+    perClient("linkvue_client_bytes_received", "counter", "Framed message bytes received, after decompression",
+        [](const ConnectionStats& entry) { return entry.bytesReceived; });
+    perClient("linkvue_client_wire_bytes_received", "counter", "Bytes read from the socket",
+        [](const ConnectionStats& entry) { return entry.wireBytesReceived; });
+    perClient("linkvue_client_send_queue_depth", "gauge", "Sends writing to or waiting for the connection",
+        [](const ConnectionStats& entry) { return entry.sendsInFlight; });
+    perClient("linkvue_client_compressed", "gauge", "1 if the connection is compressed",
+        [](const ConnectionStats& entry) { return entry.compressed ? 1 : 0; });
+}
+
+bool NetworkManager::reconnect() {
+    if (hostMode) {
+        return false;
+    }
+    stop();
+    if (!initializeClient(hostAddress)) {
+        return false;
+    }
+    start();
+    return true;
 }
\ No newline at end of file
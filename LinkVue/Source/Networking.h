@@ -1,12 +1,43 @@
+#pragma once
 #include <string>
+#include <string_view>
 #include <vector>
+#include <map>
+#include <memory_resource>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <cstdint>
 #include <functional>
 #include <winsock2.h>
 #include <ws2tcpip.h>
 #pragma comment(lib, "ws2_32.lib")
 
+#include "StreamCompression.h"
+#include "Metrics.h"
+
+// Identifies a connection. On a client the host is always HOST_ID.
+using ClientId = uint32_t;
+
+// Traffic on one connection. Raw bytes are the framed messages, wire bytes what
+// actually crossed the socket; the two only differ on compressed connections.
+struct ConnectionStats {
+    bool compressed = false;
+    uint64_t messagesSent = 0;
+    uint64_t messagesReceived = 0;
+    uint32_t sendsInFlight = 0;  // Sends writing or waiting for the connection's lock
+    uint64_t bytesSent = 0;
+    uint64_t wireBytesSent = 0;
+    uint64_t bytesReceived = 0;
+    uint64_t wireBytesReceived = 0;
+    double compressSeconds = 0.0;
+    double decompressSeconds = 0.0;
+};
+
 class NetworkManager {
 public:
+    static const ClientId HOST_ID = 0;
+
     NetworkManager(int port = 12345);
     ~NetworkManager();
 
@@ -14,14 +45,30 @@ public:
     bool initializeHost();
     bool initializeClient(const std::string& hostAddress);
 
-    // Send and receive messages
+    // Client only: drops whatever is left of the connection and dials the host again
+    bool reconnect();
+
+    // Send and receive messages. Messages are length-prefixed on the wire, so
+    // every callback receives exactly one message as it was sent.
     bool sendMessage(const std::string& message);
+    bool sendTo(ClientId client, const std::string& message);
     bool broadcastMessage(const std::string& message);
 
-    // Set callbacks
-    void setOnMessageReceived(std::function<void(const std::string&)> callback);
-    void setOnClientConnected(std::function<void()> callback);
-    void setOnClientDisconnected(std::function<void()> callback);
+    // Set callbacks. They run on the socket threads. A received message points
+    // into the receive buffer and is only valid during the call.
+    void setOnMessageReceived(std::function<void(ClientId, std::string_view)> callback);
+    void setOnClientConnected(std::function<void(ClientId)> callback);
+    void setOnClientDisconnected(std::function<void(ClientId)> callback);
+
+    // Observes every message that was sent successfully, on the sending thread
+    void setOnMessageSent(std::function<void(ClientId, const std::string&)> callback);
+
+    // Whether to offer stream compression on new connections. It is used when
+    // both ends offer it, and applies below the message framing.
+    void setCompression(bool enabled);
+
+    // Largest payload either end takes in one frame; a peer sending more is dropped
+    static const uint32_t MAX_MESSAGE_SIZE = 64 * 1024 * 1024;
 
     // Start and stop networking
     void start();
@@ -30,23 +77,65 @@ public:
     // Status checks
     bool isRunning() const;
     bool isHost() const;
+    bool isConnected() const;
+
+    // Stats of every open connection, by client; stats is cleared first
+    void getConnectionStats(std::pmr::vector<std::pair<ClientId, ConnectionStats>>& stats) const;
+
+    // Appends transport metrics, totals and per connection. Safe from any thread.
+    void writeMetrics(MetricsWriter& writer) const;
 
 private:
-    static const int BUFFER_SIZE = 512;
+    static const int BUFFER_SIZE = 16 * 1024;
+    static const size_t MAX_KEPT_SEND_BUFFER = 256 * 1024;
+
+    struct Connection {
+        SOCKET socket = INVALID_SOCKET;
+        bool compressed = false;
+        StreamCompressor compressor;      // Guarded by sendMutex
+        StreamDecompressor decompressor;  // Used by the receiving thread only
+        std::mutex sendMutex;
+        std::string frame;                // Reused for every send, guarded by sendMutex
+        std::string block;
 
-    void handleClient(SOCKET clientSocket);
+        std::atomic<uint64_t> messagesSent{ 0 };
+        std::atomic<uint64_t> messagesReceived{ 0 };
+        std::atomic<uint32_t> sendsInFlight{ 0 };
+        std::atomic<uint64_t> bytesSent{ 0 };
+        std::atomic<uint64_t> wireBytesSent{ 0 };
+        std::atomic<uint64_t> bytesReceived{ 0 };
+        std::atomic<uint64_t> wireBytesReceived{ 0 };
+        std::atomic<int64_t> compressNanoseconds{ 0 };
+        std::atomic<int64_t> decompressNanoseconds{ 0 };
+    };
+
+    void handleClient(ClientId client, std::shared_ptr<Connection> connection);
+    void acceptClient(ClientId client, std::shared_ptr<Connection> connection);
     void clientListenerThread();
     void cleanup();
+    bool negotiate(Connection& connection);
+    bool sendFrame(Connection& connection, const std::string& message);
 
     SOCKET listenSocket;
-    std::vector<SOCKET> clientSockets;
-    bool running;
+    std::map<ClientId, std::shared_ptr<Connection>> clientSockets;
+    mutable std::mutex clientsMutex;
+    std::atomic<bool> running;
+    std::atomic<bool> compression;
+
+    // Totals over every connection so far, recorded from all socket and sending threads
+    ShardedCounter totalMessagesSent;
+    ShardedCounter totalMessagesReceived;
+    ShardedCounter totalWireBytesSent;
+    ShardedCounter totalWireBytesReceived;
+    ShardedCounter totalConnections;
+    ShardedCounter totalSendFailures;
     bool hostMode;
     int port;
+    ClientId nextClientId;
+    std::string hostAddress;
 
-    std::function<void(const std::string&)> onMessageReceived;
-    std::function<void()> onClientConnected;
-    std::function<void()> onClientDisconnected;
+    std::function<void(ClientId, std::string_view)> onMessageReceived;
+    std::function<void(ClientId)> onClientConnected;
+    std::function<void(ClientId)> onClientDisconnected;
+    std::function<void(ClientId, const std::string&)> onMessageSent;
 };
-
-
@@ -0,0 +1,289 @@
+#include "PngWriter.h"
+
+#include <algorithm>
+#include <array>
+
+namespace {
+    const size_t IDAT_CHUNK_SIZE = 64 * 1024;
+    const int MAX_MATCH = 258;
+    const int MAX_DISTANCE = 32768;
+
+    const uint16_t LENGTH_BASE[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    const uint8_t LENGTH_EXTRA[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    const uint16_t DISTANCE_BASE[30] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    const uint8_t DISTANCE_EXTRA[30] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    const std::array<uint32_t, 256>& crcTable()
+    {
+        static const std::array<uint32_t, 256> table = []() {
+            std::array<uint32_t, 256> result{};
+            for (uint32_t n = 0; n < 256; n++) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++) {
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                result[n] = c;
+            }
+            return result;
+        }();
+        return table;
+    }
+
+    uint32_t updateCrc(uint32_t crc, const uint8_t* data, size_t size)
+    {
+        const auto& table = crcTable();
+        for (size_t i = 0; i < size; i++) {
+            crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return crc;
+    }
+
+    uint32_t updateAdler(uint32_t adler, const uint8_t* data, size_t size)
+    {
+        uint32_t a = adler & 0xFFFF;
+        uint32_t b = adler >> 16;
+        while (size > 0) {
+            // 5552 is the most bytes that cannot overflow before the modulo
+            size_t block = std::min<size_t>(size, 5552);
+            size -= block;
+            while (block-- > 0) {
+                a += *data++;
+                b += a;
+            }
+            a %= 65521;
+            b %= 65521;
+        }
+        return (b << 16) | a;
+    }
+
+    void putBigEndian(uint8_t* out, uint32_t value)
+    {
+        out[0] = static_cast<uint8_t>(value >> 24);
+        out[1] = static_cast<uint8_t>(value >> 16);
+        out[2] = static_cast<uint8_t>(value >> 8);
+        out[3] = static_cast<uint8_t>(value);
+    }
+}
+
+PngWriter::~PngWriter()
+{
+    abort();
+}
+
+bool PngWriter::open(const std::string& path, uint32_t width, uint32_t height, bool alpha)
+{
+    m_File.open(path, std::ios::binary | std::ios::trunc);
+    if (!m_File) {
+        return false;
+    }
+
+    m_Width = width;
+    m_Height = height;
+    m_Channels = alpha ? 4 : 3;
+    m_RowsWritten = 0;
+    m_PreviousRow.clear();
+    m_CurrentRow.assign(1 + static_cast<size_t>(width) * m_Channels, 0);
+    m_Output.clear();
+    m_BitBuffer = 0;
+    m_BitCount = 0;
+    m_Adler = 1;
+
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    m_File.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+    uint8_t header[13];
+    putBigEndian(header, width);
+    putBigEndian(header + 4, height);
+    header[8] = 8;   // Bit depth
+    header[9] = alpha ? 6 : 2; // Truecolor, with or without alpha
+    header[10] = 0;  // Deflate
+    header[11] = 0;  // Adaptive filtering
+    header[12] = 0;  // No interlace
+    if (!writeChunk("IHDR", header, sizeof(header))) {
+        return false;
+    }
+
+    // zlib header, then one fixed-Huffman block that lasts until finish()
+    m_Output.push_back(0x78);
+    m_Output.push_back(0x01);
+    putBits(1, 1);
+    putBits(1, 2);
+    return true;
+}
+
+bool PngWriter::writeRow(const uint8_t* pixels)
+{
+    if (!m_File || m_RowsWritten >= m_Height) {
+        return false;
+    }
+
+    // Filter type 0; the matcher below already exploits horizontal and vertical runs
+    m_CurrentRow[0] = 0;
+    std::copy(pixels, pixels + static_cast<size_t>(m_Width) * m_Channels, m_CurrentRow.begin() + 1);
+    m_Adler = updateAdler(m_Adler, m_CurrentRow.data(), m_CurrentRow.size());
+
+    const int stride = static_cast<int>(m_CurrentRow.size());
+    const bool canMatchAbove = !m_PreviousRow.empty() && stride <= MAX_DISTANCE;
+
+    int i = 0;
+    while (i < stride) {
+        int limit = std::min(MAX_MATCH, stride - i);
+        int bestLength = 0;
+        int bestDistance = 0;
+
+        if (i >= m_Channels) {
+            int length = 0;
+            while (length < limit && m_CurrentRow[i + length] == m_CurrentRow[i + length - m_Channels]) {
+                length++;
+            }
+            bestLength = length;
+            bestDistance = m_Channels;
+        }
+        if (canMatchAbove) {
+            int length = 0;
+            while (length < limit && m_CurrentRow[i + length] == m_PreviousRow[i + length]) {
+                length++;
+            }
+            if (length > bestLength) {
+                bestLength = length;
+                bestDistance = stride;
+            }
+        }
+
+        if (bestLength >= 3) {
+            putMatch(bestLength, bestDistance);
+            i += bestLength;
+        }
+        else {
+            putLiteral(m_CurrentRow[i]);
+            i++;
+        }
+    }
+
+    m_PreviousRow.swap(m_CurrentRow);
+    m_CurrentRow.resize(m_PreviousRow.size());
+    m_RowsWritten++;
+
+    flushBits(false);
+    return static_cast<bool>(m_File);
+}
+
+bool PngWriter::finish()
+{
+    if (!m_File || m_RowsWritten != m_Height) {
+        return false;
+    }
+
+    putHuffman(0, 7); // End of block
+    flushBits(true);
+
+    uint8_t adler[4];
+    putBigEndian(adler, m_Adler);
+    m_Output.insert(m_Output.end(), adler, adler + 4);
+    if (!writeChunk("IDAT", m_Output.data(), m_Output.size())) {
+        return false;
+    }
+    m_Output.clear();
+
+    bool ok = writeChunk("IEND", nullptr, 0);
+    m_File.close();
+    return ok;
+}
+
+void PngWriter::abort()
+{
+    if (m_File.is_open()) {
+        m_File.close();
+    }
+}
+
+void PngWriter::putBits(uint32_t value, int count)
+{
+    m_BitBuffer |= value << m_BitCount;
+    m_BitCount += count;
+    while (m_BitCount >= 8) {
+        m_Output.push_back(static_cast<uint8_t>(m_BitBuffer));
+        m_BitBuffer >>= 8;
+        m_BitCount -= 8;
+    }
+}
+
+void PngWriter::putHuffman(uint32_t code, int length)
+{
+    // Huffman codes are stored most significant bit first
+    uint32_t reversed = 0;
+    for (int i = 0; i < length; i++) {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    putBits(reversed, length);
+}
+
+void PngWriter::putLiteral(uint8_t value)
+{
+    if (value < 144) {
+        putHuffman(0x30 + value, 8);
+    }
+    else {
+        putHuffman(0x190 + (value - 144), 9);
+    }
+}
+
+void PngWriter::putMatch(int length, int distance)
+{
+    int lengthCode = 28;
+    while (LENGTH_BASE[lengthCode] > length) {
+        lengthCode--;
+    }
+    int symbol = 257 + lengthCode;
+    if (symbol < 280) {
+        putHuffman(symbol - 256, 7);
+    }
+    else {
+        putHuffman(0xC0 + (symbol - 280), 8);
+    }
+    putBits(length - LENGTH_BASE[lengthCode], LENGTH_EXTRA[lengthCode]);
+
+    int distanceCode = 29;
+    while (DISTANCE_BASE[distanceCode] > distance) {
+        distanceCode--;
+    }
+    putHuffman(distanceCode, 5);
+    putBits(distance - DISTANCE_BASE[distanceCode], DISTANCE_EXTRA[distanceCode]);
+}
+
+void PngWriter::flushBits(bool final)
+{
+    if (final && m_BitCount > 0) {
+        putBits(0, 8 - m_BitCount);
+    }
+    if (!final && m_Output.size() >= IDAT_CHUNK_SIZE) {
+        writeChunk("IDAT", m_Output.data(), m_Output.size());
+        m_Output.clear();
+    }
+}
+
+bool PngWriter::writeChunk(const char type[4], const uint8_t* data, size_t size)
+{
+    uint8_t length[4];
+    putBigEndian(length, static_cast<uint32_t>(size));
+    m_File.write(reinterpret_cast<const char*>(length), 4);
+    m_File.write(type, 4);
+    if (size > 0) {
+        m_File.write(reinterpret_cast<const char*>(data), size);
+    }
+
+    uint32_t crc = updateCrc(0xFFFFFFFFu, reinterpret_cast<const uint8_t*>(type), 4);
+    crc = updateCrc(crc, data, size) ^ 0xFFFFFFFFu;
+    uint8_t crcBytes[4];
+    putBigEndian(crcBytes, crc);
+    m_File.write(reinterpret_cast<const char*>(crcBytes), 4);
+    return static_cast<bool>(m_File);
+}
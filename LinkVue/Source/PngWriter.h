@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Streaming RGB8 or RGBA8 PNG encoder.
+// Rows are compressed as they arrive (fixed-Huffman deflate, matching against
+// the previous pixel and the pixel above), so memory use is a couple of rows
+// no matter how large the image is.
+class PngWriter {
+public:
+    PngWriter() = default;
+    ~PngWriter();
+
+    PngWriter(const PngWriter&) = delete;
+    PngWriter& operator=(const PngWriter&) = delete;
+
+    bool open(const std::string& path, uint32_t width, uint32_t height, bool alpha = false);
+
+    // pixels holds width * 3 bytes, or width * 4 with alpha; rows must be written top to bottom
+    bool writeRow(const uint8_t* pixels);
+
+    // Writes the trailer once every row was written
+    bool finish();
+
+    // Closes without finishing, e.g. when an export is cancelled
+    void abort();
+
+private:
+    void putBits(uint32_t value, int count);
+    void putHuffman(uint32_t code, int length);
+    void putLiteral(uint8_t value);
+    void putMatch(int length, int distance);
+    void flushBits(bool final);
+    bool writeChunk(const char type[4], const uint8_t* data, size_t size);
+
+    std::ofstream m_File;
+    uint32_t m_Width = 0;
+    uint32_t m_Height = 0;
+    int m_Channels = 3;
+    uint32_t m_RowsWritten = 0;
+
+    // Deflate state
+    std::vector<uint8_t> m_PreviousRow;  // Filter byte + pixels of the row above
+    std::vector<uint8_t> m_CurrentRow;
+    std::vector<uint8_t> m_Output;       // Compressed bytes waiting for the next IDAT chunk
+    uint32_t m_BitBuffer = 0;
+    int m_BitCount = 0;
+    uint32_t m_Adler = 1;
+};
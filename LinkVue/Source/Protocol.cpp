@@ -0,0 +1,430 @@
+#include "Protocol.h"
+#include "BlobStore.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <yaml-cpp/yaml.h>
+
+namespace YAML {
+    template<>
+    struct convert<StrokeTransform> {
+        static Node encode(const StrokeTransform& transform) {
+            Node node;
+            node.push_back(transform.scale);
+            node.push_back(transform.offsetX);
+            node.push_back(transform.offsetY);
+            return node;
+        }
+
+        static bool decode(const Node& node, StrokeTransform& transform) {
+            if (!node.IsSequence() || node.size() != 3)
+                return false;
+
+            transform.scale = node[0].as<double>();
+            transform.offsetX = node[1].as<double>();
+            transform.offsetY = node[2].as<double>();
+            return std::isfinite(transform.scale) && transform.scale > 0.0 &&
+                std::isfinite(transform.offsetX) && std::isfinite(transform.offsetY);
+        }
+    };
+
+    template<>
+    struct convert<Stroke> {
+        // Points go out as one binary block of little-endian int16 x, y pairs
+        static Node encode(const Stroke& stroke) {
+            std::vector<unsigned char> packed;
+            packed.reserve(stroke.points.size() * 4);
+            for (const auto& point : stroke.points) {
+                for (int16_t value : { point.x, point.y }) {
+                    uint16_t bits = static_cast<uint16_t>(value);
+                    packed.push_back(static_cast<unsigned char>(bits & 0xFF));
+                    packed.push_back(static_cast<unsigned char>(bits >> 8));
+                }
+            }
+
+            Node node;
+            node["id"] = stroke.id;
+            if (stroke.isShape()) {
+                node["kind"] = static_cast<int>(stroke.kind);
+            }
+            node["tile"].push_back(stroke.tileX);
+            node["tile"].push_back(stroke.tileY);
+            node["scale"] = static_cast<int>(stroke.scale);
+            node["color"] = stroke.color;
+            node["thickness"] = stroke.thickness;
+            node["points"] = Binary(packed.data(), packed.size());
+            if (!stroke.transform.isIdentity()) {
+                node["transform"] = stroke.transform;
+            }
+            return node;
+        }
+
+        static bool decode(const Node& node, Stroke& stroke) {
+            if (!node.IsMap() || !node["id"] || !node["tile"] || !node["scale"] || !node["points"])
+                return false;
+            if (!node["tile"].IsSequence() || node["tile"].size() != 2)
+                return false;
+
+            int scale = node["scale"].as<int>();
+            int kind = node["kind"] ? node["kind"].as<int>() : 0;
+            Binary packed = node["points"].as<Binary>();
+            if (scale < Stroke::MIN_SCALE || scale > Stroke::MAX_SCALE || packed.size() % 4 != 0)
+                return false;
+            if (kind < 0 || kind > static_cast<int>(StrokeKind::Ellipse) || (kind != 0 && packed.size() != 8))
+                return false;
+            stroke.kind = static_cast<StrokeKind>(kind);
+
+            stroke.id = node["id"].as<uint64_t>();
+            stroke.tileX = node["tile"][0].as<int64_t>();
+            stroke.tileY = node["tile"][1].as<int64_t>();
+            stroke.scale = static_cast<int8_t>(scale);
+            if (node["color"]) stroke.color = node["color"].as<std::array<float, 3>>();
+            if (node["thickness"]) stroke.thickness = node["thickness"].as<float>();
+            stroke.transform = node["transform"] ? node["transform"].as<StrokeTransform>() : StrokeTransform();
+
+            const unsigned char* bytes = packed.data();
+            stroke.points.resize(packed.size() / 4);
+            for (auto& point : stroke.points) {
+                point.x = static_cast<int16_t>(bytes[0] | (bytes[1] << 8));
+                point.y = static_cast<int16_t>(bytes[2] | (bytes[3] << 8));
+                bytes += 4;
+            }
+            stroke.updateBounds();
+            return true;
+        }
+    };
+
+    template<>
+    struct convert<Rect> {
+        static Node encode(const Rect& rect) {
+            Node node;
+            node.push_back(rect.minX);
+            node.push_back(rect.minY);
+            node.push_back(rect.maxX);
+            node.push_back(rect.maxY);
+            return node;
+        }
+
+        static bool decode(const Node& node, Rect& rect) {
+            if (!node.IsSequence() || node.size() != 4)
+                return false;
+
+            rect.minX = node[0].as<double>();
+            rect.minY = node[1].as<double>();
+            rect.maxX = node[2].as<double>();
+            rect.maxY = node[3].as<double>();
+            // NaN would slip past every comparison, and infinities past any size limit
+            return std::isfinite(rect.minX) && std::isfinite(rect.minY) &&
+                std::isfinite(rect.maxX) && std::isfinite(rect.maxY);
+        }
+    };
+
+    template<>
+    struct convert<BoardImage> {
+        static Node encode(const BoardImage& image) {
+            Node node;
+            node["id"] = image.id;
+            node["blob"] = image.blobHash;
+            node["size"] = image.blobSize;
+            node["bounds"] = image.bounds;
+            return node;
+        }
+
+        static bool decode(const Node& node, BoardImage& image) {
+            if (!node.IsMap() || !node["id"] || !node["blob"] || !node["size"] || !node["bounds"])
+                return false;
+
+            image.id = node["id"].as<uint64_t>();
+            image.blobHash = node["blob"].as<std::string>();
+            image.blobSize = node["size"].as<uint64_t>();
+            image.bounds = node["bounds"].as<Rect>();
+            return true;
+        }
+    };
+}
+
+const char* opTypeName(OpType type)
+{
+    switch (type) {
+    case OpType::AddStrokes: return "add";
+    case OpType::RemoveStrokes: return "remove";
+    case OpType::Clear: return "clear";
+    case OpType::CanvasColor: return "canvas";
+    case OpType::Snapshot: return "snapshot";
+    case OpType::Viewport: return "viewport";
+    case OpType::AddImages: return "images";
+    case OpType::BlobRequest: return "blobRequest";
+    case OpType::BlobChunk: return "blobChunk";
+    case OpType::Hello: return "hello";
+    case OpType::Welcome: return "welcome";
+    case OpType::Ack: return "ack";
+    case OpType::DigestQuery: return "digestQuery";
+    case OpType::Digest: return "digest";
+    case OpType::StrokeRequest: return "strokeRequest";
+    case OpType::TransformStrokes: return "transform";
+    }
+    return "";
+}
+
+namespace {
+    bool opFromName(const std::string& name, OpType& type)
+    {
+        for (OpType candidate : { OpType::AddStrokes, OpType::RemoveStrokes, OpType::Clear,
+                                  OpType::CanvasColor, OpType::Snapshot, OpType::Viewport,
+                                  OpType::AddImages, OpType::BlobRequest, OpType::BlobChunk,
+                                  OpType::Hello, OpType::Welcome, OpType::Ack,
+                                  OpType::DigestQuery, OpType::Digest, OpType::StrokeRequest,
+                                  OpType::TransformStrokes }) {
+            if (name == opTypeName(candidate)) {
+                type = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Hashes are random bits, so they go out as one binary block of little-endian uint64s
+    void putHashes(YAML::Node node, const std::vector<uint64_t>& hashes)
+    {
+        std::vector<unsigned char> packed;
+        packed.reserve(hashes.size() * 8);
+        for (uint64_t hash : hashes) {
+            for (int shift = 0; shift < 64; shift += 8) {
+                packed.push_back(static_cast<unsigned char>(hash >> shift));
+            }
+        }
+        node = YAML::Binary(packed.data(), packed.size());
+    }
+
+    bool getHashes(const YAML::Node& node, std::vector<uint64_t>& hashes)
+    {
+        YAML::Binary packed = node.as<YAML::Binary>();
+        if (packed.size() % 8 != 0) {
+            return false;
+        }
+        hashes.resize(packed.size() / 8);
+        const unsigned char* bytes = packed.data();
+        for (auto& hash : hashes) {
+            hash = 0;
+            for (int i = 7; i >= 0; i--) {
+                hash = (hash << 8) | bytes[i];
+            }
+            bytes += 8;
+        }
+        return true;
+    }
+
+    // Ids drawn in one session differ in their low bits only, so sorted they go
+    // out as one binary block of gaps, 7 bits per byte
+    void putIds(YAML::Node node, std::vector<uint64_t> ids)
+    {
+        std::sort(ids.begin(), ids.end());
+        std::vector<unsigned char> packed;
+        uint64_t previous = 0;
+        for (uint64_t id : ids) {
+            uint64_t gap = id - previous;
+            previous = id;
+            while (gap >= 0x80) {
+                packed.push_back(static_cast<unsigned char>(gap | 0x80));
+                gap >>= 7;
+            }
+            packed.push_back(static_cast<unsigned char>(gap));
+        }
+        node = YAML::Binary(packed.data(), packed.size());
+    }
+
+    bool getIds(const YAML::Node& node, std::vector<uint64_t>& ids)
+    {
+        YAML::Binary packed = node.as<YAML::Binary>();
+        uint64_t previous = 0;
+        uint64_t gap = 0;
+        int shift = 0;
+        for (size_t i = 0; i < packed.size(); i++) {
+            if (shift > 63) {
+                return false;
+            }
+            gap |= static_cast<uint64_t>(packed.data()[i] & 0x7F) << shift;
+            shift += 7;
+            if ((packed.data()[i] & 0x80) == 0) {
+                previous += gap;
+                ids.push_back(previous);
+                gap = 0;
+                shift = 0;
+            }
+        }
+        return shift == 0;
+    }
+}
+
+size_t encodedSizeBound(const Stroke& stroke)
+{
+    // Points are 4 bytes each as base64, which is 16 characters per 3 points;
+    // the other fields are a few numbers and keys, well under the fixed part
+    const size_t FIXED_BYTES = 512;
+    return FIXED_BYTES + (stroke.points.size() * 16 + 2) / 3;
+}
+
+std::string encodeOp(const BoardOp& op)
+{
+    YAML::Node node;
+    node["op"] = opTypeName(op.type);
+    if (op.seq != 0) {
+        node["seq"] = op.seq;
+    }
+    if (op.clientSeq != 0) {
+        node["cseq"] = op.clientSeq;
+    }
+
+    switch (op.type) {
+    case OpType::AddStrokes:
+        for (const auto& stroke : op.strokes) {
+            node["strokes"].push_back(stroke);
+        }
+        break;
+    case OpType::RemoveStrokes:
+        node["ids"] = op.strokeIds;
+        break;
+    case OpType::Clear:
+        break;
+    case OpType::CanvasColor:
+        node["canvasColor"] = op.canvasColor;
+        break;
+    case OpType::Snapshot:
+        for (const auto& stroke : op.strokes) {
+            node["strokes"].push_back(stroke);
+        }
+        for (const auto& image : op.images) {
+            node["images"].push_back(image);
+        }
+        node["canvasColor"] = op.canvasColor;
+        break;
+    case OpType::Viewport:
+        node["viewport"] = op.viewport;
+        break;
+    case OpType::AddImages:
+        for (const auto& image : op.images) {
+            node["images"].push_back(image);
+        }
+        break;
+    case OpType::BlobRequest:
+        node["blob"] = op.blobHash;
+        node["offset"] = op.blobOffset;
+        break;
+    case OpType::BlobChunk:
+        node["blob"] = op.blobHash;
+        node["offset"] = op.blobOffset;
+        node["size"] = op.blobSize;
+        node["data"] = YAML::Binary(op.blobData.data(), op.blobData.size());
+        break;
+    case OpType::Hello:
+        node["session"] = op.sessionToken;
+        node["lastSeq"] = op.lastSeq;
+        break;
+    case OpType::Welcome:
+        node["session"] = op.sessionToken;
+        node["resumed"] = op.resumed;
+        break;
+    case OpType::Ack:
+        break;
+    case OpType::DigestQuery:
+    case OpType::Digest:
+        node["nodes"] = op.digestNodes;
+        putHashes(node["nodeHashes"], op.digestHashes);
+        if (!op.strokeIds.empty()) {
+            node["ids"] = op.strokeIds;
+            putHashes(node["strokeHashes"], op.strokeHashes);
+        }
+        break;
+    case OpType::StrokeRequest:
+        node["ids"] = op.strokeIds;
+        break;
+    case OpType::TransformStrokes: {
+        // Strokes moved together share their new transform, so they go out as one group
+        std::map<std::array<double, 3>, std::vector<uint64_t>> groups;
+        for (size_t i = 0; i < op.strokeIds.size() && i < op.transforms.size(); i++) {
+            const StrokeTransform& transform = op.transforms[i];
+            groups[{ transform.scale, transform.offsetX, transform.offsetY }].push_back(op.strokeIds[i]);
+        }
+        for (auto& [key, ids] : groups) {
+            YAML::Node group;
+            group["transform"] = StrokeTransform{ key[0], key[1], key[2] };
+            putIds(group["ids"], std::move(ids));
+            node["moves"].push_back(group);
+        }
+        break;
+    }
+    }
+
+    return YAML::Dump(node);
+}
+
+bool decodeOp(const std::string& message, BoardOp& op)
+{
+    try {
+        YAML::Node node = YAML::Load(message);
+        if (!node["op"] || !opFromName(node["op"].as<std::string>(), op.type)) {
+            return false;
+        }
+
+        op.seq = node["seq"] ? node["seq"].as<uint64_t>() : 0;
+        op.clientSeq = node["cseq"] ? node["cseq"].as<uint64_t>() : 0;
+        op.strokes.clear();
+        op.strokeIds.clear();
+        op.images.clear();
+        op.blobData.clear();
+        op.digestNodes.clear();
+        op.digestHashes.clear();
+        op.strokeHashes.clear();
+        op.transforms.clear();
+        if (node["strokes"]) {
+            for (const auto& strokeNode : node["strokes"]) {
+                op.strokes.push_back(strokeNode.as<Stroke>());
+            }
+        }
+        if (node["ids"]) op.strokeIds = node["ids"].as<std::vector<uint64_t>>();
+        if (node["canvasColor"]) op.canvasColor = node["canvasColor"].as<std::array<float, 3>>();
+        if (node["viewport"]) op.viewport = node["viewport"].as<Rect>();
+        if (node["images"]) {
+            for (const auto& imageNode : node["images"]) {
+                // No image we can decode is larger, so the rest of the op still counts
+                BoardImage image = imageNode.as<BoardImage>();
+                if (image.blobSize <= BlobStore::MAX_BLOB_SIZE) {
+                    op.images.push_back(std::move(image));
+                }
+            }
+        }
+        if (node["blob"]) op.blobHash = node["blob"].as<std::string>();
+        if (node["offset"]) op.blobOffset = node["offset"].as<uint64_t>();
+        if (node["size"]) op.blobSize = node["size"].as<uint64_t>();
+        if (node["session"]) op.sessionToken = node["session"].as<std::string>();
+        if (node["lastSeq"]) op.lastSeq = node["lastSeq"].as<uint64_t>();
+        if (node["resumed"]) op.resumed = node["resumed"].as<bool>();
+        if (node["data"]) {
+            YAML::Binary data = node["data"].as<YAML::Binary>();
+            op.blobData.assign(data.data(), data.data() + data.size());
+        }
+        if (node["nodes"]) op.digestNodes = node["nodes"].as<std::vector<uint32_t>>();
+        if (node["nodeHashes"] && (!getHashes(node["nodeHashes"], op.digestHashes) || op.digestHashes.size() != op.digestNodes.size())) {
+            return false;
+        }
+        if (node["strokeHashes"] && (!getHashes(node["strokeHashes"], op.strokeHashes) || op.strokeHashes.size() != op.strokeIds.size())) {
+            return false;
+        }
+        if (node["moves"]) {
+            for (const auto& group : node["moves"]) {
+                StrokeTransform transform = group["transform"].as<StrokeTransform>();
+                if (!group["ids"] || !getIds(group["ids"], op.strokeIds)) {
+                    return false;
+                }
+                op.transforms.resize(op.strokeIds.size(), transform);
+            }
+        }
+        return true;
+    }
+    catch (const YAML::Exception& e) {
+        std::cerr << "Dropping malformed message: " << e.what() << std::endl;
+        return false;
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <array>
+#include <cstdint>
+
+#include "Stroke.h"
+
+// Operations exchanged between peers. Each one is sent as its own message.
+enum class OpType {
+    AddStrokes,     // strokes
+    RemoveStrokes,  // strokeIds, which may name strokes or images
+    Clear,
+    CanvasColor,    // canvasColor
+    Snapshot,       // strokes + images + canvasColor, replaces the whole board
+    Viewport,       // viewport, client -> host only
+    AddImages,      // images, metadata only
+    BlobRequest,    // blobHash + blobOffset: send this blob from that byte on
+    BlobChunk,      // blobHash + blobOffset + blobSize (total) + blobData
+    Hello,          // sessionToken (empty for a new session) + lastSeq, client -> host on connect
+    Welcome,        // sessionToken + resumed, host -> client
+    Ack,            // clientSeq: the host applied the client's ops up to this one
+    DigestQuery,    // digestNodes + digestHashes (the sender's), client -> host
+    Digest,         // digestNodes + digestHashes: children of the queried nodes that differ;
+                    // strokeIds + strokeHashes: everything in the queried leaves
+    StrokeRequest,  // strokeIds: client -> host, send these strokes again
+    TransformStrokes // strokeIds + transforms: the new transform of each stroke
+};
+
+struct BoardOp {
+    OpType type = OpType::AddStrokes;
+    uint64_t seq = 0;       // Host -> client ordering within a session; 0 when unsequenced
+    uint64_t clientSeq = 0; // Client -> host numbering of local ops, echoed back in Ack
+    std::vector<Stroke> strokes;
+    std::vector<uint64_t> strokeIds;
+    std::array<float, 3> canvasColor = { 1.0f, 1.0f, 1.0f };
+    Rect viewport;
+    std::vector<BoardImage> images;
+    std::string blobHash;
+    uint64_t blobOffset = 0;
+    uint64_t blobSize = 0;
+    std::vector<uint8_t> blobData;
+    std::string sessionToken;
+    uint64_t lastSeq = 0;
+    bool resumed = false;
+    std::vector<uint32_t> digestNodes;  // BoardDigest nodes
+    std::vector<uint64_t> digestHashes; // One per digest node
+    std::vector<uint64_t> strokeHashes; // One per stroke id
+    std::vector<StrokeTransform> transforms; // One per stroke id
+};
+
+const char* opTypeName(OpType type);
+std::string encodeOp(const BoardOp& op);
+
+// At least as many bytes as the stroke takes up in an encoded op, to split
+// batches of strokes into messages that stay under a size
+size_t encodedSizeBound(const Stroke& stroke);
+bool decodeOp(const std::string& message, BoardOp& op);
@@ -0,0 +1,141 @@
+#include "SessionManager.h"
+
+#include <random>
+
+SessionManager::SessionManager(size_t maxLogBytes, size_t maxLogOps, std::chrono::seconds expiry)
+    : m_MaxLogBytes(maxLogBytes), m_MaxLogOps(maxLogOps), m_Expiry(expiry)
+{
+}
+
+std::string SessionManager::newToken()
+{
+    static const char* hex = "0123456789abcdef";
+    std::random_device device;
+    std::string token;
+    for (int i = 0; i < 4; i++) {
+        uint32_t bits = device();
+        for (int j = 0; j < 8; j++) {
+            token += hex[(bits >> (j * 4)) & 0xF];
+        }
+    }
+    return token;
+}
+
+SessionManager::Resume SessionManager::attach(ClientId client, const std::string& token, uint64_t lastSeq,
+    ClientId& previous, std::vector<std::string>& replay)
+{
+    replay.clear();
+    previous = client;
+
+    auto it = token.empty() ? m_Sessions.end() : m_Sessions.find(token);
+    if (it == m_Sessions.end()) {
+        std::string fresh = newToken();
+        Session& session = m_Sessions[fresh];
+        session.client = client;
+        session.connected = true;
+        m_Tokens[client] = fresh;
+        return Resume::NewSession;
+    }
+
+    // Also covers a reconnect that beat the host to noticing the old connection died
+    Session& session = it->second;
+    previous = session.client;
+    m_Tokens.erase(session.client);
+    m_Tokens[client] = token;
+    session.client = client;
+    session.connected = true;
+
+    uint64_t oldest = session.log.empty() ? session.nextSeq : session.log.front().seq;
+    if (lastSeq >= session.nextSeq || lastSeq + 1 < oldest) {
+        return Resume::Snapshot;
+    }
+
+    for (const auto& entry : session.log) {
+        if (entry.seq > lastSeq) {
+            replay.push_back(entry.message);
+        }
+    }
+    return Resume::Replayed;
+}
+
+void SessionManager::detach(ClientId client)
+{
+    auto token = m_Tokens.find(client);
+    if (token == m_Tokens.end()) {
+        return;
+    }
+    auto it = m_Sessions.find(token->second);
+    if (it != m_Sessions.end() && it->second.client == client) {
+        it->second.connected = false;
+        it->second.parkedAt = Clock::now();
+    }
+}
+
+std::vector<ClientId> SessionManager::expire()
+{
+    std::vector<ClientId> expired;
+    Clock::time_point now = Clock::now();
+    for (auto it = m_Sessions.begin(); it != m_Sessions.end();) {
+        if (!it->second.connected && now - it->second.parkedAt > m_Expiry) {
+            expired.push_back(it->second.client);
+            m_Tokens.erase(it->second.client);
+            it = m_Sessions.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    return expired;
+}
+
+std::string SessionManager::stamp(ClientId client, BoardOp& op)
+{
+    auto token = m_Tokens.find(client);
+    if (token == m_Tokens.end()) {
+        op.seq = 0;
+        return encodeOp(op);
+    }
+
+    Session& session = m_Sessions[token->second];
+    op.seq = session.nextSeq++;
+    std::string message = encodeOp(op);
+
+    // Oldest entries fall off first; a client that needed them gets a snapshot
+    session.logBytes += message.size();
+    session.log.push_back({ op.seq, message });
+    while (!session.log.empty() && (session.log.size() > m_MaxLogOps || session.logBytes > m_MaxLogBytes)) {
+        session.logBytes -= session.log.front().message.size();
+        session.log.pop_front();
+    }
+    return message;
+}
+
+bool SessionManager::acceptClientOp(ClientId client, uint64_t clientSeq)
+{
+    auto token = m_Tokens.find(client);
+    if (token == m_Tokens.end()) {
+        return true;
+    }
+    Session& session = m_Sessions[token->second];
+    if (clientSeq <= session.lastClientSeq) {
+        return false;
+    }
+    session.lastClientSeq = clientSeq;
+    return true;
+}
+
+bool SessionManager::isConnected(ClientId client) const
+{
+    auto token = m_Tokens.find(client);
+    if (token == m_Tokens.end()) {
+        return false;
+    }
+    auto it = m_Sessions.find(token->second);
+    return it != m_Sessions.end() && it->second.connected && it->second.client == client;
+}
+
+std::string SessionManager::getToken(ClientId client) const
+{
+    auto token = m_Tokens.find(client);
+    return token != m_Tokens.end() ? token->second : std::string();
+}
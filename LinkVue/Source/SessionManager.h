@@ -0,0 +1,76 @@
+#pragma once
+#include <string>
+#include <deque>
+#include <vector>
+#include <chrono>
+#include <unordered_map>
+#include <cstdint>
+
+#include "Networking.h"
+#include "Protocol.h"
+
+// Host-side client sessions that outlive their TCP connection.
+// Every board message sent to a session is numbered and kept in a bounded log.
+// A client that reconnects with its token and the last number it got is sent
+// just the logged messages after that; if the log no longer reaches back that
+// far, it needs a snapshot instead.
+class SessionManager {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class Resume {
+        Replayed,   // replay holds every message the client missed
+        Snapshot,   // Known session, but the gap is wider than the log
+        NewSession  // Unknown or expired token
+    };
+
+    explicit SessionManager(size_t maxLogBytes = 8 * 1024 * 1024, size_t maxLogOps = 8192,
+        std::chrono::seconds expiry = std::chrono::seconds(120));
+
+    // Binds connection client to the session named by token, or to a new session.
+    // previous is the connection id the session had before, for resumed sessions.
+    Resume attach(ClientId client, const std::string& token, uint64_t lastSeq,
+        ClientId& previous, std::vector<std::string>& replay);
+
+    // The connection dropped; its session waits for a resume until it expires
+    void detach(ClientId client);
+
+    // Drops sessions parked for too long and returns their connection ids
+    std::vector<ClientId> expire();
+
+    // Numbers op for client's session, logs it and returns the encoded message
+    std::string stamp(ClientId client, BoardOp& op);
+
+    // Returns false for a client op the session already delivered, e.g. one resent
+    // after a reconnect because its Ack was lost
+    bool acceptClientOp(ClientId client, uint64_t clientSeq);
+
+    bool hasSession(ClientId client) const { return m_Tokens.count(client) != 0; }
+    bool isConnected(ClientId client) const;
+    std::string getToken(ClientId client) const;
+
+private:
+    struct LogEntry {
+        uint64_t seq;
+        std::string message;
+    };
+
+    struct Session {
+        ClientId client = 0;
+        bool connected = false;
+        Clock::time_point parkedAt;
+        uint64_t nextSeq = 1;
+        uint64_t lastClientSeq = 0; // Highest client op applied
+        std::deque<LogEntry> log; // Oldest first
+        size_t logBytes = 0;
+    };
+
+    static std::string newToken();
+
+    size_t m_MaxLogBytes;
+    size_t m_MaxLogOps;
+    std::chrono::seconds m_Expiry;
+
+    std::unordered_map<std::string, Session> m_Sessions;  // By token
+    std::unordered_map<ClientId, std::string> m_Tokens;   // Connection id -> token
+};
@@ -0,0 +1,121 @@
+#include "SessionRecording.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace {
+    const char RECORDING_MAGIC[4] = { 'L', 'V', 'R', '1' };
+    const uint64_t MAX_RECORD_PAYLOAD = 256ull * 1024 * 1024;
+}
+
+bool SessionRecorder::open(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_File.open(path, std::ios::binary | std::ios::trunc);
+    if (!m_File) {
+        std::cerr << "Cannot record to " << path << std::endl;
+        return false;
+    }
+    m_File.write(RECORDING_MAGIC, sizeof(RECORDING_MAGIC));
+    m_LastRecord = Clock::now();
+    m_Open = true;
+    return true;
+}
+
+void SessionRecorder::writeVarint(uint64_t value)
+{
+    char bytes[10];
+    int count = 0;
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        bytes[count++] = static_cast<char>(value != 0 ? byte | 0x80 : byte);
+    } while (value != 0);
+    m_File.write(bytes, count);
+}
+
+void SessionRecorder::record(RecordKind kind, uint32_t peer, const std::string& payload)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (!m_Open) {
+        return;
+    }
+
+    // Time deltas stay small, so most records spend one or two bytes on them
+    Clock::time_point now = Clock::now();
+    uint64_t delta = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - m_LastRecord).count());
+    m_LastRecord = now;
+
+    m_File.put(static_cast<char>(kind));
+    writeVarint(delta);
+    writeVarint(peer);
+    writeVarint(payload.size());
+    m_File.write(payload.data(), payload.size());
+}
+
+void SessionRecorder::close(uint64_t checksum)
+{
+    std::string bytes(8, '\0');
+    for (int i = 0; i < 8; i++) {
+        bytes[i] = static_cast<char>(checksum >> (i * 8));
+    }
+    record(RecordKind::Checksum, 0, bytes);
+    close();
+}
+
+void SessionRecorder::close()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (m_Open) {
+        m_File.close();
+        m_Open = false;
+    }
+}
+
+bool SessionReader::open(const std::string& path)
+{
+    m_File.open(path, std::ios::binary);
+    char magic[4] = {};
+    m_File.read(magic, sizeof(magic));
+    m_Time = 0;
+    return m_File && std::equal(magic, magic + 4, RECORDING_MAGIC);
+}
+
+bool SessionReader::readVarint(uint64_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int byte = m_File.get();
+        if (byte == EOF) {
+            return false;
+        }
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SessionReader::next(RecordEntry& entry)
+{
+    int kind = m_File.get();
+    if (kind == EOF) {
+        return false;
+    }
+
+    uint64_t delta = 0;
+    uint64_t peer = 0;
+    uint64_t length = 0;
+    if (!readVarint(delta) || !readVarint(peer) || !readVarint(length) || length > MAX_RECORD_PAYLOAD) {
+        return false;
+    }
+
+    entry.kind = static_cast<RecordKind>(kind);
+    m_Time += delta;
+    entry.timeMicros = m_Time;
+    entry.peer = static_cast<uint32_t>(peer);
+    entry.payload.resize(static_cast<size_t>(length));
+    m_File.read(entry.payload.data(), static_cast<std::streamsize>(length));
+    return static_cast<uint64_t>(m_File.gcount()) == length;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <string>
+#include <fstream>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+// Binary session recordings, used to replay real sessions offline.
+// A file is the magic "LVR1" followed by records of
+//   [kind u8][microseconds since the previous record][peer][payload length][payload]
+// with every number after the kind stored as a LEB128 varint.
+enum class RecordKind : uint8_t {
+    Inbound = 1,  // Message applied from a peer
+    Outbound = 2, // Message handed to the network
+    LocalOp = 3,  // Op produced by local input
+    Checksum = 4  // Board checksum when recording stopped, as 8 little-endian bytes
+};
+
+struct RecordEntry {
+    RecordKind kind = RecordKind::Inbound;
+    uint64_t timeMicros = 0; // Since the start of the recording
+    uint32_t peer = 0;
+    std::string payload;
+};
+
+// Appends records from any thread
+class SessionRecorder {
+public:
+    SessionRecorder() = default;
+    ~SessionRecorder() { close(); }
+
+    SessionRecorder(const SessionRecorder&) = delete;
+    SessionRecorder& operator=(const SessionRecorder&) = delete;
+
+    bool open(const std::string& path);
+    bool isOpen() const { return m_Open; }
+    void record(RecordKind kind, uint32_t peer, const std::string& payload);
+
+    // Writes the final board checksum so a replay can verify itself against it
+    void close(uint64_t checksum);
+    void close();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void writeVarint(uint64_t value);
+
+    std::mutex m_Mutex;
+    std::ofstream m_File;
+    bool m_Open = false;
+    Clock::time_point m_LastRecord;
+};
+
+class SessionReader {
+public:
+    bool open(const std::string& path);
+
+    // Returns false at the end of the file or on a truncated record
+    bool next(RecordEntry& entry);
+
+private:
+    bool readVarint(uint64_t& value);
+
+    std::ifstream m_File;
+    uint64_t m_Time = 0;
+};
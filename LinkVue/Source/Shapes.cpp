@@ -0,0 +1,91 @@
+#include "Shapes.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    const double PI = 3.14159265358979323846;
+
+    // Largest gap between an ellipse and its polygon, in screen pixels
+    const double MAX_CURVE_ERROR = 0.25;
+    const int MIN_CURVE_SEGMENTS = 12;
+    const int MAX_CURVE_SEGMENTS = 1024;
+}
+
+void appendShapeOutline(const Stroke& stroke, double pixelsPerStep, std::vector<OutlinePoint>& outline)
+{
+    if (!stroke.isShape() || stroke.points.size() != 2) {
+        return;
+    }
+
+    float x0 = stroke.points[0].x;
+    float y0 = stroke.points[0].y;
+    float x1 = stroke.points[1].x;
+    float y1 = stroke.points[1].y;
+
+    switch (stroke.kind) {
+    case StrokeKind::Line:
+        outline.push_back({ x0, y0 });
+        outline.push_back({ x1, y1 });
+        break;
+
+    case StrokeKind::Arrow: {
+        double dx = x1 - x0;
+        double dy = y1 - y0;
+        double length = std::sqrt(dx * dx + dy * dy);
+        if (length <= 0.0) {
+            break;
+        }
+        // Head barbs at 30 degrees either side of the shaft; the tip is visited twice
+        double head = stroke.arrowHeadLength(length * stroke.step()) / stroke.step();
+        double ux = dx / length;
+        double uy = dy / length;
+        double cosine = std::cos(PI / 6.0);
+        double sine = std::sin(PI / 6.0);
+        OutlinePoint left = {
+            static_cast<float>(x1 - head * (ux * cosine - uy * sine)),
+            static_cast<float>(y1 - head * (uy * cosine + ux * sine)) };
+        OutlinePoint right = {
+            static_cast<float>(x1 - head * (ux * cosine + uy * sine)),
+            static_cast<float>(y1 - head * (uy * cosine - ux * sine)) };
+        outline.push_back({ x0, y0 });
+        outline.push_back({ x1, y1 });
+        outline.push_back(left);
+        outline.push_back({ x1, y1 });
+        outline.push_back(right);
+        break;
+    }
+
+    case StrokeKind::Rectangle:
+        outline.push_back({ x0, y0 });
+        outline.push_back({ x1, y0 });
+        outline.push_back({ x1, y1 });
+        outline.push_back({ x0, y1 });
+        outline.push_back({ x0, y0 });
+        break;
+
+    case StrokeKind::Ellipse: {
+        // Inscribed in the box the two points span
+        double cx = 0.5 * (x0 + x1);
+        double cy = 0.5 * (y0 + y1);
+        double rx = 0.5 * std::abs(x1 - x0);
+        double ry = 0.5 * std::abs(y1 - y0);
+
+        // Chord count keeping the sagitta under MAX_CURVE_ERROR at the larger radius
+        double radiusPixels = std::max(rx, ry) * pixelsPerStep;
+        int segments = MIN_CURVE_SEGMENTS;
+        if (radiusPixels > MAX_CURVE_ERROR) {
+            double angle = 2.0 * std::acos(1.0 - MAX_CURVE_ERROR / radiusPixels);
+            segments = std::clamp(static_cast<int>(std::ceil(2.0 * PI / angle)), MIN_CURVE_SEGMENTS, MAX_CURVE_SEGMENTS);
+        }
+        for (int i = 0; i <= segments; i++) {
+            double angle = 2.0 * PI * i / segments;
+            outline.push_back({ static_cast<float>(cx + rx * std::cos(angle)), static_cast<float>(cy + ry * std::sin(angle)) });
+        }
+        break;
+    }
+
+    case StrokeKind::Freehand:
+        break;
+    }
+}
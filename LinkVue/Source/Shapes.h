@@ -0,0 +1,14 @@
+#pragma once
+#include <vector>
+
+#include "Stroke.h"
+
+// Outline vertex in quantization steps from the stroke's tile origin
+struct OutlinePoint {
+    float x, y;
+};
+
+// Appends the polyline that draws a shape stroke. Curves are split just finely
+// enough to look smooth at pixelsPerStep screen pixels per quantization step,
+// so the same shape stays crisp at every zoom. Freehand strokes append nothing.
+void appendShapeOutline(const Stroke& stroke, double pixelsPerStep, std::vector<OutlinePoint>& outline);
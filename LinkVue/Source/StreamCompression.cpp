@@ -0,0 +1,240 @@
+#include "StreamCompression.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    const size_t WINDOW_SIZE = 64 * 1024;
+    const size_t MAX_OFFSET = WINDOW_SIZE - 1;
+    const size_t MIN_MATCH = 4;
+    const int HASH_BITS = 14;
+    const size_t HEADER_SIZE = 8;
+
+    // Matches the 64 MiB message limit plus its length prefix, with room to spare
+    const size_t MAX_BLOCK_SIZE = 128 * 1024 * 1024;
+
+    uint32_t read32(const uint8_t* data)
+    {
+        uint32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    uint32_t hashSequence(uint32_t sequence)
+    {
+        return (sequence * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    void writeU32(std::string& out, uint32_t value)
+    {
+        out += static_cast<char>(value >> 24);
+        out += static_cast<char>(value >> 16);
+        out += static_cast<char>(value >> 8);
+        out += static_cast<char>(value);
+    }
+
+    uint32_t readU32(const char* data)
+    {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+        return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) | uint32_t(bytes[3]);
+    }
+
+    // Lengths past what fits in the token continue in bytes of 255 and a remainder
+    void writeLength(std::string& out, size_t length)
+    {
+        while (length >= 255) {
+            out += static_cast<char>(255);
+            length -= 255;
+        }
+        out += static_cast<char>(length);
+    }
+
+    bool readLength(const uint8_t* payload, size_t payloadSize, size_t& i, size_t& length)
+    {
+        uint8_t byte = 255;
+        while (byte == 255) {
+            if (i >= payloadSize || length > MAX_BLOCK_SIZE) {
+                return false;
+            }
+            byte = payload[i++];
+            length += byte;
+        }
+        return true;
+    }
+
+    // One sequence: literals, then a match of matchLength bytes at offset back.
+    // A matchLength of 0 ends the block with literals only.
+    void writeSequence(std::string& out, const uint8_t* literals, size_t literalLength, size_t offset, size_t matchLength)
+    {
+        size_t matchCode = matchLength > 0 ? matchLength - MIN_MATCH : 0;
+        uint8_t token = static_cast<uint8_t>((std::min<size_t>(literalLength, 15) << 4) | std::min<size_t>(matchCode, 15));
+        out += static_cast<char>(token);
+        if (literalLength >= 15) {
+            writeLength(out, literalLength - 15);
+        }
+        out.append(reinterpret_cast<const char*>(literals), literalLength);
+
+        if (matchLength == 0) {
+            return;
+        }
+        out += static_cast<char>(offset & 0xFF);
+        out += static_cast<char>(offset >> 8);
+        if (matchCode >= 15) {
+            writeLength(out, matchCode - 15);
+        }
+    }
+}
+
+StreamCompressor::StreamCompressor()
+    : m_Table(size_t(1) << HASH_BITS, 0)
+{
+}
+
+void StreamCompressor::compress(const uint8_t* data, size_t size, std::string& out)
+{
+    size_t start = m_Window.size();
+    m_Window.insert(m_Window.end(), data, data + size);
+    const uint8_t* window = m_Window.data();
+    const size_t end = m_Window.size();
+
+    std::string payload;
+    payload.reserve(size + size / 255 + 16);
+
+    size_t anchor = start;
+    size_t pos = start;
+    while (pos + MIN_MATCH <= end) {
+        uint32_t sequence = read32(window + pos);
+        uint32_t& slot = m_Table[hashSequence(sequence)];
+        size_t candidate = slot;
+        slot = static_cast<uint32_t>(pos + 1);
+
+        if (candidate != 0 && pos - (candidate - 1) <= MAX_OFFSET && read32(window + candidate - 1) == sequence) {
+            candidate--;
+            size_t length = MIN_MATCH;
+            while (pos + length < end && window[candidate + length] == window[pos + length]) {
+                length++;
+            }
+            writeSequence(payload, window + anchor, pos - anchor, pos - candidate, length);
+            pos += length;
+            anchor = pos;
+            continue;
+        }
+
+        // Skip ahead faster the longer nothing matched, so incompressible data stays cheap
+        pos += 1 + ((pos - anchor) >> 6);
+    }
+    writeSequence(payload, window + anchor, end - anchor, 0, 0);
+
+    bool stored = payload.size() >= size;
+    writeU32(out, static_cast<uint32_t>(stored ? size : payload.size()));
+    writeU32(out, static_cast<uint32_t>(size));
+    if (stored) {
+        out.append(reinterpret_cast<const char*>(data), size);
+    }
+    else {
+        out += payload;
+    }
+
+    // Keep only what later blocks can still reach
+    if (m_Window.size() > 2 * WINDOW_SIZE) {
+        size_t shift = m_Window.size() - WINDOW_SIZE;
+        m_Window.erase(m_Window.begin(), m_Window.begin() + shift);
+        for (auto& entry : m_Table) {
+            entry = entry > shift ? static_cast<uint32_t>(entry - shift) : 0;
+        }
+    }
+}
+
+bool StreamDecompressor::feed(const char* data, size_t size, std::string& out)
+{
+    m_Pending.append(data, size);
+
+    size_t offset = 0;
+    while (m_Pending.size() - offset >= HEADER_SIZE) {
+        size_t payloadSize = readU32(m_Pending.data() + offset);
+        size_t rawSize = readU32(m_Pending.data() + offset + 4);
+        if (rawSize > MAX_BLOCK_SIZE || payloadSize > rawSize) {
+            return false;
+        }
+        if (m_Pending.size() - offset - HEADER_SIZE < payloadSize) {
+            break;
+        }
+
+        const uint8_t* payload = reinterpret_cast<const uint8_t*>(m_Pending.data() + offset + HEADER_SIZE);
+        if (!decodeBlock(payload, payloadSize, rawSize, out)) {
+            return false;
+        }
+        offset += HEADER_SIZE + payloadSize;
+    }
+
+    if (offset > 0) {
+        m_Pending.erase(0, offset);
+    }
+    return true;
+}
+
+bool StreamDecompressor::decodeBlock(const uint8_t* payload, size_t payloadSize, size_t rawSize, std::string& out)
+{
+    size_t start = m_Window.size();
+
+    if (payloadSize == rawSize) {
+        m_Window.insert(m_Window.end(), payload, payload + payloadSize);
+    }
+    else {
+        size_t i = 0;
+        while (i < payloadSize) {
+            uint8_t token = payload[i++];
+
+            size_t literalLength = token >> 4;
+            if (literalLength == 15 && !readLength(payload, payloadSize, i, literalLength)) {
+                return false;
+            }
+            if (literalLength > payloadSize - i || m_Window.size() - start + literalLength > rawSize) {
+                return false;
+            }
+            m_Window.insert(m_Window.end(), payload + i, payload + i + literalLength);
+            i += literalLength;
+
+            if (i == payloadSize) {
+                break; // Literals-only sequence at the end of the block
+            }
+            if (payloadSize - i < 2) {
+                return false;
+            }
+            size_t offset = payload[i] | (size_t(payload[i + 1]) << 8);
+            i += 2;
+
+            size_t matchLength = token & 15;
+            if (matchLength == 15 && !readLength(payload, payloadSize, i, matchLength)) {
+                return false;
+            }
+            matchLength += MIN_MATCH;
+            if (offset == 0 || offset > m_Window.size() || m_Window.size() - start + matchLength > rawSize) {
+                return false;
+            }
+
+            // Overlapping matches repeat the bytes just written, so copy forwards
+            size_t from = m_Window.size() - offset;
+            size_t to = m_Window.size();
+            m_Window.resize(to + matchLength);
+            if (offset >= matchLength) {
+                std::memcpy(m_Window.data() + to, m_Window.data() + from, matchLength);
+            }
+            else {
+                for (size_t k = 0; k < matchLength; k++) {
+                    m_Window[to + k] = m_Window[from + k];
+                }
+            }
+        }
+        if (m_Window.size() - start != rawSize) {
+            return false;
+        }
+    }
+
+    out.append(reinterpret_cast<const char*>(m_Window.data() + start), rawSize);
+
+    if (m_Window.size() > 2 * WINDOW_SIZE) {
+        m_Window.erase(m_Window.begin(), m_Window.end() - WINDOW_SIZE);
+    }
+    return true;
+}
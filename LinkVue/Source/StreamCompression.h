@@ -0,0 +1,38 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// LZ4-style compression of a byte stream cut into blocks.
+// Both ends keep the last 64 KiB of the stream, so a block can refer back into
+// the ones before it: the field names and stroke headers every op repeats
+// compress across messages, not only within one. Blocks must be decompressed in
+// the order they were compressed.
+//
+// Block: [u32 payload size][u32 raw size][payload], sizes big-endian. A payload
+// as long as the raw data is the raw data stored as-is.
+class StreamCompressor {
+public:
+    StreamCompressor();
+
+    // Appends the block holding data to out
+    void compress(const uint8_t* data, size_t size, std::string& out);
+
+private:
+    std::vector<uint8_t> m_Window;  // Recent stream bytes, then the block being compressed
+    std::vector<uint32_t> m_Table;  // Hash of 4 bytes -> last window position + 1
+};
+
+class StreamDecompressor {
+public:
+    // Consumes received bytes and appends the contents of every block they
+    // complete to out. Returns false once the stream turns out to be corrupt.
+    bool feed(const char* data, size_t size, std::string& out);
+
+private:
+    bool decodeBlock(const uint8_t* payload, size_t payloadSize, size_t rawSize, std::string& out);
+
+    std::string m_Pending;          // Bytes of a block that has not fully arrived
+    std::vector<uint8_t> m_Window;  // Recent stream bytes, matches copy from here
+};
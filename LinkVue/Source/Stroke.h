@@ -0,0 +1,271 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+
+#include "Geometry.h"
+
+// Position in canvas units. Doubles keep it exact far beyond where floats jitter.
+struct CanvasPoint {
+    double x = 0.0;
+    double y = 0.0;
+};
+
+// Stored stroke point: offset from the stroke's tile origin, in quantization steps
+struct Point {
+    int16_t x = 0;
+    int16_t y = 0;
+};
+
+// Axis-aligned box in canvas space. Default constructed boxes are empty.
+struct Rect {
+    double minX = 0.0;
+    double minY = 0.0;
+    double maxX = -1.0;
+    double maxY = -1.0;
+
+    bool isEmpty() const { return maxX < minX || maxY < minY; }
+
+    bool intersects(const Rect& other) const {
+        return !isEmpty() && !other.isEmpty() &&
+            minX <= other.maxX && other.minX <= maxX &&
+            minY <= other.maxY && other.minY <= maxY;
+    }
+
+    bool contains(const Rect& other) const {
+        return !isEmpty() && !other.isEmpty() &&
+            minX <= other.minX && other.maxX <= maxX &&
+            minY <= other.minY && other.maxY <= maxY;
+    }
+
+    // Grows the box to cover a circle around (x, y)
+    void include(double x, double y, double radius = 0.0) {
+        if (isEmpty()) {
+            minX = x - radius; minY = y - radius;
+            maxX = x + radius; maxY = y + radius;
+            return;
+        }
+        minX = std::min(minX, x - radius); minY = std::min(minY, y - radius);
+        maxX = std::max(maxX, x + radius); maxY = std::max(maxY, y + radius);
+    }
+
+    void include(const Rect& other) {
+        if (other.isEmpty()) return;
+        include(other.minX, other.minY);
+        include(other.maxX, other.maxY);
+    }
+
+    Rect expanded(double amount) const {
+        if (isEmpty()) return *this;
+        return { minX - amount, minY - amount, maxX + amount, maxY + amount };
+    }
+
+    double width() const { return isEmpty() ? 0.0 : maxX - minX; }
+    double height() const { return isEmpty() ? 0.0 : maxY - minY; }
+};
+
+// Uniform scale and move applied on top of a stroke's stored points, so strokes
+// can be moved or resized without rewriting them: p -> p * scale + offset
+struct StrokeTransform {
+    double scale = 1.0;
+    double offsetX = 0.0;
+    double offsetY = 0.0;
+
+    bool isIdentity() const { return scale == 1.0 && offsetX == 0.0 && offsetY == 0.0; }
+    bool operator==(const StrokeTransform& other) const {
+        return scale == other.scale && offsetX == other.offsetX && offsetY == other.offsetY;
+    }
+
+    CanvasPoint apply(const CanvasPoint& point) const {
+        return { point.x * scale + offsetX, point.y * scale + offsetY };
+    }
+
+    Rect apply(const Rect& rect) const {
+        if (rect.isEmpty()) return rect;
+        return { rect.minX * scale + offsetX, rect.minY * scale + offsetY, rect.maxX * scale + offsetX, rect.maxY * scale + offsetY };
+    }
+
+    // This transform followed by next
+    StrokeTransform then(const StrokeTransform& next) const {
+        return { scale * next.scale, offsetX * next.scale + next.offsetX, offsetY * next.scale + next.offsetY };
+    }
+
+    StrokeTransform inverse() const {
+        return { 1.0 / scale, -offsetX / scale, -offsetY / scale };
+    }
+
+    // Scales by factor around pivot, then moves by (dx, dy)
+    static StrokeTransform around(const CanvasPoint& pivot, double factor, double dx, double dy) {
+        return { factor, pivot.x * (1.0 - factor) + dx, pivot.y * (1.0 - factor) + dy };
+    }
+};
+
+// Points of a stroke, shared between copies until one of them is written to.
+// Copying a stroke, e.g. to give it a new transform, then costs no point copies.
+class PointList {
+public:
+    size_t size() const { return m_Points ? m_Points->size() : 0; }
+    bool empty() const { return size() == 0; }
+    size_t capacity() const { return m_Points ? m_Points->capacity() : 0; }
+
+    const Point* data() const { return m_Points ? m_Points->data() : nullptr; }
+    const Point* begin() const { return data(); }
+    const Point* end() const { return data() + size(); }
+    const Point& operator[](size_t index) const { return (*m_Points)[index]; }
+    const Point& back() const { return m_Points->back(); }
+
+    Point* data() { return m_Points ? write().data() : nullptr; }
+    Point* begin() { return data(); }
+    Point* end() { return data() + size(); }
+
+    void push_back(const Point& point) { write().push_back(point); }
+    void resize(size_t count) { write().resize(count); }
+    void reserve(size_t count) { write().reserve(count); }
+    void clear() { m_Points.reset(); }
+
+private:
+    std::vector<Point>& write() {
+        if (!m_Points) {
+            m_Points = std::make_shared<std::vector<Point>>();
+        }
+        else if (m_Points.use_count() > 1) {
+            m_Points = std::make_shared<std::vector<Point>>(*m_Points);
+        }
+        return *m_Points;
+    }
+
+    std::shared_ptr<std::vector<Point>> m_Points;
+};
+
+// Freehand strokes are sampled point streams. Shapes keep exactly two points,
+// where the drag started and ended, and are drawn from those at any zoom.
+enum class StrokeKind : uint8_t {
+    Freehand,
+    Line,
+    Arrow,
+    Rectangle,
+    Ellipse
+};
+
+// Points are 16-bit fixed-point offsets from the origin of the tile the stroke
+// starts in. The step is a power of two picked from the zoom the stroke was drawn
+// at, so precision stays the same anywhere on the board and at any zoom.
+struct Stroke {
+    static constexpr int TILE_STEPS = 1 << 14; // Tile edge in quantization steps
+    static constexpr int MIN_SCALE = -32;
+    static constexpr int MAX_SCALE = 32;
+
+    uint64_t id = 0;
+    StrokeKind kind = StrokeKind::Freehand;
+    int64_t tileX = 0;
+    int64_t tileY = 0;
+    int8_t scale = 0;          // log2 of the quantization step in canvas units
+    std::array<float, 3> color = { 0.0f, 0.0f, 0.0f };
+    float thickness = 1.0f;    // In canvas units
+    PointList points;
+    StrokeTransform transform; // Identity until the stroke is moved or resized
+    Rect bounds; // Covers every point including its thickness, after the transform
+    uint64_t order = 0; // Stacking position on this board, assigned when added; never sent
+
+    // A quarter of a screen pixel at zoom
+    static int8_t scaleForZoom(double zoom) {
+        int scale = static_cast<int>(std::floor(std::log2(0.25 / zoom)));
+        return static_cast<int8_t>(std::clamp(scale, MIN_SCALE, MAX_SCALE));
+    }
+
+    // Size of one quantization step in canvas units, after the transform
+    double step() const { return std::ldexp(transform.scale, scale); }
+
+    // Thickness in canvas units, after the transform
+    double width() const { return thickness * transform.scale; }
+
+    bool isShape() const { return kind != StrokeKind::Freehand; }
+
+    // Length of an arrow's head in canvas units, for a shaft of the given length
+    double arrowHeadLength(double shaftLength) const {
+        return std::min(shaftLength * 0.5, std::max(width() * 4.0, shaftLength * 0.15));
+    }
+
+    // Where the tile the points are offsets from starts, before the transform
+    CanvasPoint tileOrigin() const {
+        double tileSize = std::ldexp(static_cast<double>(TILE_STEPS), scale);
+        return { tileX * tileSize, tileY * tileSize };
+    }
+
+    CanvasPoint origin() const { return transform.apply(tileOrigin()); }
+
+    CanvasPoint position(const Point& point) const {
+        CanvasPoint base = origin();
+        double size = step();
+        return { base.x + point.x * size, base.y + point.y * size };
+    }
+
+    // The first point picks the tile. Returns false for a point too far from it
+    // to encode; the caller continues the line in a new stroke. Points are taken
+    // before the transform, which strokes being drawn do not have yet.
+    bool addPoint(const CanvasPoint& at) {
+        double size = std::ldexp(1.0, scale);
+        if (points.empty()) {
+            double tileSize = size * TILE_STEPS;
+            tileX = static_cast<int64_t>(std::floor(at.x / tileSize));
+            tileY = static_cast<int64_t>(std::floor(at.y / tileSize));
+        }
+        CanvasPoint base = tileOrigin();
+        double x = std::round((at.x - base.x) / size);
+        double y = std::round((at.y - base.y) / size);
+        if (x < INT16_MIN || x > INT16_MAX || y < INT16_MIN || y > INT16_MAX) {
+            return false;
+        }
+
+        points.push_back({ static_cast<int16_t>(x), static_cast<int16_t>(y) });
+        if (isShape()) {
+            updateBounds();
+            return true;
+        }
+        CanvasPoint stored = position(points.back());
+        bounds.include(stored.x, stored.y, width() * 0.5);
+        return true;
+    }
+
+    // A uniform scale maps the box exactly, so the points need not be looked at
+    void setTransform(const StrokeTransform& next) {
+        bounds = next.apply(transform.inverse().apply(bounds));
+        transform = next;
+    }
+
+    void updateBounds() {
+        bounds = Rect();
+        double radius = width() * 0.5;
+        if (kind == StrokeKind::Arrow && points.size() == 2) {
+            CanvasPoint a = position(points[0]);
+            CanvasPoint b = position(points[1]);
+            radius += arrowHeadLength(std::hypot(b.x - a.x, b.y - a.y));
+        }
+        // Positions are monotonic in the stored offsets, so the box of the
+        // offsets' extremes is the box of every point
+        const PointList& stored = points;
+        if (stored.empty()) {
+            return;
+        }
+        Point min;
+        Point max;
+        pointBounds(stored.data(), stored.size(), min, max);
+        CanvasPoint low = position(min);
+        CanvasPoint high = position(max);
+        bounds.include(low.x, low.y, radius);
+        bounds.include(high.x, high.y, radius);
+    }
+};
+
+// Picture placed on the board. The pixels live in the blob store under blobHash
+// and travel separately from the op that places them.
+struct BoardImage {
+    uint64_t id = 0;        // Shares the id space with strokes
+    std::string blobHash;
+    uint64_t blobSize = 0;
+    Rect bounds;            // Where the image sits in canvas space
+};
@@ -0,0 +1,372 @@
+#include "StrokeRenderer.h"
+#include "Stroke.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cstddef>
+#include <cmath>
+
+namespace {
+    const char* s_VertexShader = R"(
+#version 330 core
+layout(location = 0) in vec4 a_Segment;  // x0, y0, x1, y1 in canvas units from the anchor
+layout(location = 1) in vec4 a_Style;    // r, g, b, thickness
+
+uniform vec2 u_Origin;
+uniform float u_Zoom;
+uniform vec2 u_DisplayPos;
+uniform vec2 u_DisplaySize;
+
+out vec3 v_Color;
+
+void main()
+{
+    vec2 p0 = u_Origin + a_Segment.xy * u_Zoom;
+    vec2 p1 = u_Origin + a_Segment.zw * u_Zoom;
+    vec2 dir = p1 - p0;
+    float len = length(dir);
+    dir = len > 0.0001 ? dir / len : vec2(1.0, 0.0);
+    vec2 normal = vec2(-dir.y, dir.x);
+
+    // Triangle strip corners: 0 = (p0, -n), 1 = (p0, +n), 2 = (p1, -n), 3 = (p1, +n)
+    float halfWidth = max(a_Style.w * u_Zoom, 1.0) * 0.5;
+    float side = (gl_VertexID & 1) == 0 ? -1.0 : 1.0;
+    vec2 pos = ((gl_VertexID & 2) == 0 ? p0 : p1) + normal * side * halfWidth;
+
+    vec2 ndc = (pos - u_DisplayPos) / u_DisplaySize * 2.0 - 1.0;
+    gl_Position = vec4(ndc.x, -ndc.y, 0.0, 1.0);
+    v_Color = a_Style.rgb;
+}
+)";
+
+    const char* s_FragmentShader = R"(
+#version 330 core
+in vec3 v_Color;
+out vec4 o_Color;
+
+void main()
+{
+    o_Color = vec4(v_Color, 1.0);
+}
+)";
+
+    GLuint compileShader(GLenum type, const char* source)
+    {
+        GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 1, &source, nullptr);
+        glCompileShader(shader);
+
+        GLint status = GL_FALSE;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+        if (status != GL_TRUE) {
+            char log[512];
+            glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+            std::cerr << "Stroke shader compilation failed: " << log << std::endl;
+            glDeleteShader(shader);
+            return 0;
+        }
+        return shader;
+    }
+}
+
+StrokeRenderer::~StrokeRenderer()
+{
+    // GL objects must be released with the context current, see shutdown()
+    if (m_Program != 0) {
+        std::cerr << "StrokeRenderer destroyed without shutdown()" << std::endl;
+    }
+}
+
+bool StrokeRenderer::init()
+{
+    GLuint vertexShader = compileShader(GL_VERTEX_SHADER, s_VertexShader);
+    GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, s_FragmentShader);
+    if (vertexShader == 0 || fragmentShader == 0) {
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+        return false;
+    }
+
+    m_Program = glCreateProgram();
+    glAttachShader(m_Program, vertexShader);
+    glAttachShader(m_Program, fragmentShader);
+    glLinkProgram(m_Program);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    GLint status = GL_FALSE;
+    glGetProgramiv(m_Program, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        char log[512];
+        glGetProgramInfoLog(m_Program, sizeof(log), nullptr, log);
+        std::cerr << "Stroke shader link failed: " << log << std::endl;
+        glDeleteProgram(m_Program);
+        m_Program = 0;
+        return false;
+    }
+
+    m_OriginLocation = glGetUniformLocation(m_Program, "u_Origin");
+    m_ZoomLocation = glGetUniformLocation(m_Program, "u_Zoom");
+    m_DisplayPosLocation = glGetUniformLocation(m_Program, "u_DisplayPos");
+    m_DisplaySizeLocation = glGetUniformLocation(m_Program, "u_DisplaySize");
+
+    m_UploadedStrokes = 0;
+    m_UploadedPointsInLast = 0;
+    m_ActivePoints = 0;
+    createBuffer(m_Committed);
+    createBuffer(m_Active);
+    return true;
+}
+
+void StrokeRenderer::shutdown()
+{
+    destroyBuffer(m_Committed);
+    destroyBuffer(m_Active);
+    if (m_Program != 0) {
+        glDeleteProgram(m_Program);
+        m_Program = 0;
+    }
+}
+
+void StrokeRenderer::createBuffer(SegmentBuffer& target)
+{
+    glGenVertexArrays(1, &target.vertexArray);
+    target.capacity = 0;
+    target.count = 0;
+    reserve(target, 4096);
+}
+
+void StrokeRenderer::destroyBuffer(SegmentBuffer& target)
+{
+    if (target.buffer != 0) {
+        glDeleteBuffers(1, &target.buffer);
+        target.buffer = 0;
+    }
+    if (target.vertexArray != 0) {
+        glDeleteVertexArrays(1, &target.vertexArray);
+        target.vertexArray = 0;
+    }
+    target.capacity = 0;
+    target.count = 0;
+}
+
+void StrokeRenderer::reserve(SegmentBuffer& target, size_t segmentCount)
+{
+    if (segmentCount <= target.capacity) {
+        return;
+    }
+
+    size_t newCapacity = std::max<size_t>(target.capacity, 4096);
+    while (newCapacity < segmentCount) {
+        newCapacity *= 2;
+    }
+
+    GLuint newBuffer = 0;
+    glGenBuffers(1, &newBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, newCapacity * sizeof(SegmentInstance), nullptr, GL_DYNAMIC_DRAW);
+
+    // Keep what is already on the GPU instead of uploading it again
+    if (target.buffer != 0) {
+        if (target.count > 0) {
+            glBindBuffer(GL_COPY_READ_BUFFER, target.buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                target.count * sizeof(SegmentInstance));
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &target.buffer);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    target.buffer = newBuffer;
+    target.capacity = newCapacity;
+
+    // Re-point the instance attributes at the new buffer
+    GLint previousVertexArray = 0;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVertexArray);
+    GLint previousArrayBuffer = 0;
+    glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &previousArrayBuffer);
+
+    glBindVertexArray(target.vertexArray);
+    glBindBuffer(GL_ARRAY_BUFFER, target.buffer);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(SegmentInstance),
+        reinterpret_cast<void*>(offsetof(SegmentInstance, x0)));
+    glVertexAttribDivisor(0, 1);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(SegmentInstance),
+        reinterpret_cast<void*>(offsetof(SegmentInstance, r)));
+    glVertexAttribDivisor(1, 1);
+
+    glBindVertexArray(static_cast<GLuint>(previousVertexArray));
+    glBindBuffer(GL_ARRAY_BUFFER, static_cast<GLuint>(previousArrayBuffer));
+}
+
+void StrokeRenderer::upload(SegmentBuffer& target)
+{
+    if (m_Staging.empty()) {
+        return;
+    }
+
+    reserve(target, target.count + m_Staging.size());
+
+    GLint previousArrayBuffer = 0;
+    glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &previousArrayBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, target.buffer);
+    glBufferSubData(GL_ARRAY_BUFFER,
+        target.count * sizeof(SegmentInstance),
+        m_Staging.size() * sizeof(SegmentInstance),
+        m_Staging.data());
+    glBindBuffer(GL_ARRAY_BUFFER, static_cast<GLuint>(previousArrayBuffer));
+
+    target.count += m_Staging.size();
+}
+
+void StrokeRenderer::stageSegments(const Stroke& stroke, size_t uploadedPoints)
+{
+    // Offsets are small, so only the tile origin needs doubles
+    CanvasPoint origin = stroke.origin();
+    float baseX = static_cast<float>(origin.x - m_Anchor.x);
+    float baseY = static_cast<float>(origin.y - m_Anchor.y);
+    float step = static_cast<float>(stroke.step());
+
+    if (stroke.isShape()) {
+        m_Outline.clear();
+        appendShapeOutline(stroke, stroke.step() * m_DetailZoom, m_Outline);
+        for (size_t i = 1; i < m_Outline.size(); i++) {
+            const auto& p1 = m_Outline[i - 1];
+            const auto& p2 = m_Outline[i];
+            m_Staging.push_back({
+                baseX + p1.x * step, baseY + p1.y * step, baseX + p2.x * step, baseY + p2.y * step,
+                stroke.color[0], stroke.color[1], stroke.color[2],
+                static_cast<float>(stroke.width())
+            });
+        }
+        return;
+    }
+
+    const auto& points = stroke.points;
+    for (size_t i = std::max<size_t>(uploadedPoints, 1); i < points.size(); i++) {
+        const auto& p1 = points[i - 1];
+        const auto& p2 = points[i];
+        m_Staging.push_back({
+            baseX + p1.x * step, baseY + p1.y * step, baseX + p2.x * step, baseY + p2.y * step,
+            stroke.color[0], stroke.color[1], stroke.color[2],
+            static_cast<float>(stroke.width())
+        });
+    }
+}
+
+void StrokeRenderer::sync(const std::vector<StrokePtr>& strokes, uint64_t revision, const CanvasPoint& anchor, float zoom)
+{
+    if (!isInitialized()) {
+        return;
+    }
+
+    float detailZoom = std::exp2(std::round(std::log2(zoom)));
+    bool detailChanged = m_HasShapes && detailZoom != m_DetailZoom;
+    m_DetailZoom = detailZoom;
+
+    if (anchor.x != m_Anchor.x || anchor.y != m_Anchor.y || detailChanged) {
+        m_Anchor = anchor;
+        m_UploadedRevision = revision + 1; // Forces the re-upload below
+        m_Active.count = 0;
+        m_ActivePoints = 0;
+    }
+
+    if (revision != m_UploadedRevision || strokes.size() < m_UploadedStrokes) {
+        m_UploadedRevision = revision;
+        m_HasShapes = false;
+        m_Committed.count = 0;
+        m_UploadedStrokes = 0;
+        m_UploadedPointsInLast = 0;
+    }
+
+    // Only the last uploaded stroke can have grown; everything after it is new
+    m_Staging.clear();
+    size_t first = m_UploadedStrokes > 0 ? m_UploadedStrokes - 1 : 0;
+    for (size_t s = first; s < strokes.size(); s++) {
+        size_t uploaded = (m_UploadedStrokes > 0 && s == m_UploadedStrokes - 1) ? m_UploadedPointsInLast : 0;
+        stageSegments(*strokes[s], uploaded);
+        m_HasShapes = m_HasShapes || strokes[s]->isShape();
+    }
+    m_UploadedStrokes = strokes.size();
+    m_UploadedPointsInLast = strokes.empty() ? 0 : strokes.back()->points.size();
+
+    upload(m_Committed);
+}
+
+void StrokeRenderer::syncActive(const Stroke& active)
+{
+    if (!isInitialized()) {
+        return;
+    }
+
+    // A shape being dragged moves its end point in place, so it is always uploaded whole
+    if (active.id != m_ActiveStrokeId || active.points.size() < m_ActivePoints || active.isShape()) {
+        m_ActiveStrokeId = active.id;
+        m_Active.count = 0;
+        m_ActivePoints = 0;
+    }
+
+    m_Staging.clear();
+    stageSegments(active, m_ActivePoints);
+    m_ActivePoints = active.points.size();
+
+    upload(m_Active);
+}
+
+void StrokeRenderer::draw(ImDrawList* drawList, const ImVec2& origin, float zoom)
+{
+    if (!isInitialized() || getSegmentCount() == 0) {
+        return;
+    }
+
+    m_Origin = origin;
+    m_Zoom = zoom;
+    drawList->AddCallback(&StrokeRenderer::renderCallback, this);
+    drawList->AddCallback(ImDrawCallback_ResetRenderState, nullptr);
+}
+
+void StrokeRenderer::renderCallback(const ImDrawList* /*parentList*/, const ImDrawCmd* cmd)
+{
+    static_cast<StrokeRenderer*>(cmd->UserCallbackData)->render(cmd);
+}
+
+void StrokeRenderer::render(const ImDrawCmd* cmd)
+{
+    ImDrawData* drawData = ImGui::GetDrawData();
+    if (!drawData) {
+        return;
+    }
+
+    // Clip to the Canvas window the same way the ImGui backend clips its own commands
+    ImVec2 clipOffset = drawData->DisplayPos;
+    ImVec2 clipScale = drawData->FramebufferScale;
+    int framebufferHeight = static_cast<int>(drawData->DisplaySize.y * clipScale.y);
+    ImVec4 clip(
+        (cmd->ClipRect.x - clipOffset.x) * clipScale.x,
+        (cmd->ClipRect.y - clipOffset.y) * clipScale.y,
+        (cmd->ClipRect.z - clipOffset.x) * clipScale.x,
+        (cmd->ClipRect.w - clipOffset.y) * clipScale.y);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(
+        static_cast<int>(clip.x),
+        static_cast<int>(framebufferHeight - clip.w),
+        static_cast<int>(clip.z - clip.x),
+        static_cast<int>(clip.w - clip.y));
+
+    glUseProgram(m_Program);
+    glUniform2f(m_OriginLocation, m_Origin.x, m_Origin.y);
+    glUniform1f(m_ZoomLocation, m_Zoom);
+    glUniform2f(m_DisplayPosLocation, drawData->DisplayPos.x, drawData->DisplayPos.y);
+    glUniform2f(m_DisplaySizeLocation, drawData->DisplaySize.x, drawData->DisplaySize.y);
+
+    for (const SegmentBuffer* segments : { &m_Committed, &m_Active }) {
+        if (segments->count > 0) {
+            glBindVertexArray(segments->vertexArray);
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(segments->count));
+        }
+    }
+    glBindVertexArray(0);
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <glad/glad.h>
+#include <ImGui.h>
+
+#include <vector>
+#include <cstdint>
+
+#include "BoardDocument.h"
+#include "Shapes.h"
+
+// Retained-mode OpenGL 3.3 renderer for strokes.
+// Committed points are uploaded once into a growable VBO as one instance per
+// segment; the vertex shader expands every segment into a quad using the
+// pan/zoom uniforms, so panning and zooming never touch the buffer. Positions
+// are floats relative to an anchor point, which keeps them precise as long as
+// the anchor stays near the part of the board being looked at.
+class StrokeRenderer {
+public:
+    StrokeRenderer() = default;
+    ~StrokeRenderer();
+
+    StrokeRenderer(const StrokeRenderer&) = delete;
+    StrokeRenderer& operator=(const StrokeRenderer&) = delete;
+
+    // Requires a current GL 3.3 core context
+    bool init();
+    void shutdown();
+    bool isInitialized() const { return m_Program != 0; }
+
+    // Uploads whatever is new since the last sync. Appending strokes or points to
+    // the last stroke is incremental; a different revision or anchor means
+    // everything is uploaded again. Shapes are outlined for zoom, and uploaded
+    // again once zoom moves a power of two away from that.
+    void sync(const std::vector<StrokePtr>& strokes, uint64_t revision, const CanvasPoint& anchor, float zoom);
+
+    // Same for the stroke being drawn, which lives in its own small buffer so
+    // committed strokes arriving meanwhile do not disturb it. Call after sync().
+    void syncActive(const Stroke& active);
+
+    // Queues the uploaded strokes into the draw list through a callback.
+    // origin is the screen position of the anchor.
+    void draw(ImDrawList* drawList, const ImVec2& origin, float zoom);
+
+    size_t getSegmentCount() const { return m_Committed.count + m_Active.count; }
+
+private:
+    struct SegmentInstance {
+        float x0, y0, x1, y1;
+        float r, g, b;
+        float thickness;
+    };
+
+    struct SegmentBuffer {
+        GLuint vertexArray = 0;
+        GLuint buffer = 0;
+        size_t capacity = 0;  // Segments the VBO can hold
+        size_t count = 0;     // Segments uploaded so far
+    };
+
+    static void renderCallback(const ImDrawList* parentList, const ImDrawCmd* cmd);
+    void render(const ImDrawCmd* cmd);
+    void createBuffer(SegmentBuffer& target);
+    void destroyBuffer(SegmentBuffer& target);
+    void reserve(SegmentBuffer& target, size_t segmentCount);
+    void upload(SegmentBuffer& target);
+    void stageSegments(const Stroke& stroke, size_t uploadedPoints);
+
+    GLuint m_Program = 0;
+    GLint m_OriginLocation = -1;
+    GLint m_ZoomLocation = -1;
+    GLint m_DisplayPosLocation = -1;
+    GLint m_DisplaySizeLocation = -1;
+
+    SegmentBuffer m_Committed;
+    SegmentBuffer m_Active;
+
+    // What has been uploaded for the current revision
+    uint64_t m_UploadedRevision = 0;
+    CanvasPoint m_Anchor;
+    float m_DetailZoom = 1.0f;  // Zoom the uploaded shape outlines were made for
+    bool m_HasShapes = false;   // Whether any are uploaded, i.e. zooming can require a re-upload
+    std::vector<OutlinePoint> m_Outline;
+    size_t m_UploadedStrokes = 0;
+    size_t m_UploadedPointsInLast = 0;
+    uint64_t m_ActiveStrokeId = 0;
+    size_t m_ActivePoints = 0;
+    std::vector<SegmentInstance> m_Staging;
+
+    // Pan/zoom for the pending draw callback
+    ImVec2 m_Origin = ImVec2(0.0f, 0.0f);
+    float m_Zoom = 1.0f;
+};
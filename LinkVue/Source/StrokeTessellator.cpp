@@ -0,0 +1,178 @@
+#include "StrokeTessellator.h"
+#include "Stroke.h"
+#include "Shapes.h"
+#include "Geometry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+    // 4 vertices per segment; keeps every chunk addressable with 16-bit indices
+    const size_t MAX_CHUNK_SEGMENTS = 16000;
+    const size_t MIN_CHUNK_SEGMENTS = 1024;
+}
+
+void StrokeTessellator::tessellate(std::span<const StrokePtr> strokes, ImDrawList* drawList,
+    const CanvasPoint& camera, const ImVec2& cameraScreen, float zoom)
+{
+    ImVec2 clipMin = drawList->GetClipRectMin();
+    ImVec2 clipMax = drawList->GetClipRectMax();
+    ImVec4 clipRect(clipMin.x, clipMin.y, clipMax.x, clipMax.y);
+
+    // Shapes are outlined here for the current zoom; only those on screen
+    m_Outline.clear();
+    m_OutlineStart.resize(strokes.size());
+    m_SegmentOffsets.resize(strokes.size() + 1);
+    m_SegmentOffsets[0] = 0;
+    for (size_t i = 0; i < strokes.size(); i++) {
+        const Stroke& stroke = *strokes[i];
+        size_t points = stroke.points.size();
+        if (stroke.isShape()) {
+            m_OutlineStart[i] = m_Outline.size();
+            double minX = cameraScreen.x + (stroke.bounds.minX - camera.x) * zoom;
+            double minY = cameraScreen.y + (stroke.bounds.minY - camera.y) * zoom;
+            double maxX = cameraScreen.x + (stroke.bounds.maxX - camera.x) * zoom;
+            double maxY = cameraScreen.y + (stroke.bounds.maxY - camera.y) * zoom;
+            if (maxX >= clipRect.x && minX <= clipRect.z && maxY >= clipRect.y && minY <= clipRect.w) {
+                appendShapeOutline(stroke, stroke.step() * zoom, m_Outline);
+            }
+            points = m_Outline.size() - m_OutlineStart[i];
+        }
+        m_SegmentOffsets[i + 1] = m_SegmentOffsets[i] + (points > 1 ? points - 1 : 0);
+    }
+
+    size_t totalSegments = m_SegmentOffsets.back();
+    if (totalSegments == 0) {
+        return;
+    }
+
+    // A few chunks per thread so stealing can even out dense and sparse regions
+    size_t workers = m_Pool.getThreadCount() + 1;
+    size_t segmentsPerChunk = std::clamp(totalSegments / (workers * 4), MIN_CHUNK_SEGMENTS, MAX_CHUNK_SEGMENTS);
+    size_t chunkCount = (totalSegments + segmentsPerChunk - 1) / segmentsPerChunk;
+
+    m_Chunks.resize(chunkCount);
+    for (size_t i = 0; i < chunkCount; i++) {
+        m_Chunks[i].firstSegment = i * segmentsPerChunk;
+        m_Chunks[i].endSegment = std::min(totalSegments, (i + 1) * segmentsPerChunk);
+    }
+
+    ImVec2 whiteUv = ImGui::GetFontTexUvWhitePixel();
+
+    m_Pool.parallelFor(chunkCount, [&](size_t i) {
+        buildChunk(m_Chunks[i], strokes, camera, cameraScreen, zoom, clipRect, whiteUv);
+    });
+
+    // Merge in chunk order so strokes keep their painter's order
+    for (const auto& chunk : m_Chunks) {
+        if (chunk.vertices.empty()) {
+            continue;
+        }
+
+        int vertexCount = static_cast<int>(chunk.vertices.size());
+        int indexCount = static_cast<int>(chunk.indices.size());
+        drawList->PrimReserve(indexCount, vertexCount);
+
+        unsigned int base = drawList->_VtxCurrentIdx;
+        std::memcpy(drawList->_VtxWritePtr, chunk.vertices.data(), vertexCount * sizeof(ImDrawVert));
+        for (int i = 0; i < indexCount; i++) {
+            drawList->_IdxWritePtr[i] = static_cast<ImDrawIdx>(base + chunk.indices[i]);
+        }
+
+        drawList->_VtxWritePtr += vertexCount;
+        drawList->_IdxWritePtr += indexCount;
+        drawList->_VtxCurrentIdx += vertexCount;
+    }
+}
+
+void StrokeTessellator::buildChunk(Chunk& chunk, std::span<const StrokePtr> strokes, const CanvasPoint& camera,
+    const ImVec2& cameraScreen, float zoom, const ImVec4& clipRect, ImVec2 whiteUv)
+{
+    chunk.vertices.clear();
+    chunk.indices.clear();
+
+    // Stroke containing the chunk's first segment
+    size_t s = static_cast<size_t>(std::upper_bound(m_SegmentOffsets.begin(), m_SegmentOffsets.end(), chunk.firstSegment)
+        - m_SegmentOffsets.begin()) - 1;
+
+    // Screen position of the current stroke's tile origin and its step in pixels
+    size_t placedStroke = SIZE_MAX;
+    ImVec2 base;
+    float step = 0.0f;
+    float halfWidth = 0.0f;
+    ImU32 color = 0;
+    size_t firstPosition = 0; // Point index of chunk.positions[0]
+
+    for (size_t segment = chunk.firstSegment; segment < chunk.endSegment; segment++) {
+        while (m_SegmentOffsets[s + 1] <= segment) {
+            s++;
+        }
+
+        const Stroke& stroke = *strokes[s];
+        if (s != placedStroke) {
+            CanvasPoint origin = stroke.origin();
+            base = ImVec2(
+                static_cast<float>(cameraScreen.x + (origin.x - camera.x) * zoom),
+                static_cast<float>(cameraScreen.y + (origin.y - camera.y) * zoom));
+            step = static_cast<float>(stroke.step() * zoom);
+            halfWidth = std::max(static_cast<float>(stroke.width()) * zoom, 1.0f) * 0.5f;
+            color = ImColor(stroke.color[0], stroke.color[1], stroke.color[2]);
+            placedStroke = s;
+
+            // Place all of this stroke's points the chunk covers in one batch
+            if (!stroke.isShape()) {
+                firstPosition = segment - m_SegmentOffsets[s];
+                size_t endPosition = std::min(chunk.endSegment, m_SegmentOffsets[s + 1]) - m_SegmentOffsets[s] + 1;
+                chunk.positions.resize(2 * (endPosition - firstPosition));
+                transformPoints(stroke.points.data() + firstPosition, endPosition - firstPosition,
+                    base.x, base.y, step, chunk.positions.data());
+            }
+        }
+
+        size_t i = segment - m_SegmentOffsets[s] + 1;
+        ImVec2 a;
+        ImVec2 b;
+        if (stroke.isShape()) {
+            const OutlinePoint& p1 = m_Outline[m_OutlineStart[s] + i - 1];
+            const OutlinePoint& p2 = m_Outline[m_OutlineStart[s] + i];
+            a = ImVec2(base.x + p1.x * step, base.y + p1.y * step);
+            b = ImVec2(base.x + p2.x * step, base.y + p2.y * step);
+        }
+        else {
+            const float* p = chunk.positions.data() + 2 * (i - 1 - firstPosition);
+            a = ImVec2(p[0], p[1]);
+            b = ImVec2(p[2], p[3]);
+        }
+
+        if (std::max(a.x, b.x) + halfWidth < clipRect.x || std::min(a.x, b.x) - halfWidth > clipRect.z ||
+            std::max(a.y, b.y) + halfWidth < clipRect.y || std::min(a.y, b.y) - halfWidth > clipRect.w) {
+            continue;
+        }
+
+        float dx = b.x - a.x;
+        float dy = b.y - a.y;
+        float length = std::sqrt(dx * dx + dy * dy);
+        if (length > 0.0001f) {
+            dx /= length;
+            dy /= length;
+        }
+        else {
+            dx = 1.0f;
+            dy = 0.0f;
+        }
+        float nx = -dy * halfWidth;
+        float ny = dx * halfWidth;
+
+        ImDrawIdx first = static_cast<ImDrawIdx>(chunk.vertices.size());
+        chunk.vertices.push_back({ ImVec2(a.x - nx, a.y - ny), whiteUv, color });
+        chunk.vertices.push_back({ ImVec2(a.x + nx, a.y + ny), whiteUv, color });
+        chunk.vertices.push_back({ ImVec2(b.x + nx, b.y + ny), whiteUv, color });
+        chunk.vertices.push_back({ ImVec2(b.x - nx, b.y - ny), whiteUv, color });
+
+        const ImDrawIdx quad[6] = { 0, 1, 2, 0, 2, 3 };
+        for (ImDrawIdx index : quad) {
+            chunk.indices.push_back(static_cast<ImDrawIdx>(first + index));
+        }
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <ImGui.h>
+
+#include <vector>
+#include <span>
+
+#include "BoardDocument.h"
+#include "Shapes.h"
+#include "ThreadPool.h"
+
+// Builds screen-space quads for strokes on the thread pool.
+// Segments are split into ranges; each worker fills its own vertex/index chunk
+// and the chunks are appended to the draw list in stroke order afterwards.
+class StrokeTessellator {
+public:
+    explicit StrokeTessellator(ThreadPool& pool) : m_Pool(pool) {}
+
+    // camera is the canvas point drawn at screen position cameraScreen. Segments
+    // outside the draw list's current clip rect are skipped.
+    void tessellate(std::span<const StrokePtr> strokes, ImDrawList* drawList,
+        const CanvasPoint& camera, const ImVec2& cameraScreen, float zoom);
+
+private:
+    struct Chunk {
+        size_t firstSegment = 0;
+        size_t endSegment = 0;
+        std::vector<ImDrawVert> vertices;
+        std::vector<ImDrawIdx> indices;
+        std::vector<float> positions; // Screen x, y of the current freehand stroke's points in this chunk
+    };
+
+    void buildChunk(Chunk& chunk, std::span<const StrokePtr> strokes, const CanvasPoint& camera,
+        const ImVec2& cameraScreen, float zoom, const ImVec4& clipRect, ImVec2 whiteUv);
+
+    ThreadPool& m_Pool;
+    std::vector<Chunk> m_Chunks;           // Kept between frames to reuse their buffers
+    std::vector<size_t> m_SegmentOffsets;  // First global segment index of every stroke
+    std::vector<OutlinePoint> m_Outline;   // Outlines of the visible shapes, this frame
+    std::vector<size_t> m_OutlineStart;    // Where each shape's outline starts in m_Outline
+};
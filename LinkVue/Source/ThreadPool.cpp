@@ -0,0 +1,143 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace {
+    // Queue index of the current worker thread, or -1 on threads outside the pool
+    thread_local int s_WorkerIndex = -1;
+    thread_local const ThreadPool* s_WorkerPool = nullptr;
+}
+
+ThreadPool::ThreadPool(size_t threadCount)
+{
+    if (threadCount == 0) {
+        unsigned int hardwareThreads = std::thread::hardware_concurrency();
+        threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+
+    // One extra queue for tasks submitted from outside the pool
+    for (size_t i = 0; i <= threadCount; i++) {
+        m_Queues.push_back(std::make_unique<WorkQueue>());
+    }
+    for (size_t i = 0; i < threadCount; i++) {
+        m_Threads.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_WakeMutex);
+        m_Running = false;
+    }
+    m_WakeCondition.notify_all();
+
+    for (auto& thread : m_Threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    // Workers keep their own tasks local; outside callers spread tasks round-robin
+    size_t queueIndex;
+    if (s_WorkerPool == this && s_WorkerIndex >= 0) {
+        queueIndex = static_cast<size_t>(s_WorkerIndex);
+    }
+    else {
+        queueIndex = m_NextQueue.fetch_add(1, std::memory_order_relaxed) % m_Queues.size();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_Queues[queueIndex]->mutex);
+        m_Queues[queueIndex]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_WakeMutex);
+        m_Queued.fetch_add(1, std::memory_order_release);
+    }
+    m_WakeCondition.notify_one();
+}
+
+bool ThreadPool::tryRunTask(size_t homeQueue)
+{
+    std::function<void()> task;
+
+    {
+        WorkQueue& own = *m_Queues[homeQueue];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+        }
+    }
+
+    for (size_t i = 1; !task && i < m_Queues.size(); i++) {
+        WorkQueue& victim = *m_Queues[(homeQueue + i) % m_Queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+        }
+    }
+
+    if (!task) {
+        return false;
+    }
+
+    m_Queued.fetch_sub(1, std::memory_order_acq_rel);
+    task();
+    return true;
+}
+
+void ThreadPool::workerLoop(size_t index)
+{
+    s_WorkerIndex = static_cast<int>(index);
+    s_WorkerPool = this;
+
+    while (true) {
+        if (tryRunTask(index)) {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_WakeMutex);
+        m_WakeCondition.wait(lock, [this]() {
+            return !m_Running || m_Queued.load(std::memory_order_acquire) > 0;
+        });
+        if (!m_Running) {
+            break;
+        }
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& body)
+{
+    if (count == 0) {
+        return;
+    }
+    if (count == 1 || m_Threads.empty()) {
+        for (size_t i = 0; i < count; i++) {
+            body(i);
+        }
+        return;
+    }
+
+    std::atomic<size_t> remaining{ count };
+    for (size_t i = 0; i < count; i++) {
+        submit([&body, &remaining, i]() {
+            body(i);
+            remaining.fetch_sub(1, std::memory_order_acq_rel);
+        });
+    }
+
+    // Help out until our tasks are done; whatever is still running elsewhere is short
+    size_t homeQueue = (s_WorkerPool == this && s_WorkerIndex >= 0)
+        ? static_cast<size_t>(s_WorkerIndex)
+        : m_Queues.size() - 1;
+    while (remaining.load(std::memory_order_acquire) > 0) {
+        if (!tryRunTask(homeQueue)) {
+            std::this_thread::yield();
+        }
+    }
+}
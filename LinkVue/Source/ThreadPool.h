@@ -0,0 +1,49 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+
+// Work-stealing thread pool.
+// Every worker owns a queue; it pops its own work from the back and steals from
+// the front of the other queues when it runs dry.
+class ThreadPool {
+public:
+    // threadCount of 0 picks hardware_concurrency() - 1 workers, since the
+    // caller of parallelFor() works too
+    explicit ThreadPool(size_t threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(std::function<void()> task);
+
+    // Runs body(i) for every i in [0, count) and returns once all of them finished.
+    // The calling thread helps with the work instead of blocking.
+    void parallelFor(size_t count, const std::function<void(size_t)>& body);
+
+    size_t getThreadCount() const { return m_Threads.size(); }
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void workerLoop(size_t index);
+    bool tryRunTask(size_t homeQueue);
+
+    std::vector<std::unique_ptr<WorkQueue>> m_Queues;
+    std::vector<std::thread> m_Threads;
+
+    std::mutex m_WakeMutex;
+    std::condition_variable m_WakeCondition;
+    std::atomic<size_t> m_Queued{ 0 };
+    std::atomic<size_t> m_NextQueue{ 0 };
+    std::atomic<bool> m_Running{ true };
+};
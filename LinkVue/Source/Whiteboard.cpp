@@ -5,102 +5,991 @@
 //[Implmentation]
 
 #include "Whiteboard.h"
+#include "Clipboard.h"
+#include <random>
+#include <unordered_set>
 
 
-namespace YAML {
-    template<>
-    struct convert<Point> {
-        static Node encode(const Point& point) {
-            Node node;
-            node["x"] = point.x;
-            node["y"] = point.y;
-            node["color"] = point.color;
-            node["thickness"] = point.thickness;
-            return node;
+Whiteboard::Whiteboard()
+{
+    std::random_device device;
+    m_SiteId = (static_cast<uint64_t>(device()) & 0xFFFFFFFFull) << 32;
+}
+
+namespace {
+    // Memory an entry holds on to. Every stroke counts in full: removed ones are
+    // kept alive by the history alone, and added ones too once their region is
+    // paged out. A clear's strokes are in the page file and cost only the set.
+    size_t historyEntryBytes(const HistoryEntry& entry)
+    {
+        size_t bytes = sizeof(HistoryEntry) + entry.keptBytes;
+        bytes += (entry.added.capacity() + entry.removed.capacity()) * sizeof(StrokePtr);
+        bytes += (entry.addedImages.capacity() + entry.removedImages.capacity()) * sizeof(BoardImage);
+        bytes += entry.moved.capacity() * sizeof(uint64_t);
+        bytes += (entry.movedFrom.capacity() + entry.movedTo.capacity()) * sizeof(StrokeTransform);
+        for (const auto* strokes : { &entry.added, &entry.removed }) {
+            for (const auto& stroke : *strokes) {
+                bytes += sizeof(Stroke) + stroke->points.capacity() * sizeof(Point);
+            }
         }
+        return bytes;
+    }
+
+    size_t strokeBytes(const Stroke& stroke)
+    {
+        return sizeof(Stroke) + sizeof(StrokePtr) + stroke.points.capacity() * sizeof(Point);
+    }
 
-        static bool decode(const Node& node, Point& point) {
-            if (!node.IsMap() || !node["x"] || !node["y"] || !node["color"] || !node["thickness"])
-                return false;
+    // Half the size of a selection handle in pixels
+    constexpr float SELECTION_HANDLE_SIZE = 5.0f;
 
-            point.x = node["x"].as<float>();
-            point.y = node["y"].as<float>();
-            point.color = node["color"].as<std::array<float, 3>>();
-            point.thickness = node["thickness"].as<float>();
-            return true;
+    // A press that moves less than this many pixels is a click, and a stroke
+    // this close to the click in pixels counts as hit
+    constexpr double CLICK_SLOP = 3.0;
+
+    // Freehand points closer than this to the one before, in quantization steps
+    // (a step is at most a quarter pixel at the zoom drawn at, so this is at most
+    // half a pixel), add nothing visible and are dropped
+    constexpr int MIN_POINT_SPACING = 2;
+
+    // Regions read back per tick for strokes wanted while paged out, so a
+    // large request does not load the whole page file at once
+    constexpr size_t FETCH_REGIONS_PER_TICK = 4;
+
+    // Even-odd test against a closed outline
+    bool insidePolygon(const std::vector<CanvasPoint>& polygon, const CanvasPoint& point)
+    {
+        bool inside = false;
+        for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+            const CanvasPoint& a = polygon[i];
+            const CanvasPoint& b = polygon[j];
+            if ((a.y > point.y) != (b.y > point.y) &&
+                point.x < (b.x - a.x) * (point.y - a.y) / (b.y - a.y) + a.x) {
+                inside = !inside;
+            }
         }
-    };
+        return inside;
+    }
+}
+
+void Whiteboard::recordHistory(HistoryEntry entry)
+{
+    size_t bytes = m_HistoryBytes + historyEntryBytes(entry);
+    m_UndoStack.push_back(std::move(entry));
+    // Clear redo stack when new action is performed
+    for (const auto& undone : m_RedoStack) {
+        bytes -= historyEntryBytes(undone);
+        dropHistory(undone);
+    }
+    m_RedoStack.clear();
+    m_HistoryBytes = bytes;
+    trimHistory();
+}
+
+void Whiteboard::trimHistory()
+{
+    // History keeps removed strokes alive, so it gets a quarter of the budget.
+    // The newest entry always stays so the last action can be undone.
+    size_t limit = static_cast<size_t>(m_MemoryBudgetMB) * 1024 * 1024 / 4;
+    size_t bytes = m_HistoryBytes;
+    while (bytes > limit && m_UndoStack.size() > 1) {
+        bytes -= historyEntryBytes(m_UndoStack.front());
+        dropHistory(m_UndoStack.front());
+        m_UndoStack.pop_front();
+    }
+    m_HistoryBytes = bytes;
+    m_HistoryEntries = m_UndoStack.size() + m_RedoStack.size();
+}
+
+void Whiteboard::dropHistory(const HistoryEntry& entry)
+{
+    if (entry.keptPages != 0) {
+        m_Pager.drop(entry.keptPages);
+    }
+}
+
+void Whiteboard::addStrokes(const std::vector<Stroke>& strokes)
+{
+    // Appending keeps the renderers on their incremental path
+    for (const auto& stroke : strokes) {
+        auto added = std::make_shared<Stroke>(stroke);
+        added->order = m_NextOrder++;
+        m_ResidentBytes += strokeBytes(*added);
+        m_Digest.add(*added);
+        m_Strokes.push_back(std::move(added));
+    }
+    ++m_Version;
+}
+
+void Whiteboard::addStrokes(const std::vector<StrokePtr>& strokes)
+{
+    for (const auto& stroke : strokes) {
+        m_ResidentBytes += strokeBytes(*stroke);
+        m_Digest.add(*stroke);
+        if (stroke->order >= m_NextOrder) {
+            m_NextOrder = stroke->order + 1;
+            m_Strokes.push_back(stroke);
+            continue;
+        }
+        // Restored by undo: it goes on top, so it needs a new place in the order
+        auto restored = std::make_shared<Stroke>(*stroke);
+        restored->order = m_NextOrder++;
+        m_Strokes.push_back(std::move(restored));
+    }
+    ++m_Version;
+}
+
+void Whiteboard::removeStrokes(const std::vector<uint64_t>& ids, bool forgetPaged)
+{
+    std::unordered_set<uint64_t> doomed(ids.begin(), ids.end());
+    std::unordered_set<uint64_t> missing = doomed;
+    for (uint64_t id : ids) {
+        m_Digest.remove(id); // Paged out strokes included
+        if (isFetching(id)) {
+            m_Arrived.push_back(id); // Gone, or replaced by a copy added right after
+        }
+    }
+    auto removed = std::remove_if(m_Strokes.begin(), m_Strokes.end(), [&](const StrokePtr& stroke) {
+        if (doomed.count(stroke->id) == 0) {
+            return false;
+        }
+        missing.erase(stroke->id);
+        m_ResidentBytes -= strokeBytes(*stroke);
+        return true;
+    });
+    if (removed != m_Strokes.end()) {
+        m_Strokes.erase(removed, m_Strokes.end());
+        ++m_Revision;
+    }
+
+    // Images share the id space, so the same op removes them
+    m_Images.erase(std::remove_if(m_Images.begin(), m_Images.end(), [&](const BoardImage& image) {
+        missing.erase(image.id);
+        return doomed.count(image.id) != 0;
+    }), m_Images.end());
+    ++m_Version;
+
+    // What was not here may be paged out and must not come back
+    if (forgetPaged && !missing.empty() && !m_Pager.empty()) {
+        m_Pager.forget(std::vector<uint64_t>(missing.begin(), missing.end()));
+    }
+}
+
+void Whiteboard::clearStrokes()
+{
+    m_Strokes.clear();
+    m_ResidentBytes = 0;
+    m_Digest.clear();
+    m_Pager.clear();
+    m_RegionUse.clear();
+    m_PagedTransforms.clear();
+    m_Announce.clear();
+    m_FetchGone.insert(m_FetchGone.end(), m_Requested.begin(), m_Requested.end());
+    m_Requested.clear();
+    m_FetchRegions.clear();
+    m_Arrived.clear();
+    ++m_Revision;
+    ++m_Version;
+}
 
-    template<>
-    struct convert<Stroke> {
-        static Node encode(const Stroke& stroke) {
-            Node node;
-            for (const auto& point : stroke.points) {
-                node.push_back(point);
+void Whiteboard::transformStrokes(const std::vector<uint64_t>& ids, const std::vector<StrokeTransform>& transforms)
+{
+    const auto& index = strokeIndex();
+    bool changed = false;
+    for (size_t i = 0; i < ids.size() && i < transforms.size(); i++) {
+        m_Digest.setTransform(ids[i], transforms[i]); // Paged out strokes included
+        auto it = index.find(ids[i]);
+        if (it == index.end()) {
+            // Pages are keyed by where their strokes were, so a paged out one is
+            // moved once its region is back. Ids on neither are ignored.
+            if (fetch(ids[i])) {
+                m_PagedTransforms[ids[i]] = transforms[i];
             }
-            return node;
+            continue;
+        }
+        StrokePtr& slot = m_Strokes[it->second];
+        if (slot->transform == transforms[i]) {
+            continue;
         }
+        // The copy shares the points, so this costs the same for any stroke length
+        auto moved = std::make_shared<Stroke>(*slot);
+        moved->setTransform(transforms[i]);
+        slot = moved;
+        m_Moved.push_back(std::move(moved));
+        changed = true;
+    }
+    if (changed) {
+        // Same strokes in the same places, so the index stays good
+        ++m_Revision;
+        ++m_Version;
+        m_IndexRevision = m_Revision;
+    }
+}
 
-        static bool decode(const Node& node, Stroke& stroke) {
-            if (!node.IsSequence())
-                return false;
+bool Whiteboard::fetch(uint64_t id)
+{
+    BoardPager::RegionKey key;
+    if (!m_Pager.locate(id, key)) {
+        return false;
+    }
+    m_FetchRegions.insert(key);
+    return true;
+}
+
+bool Whiteboard::isFetching(uint64_t id) const
+{
+    return m_PagedTransforms.count(id) != 0 || m_Requested.count(id) != 0 || m_Announce.count(id) != 0;
+}
 
-            for (const auto& item : node) {
-                stroke.points.push_back(item.as<Point>());
+void Whiteboard::resolveFetches()
+{
+    if (m_Arrived.empty()) {
+        return;
+    }
+    const auto& index = strokeIndex();
+    std::vector<uint64_t> ids;
+    std::vector<StrokeTransform> transforms;
+    std::vector<uint64_t> announced;
+    for (uint64_t id : std::exchange(m_Arrived, {})) {
+        if (index.count(id) == 0) {
+            // Paged out again under a newer copy, or removed for good
+            if (fetch(id)) {
+                continue;
             }
-            return true;
+            m_PagedTransforms.erase(id);
+            m_Announce.erase(id);
+            if (m_Requested.erase(id) != 0) {
+                m_FetchGone.push_back(id);
+            }
+            continue;
+        }
+        if (auto transform = m_PagedTransforms.find(id); transform != m_PagedTransforms.end()) {
+            ids.push_back(id);
+            transforms.push_back(transform->second);
+            m_PagedTransforms.erase(transform);
+        }
+        if (m_Requested.erase(id) != 0) {
+            m_Fetched.push_back(*m_Strokes[index.at(id)]);
+        }
+        if (m_Announce.erase(id) != 0) {
+            announced.push_back(id);
+        }
+    }
+    if (!ids.empty()) {
+        transformStrokes(ids, transforms);
+    }
+
+    // Peers were told of the clear, so they get what undoing it brought back,
+    // with any transform that came in meanwhile
+    if (!announced.empty()) {
+        BoardOp op;
+        op.type = OpType::AddStrokes;
+        for (uint64_t id : announced) {
+            const Stroke& stroke = *m_Strokes[strokeIndex().at(id)];
+            m_Digest.add(stroke);
+            op.strokes.push_back(stroke);
+        }
+        m_PendingOps.push_back(std::move(op));
+    }
+}
+
+void Whiteboard::moveStrokes(const std::vector<uint64_t>& ids, const std::vector<StrokeTransform>& transforms)
+{
+    transformStrokes(ids, transforms);
+
+    BoardOp op;
+    op.type = OpType::TransformStrokes;
+    op.strokeIds = ids;
+    op.transforms = transforms;
+    m_PendingOps.push_back(std::move(op));
+}
+
+std::vector<StrokePtr> Whiteboard::takeMoved()
+{
+    // Only the latest copy of each, and only while it is still on the board
+    const auto& index = strokeIndex();
+    std::vector<StrokePtr> moved;
+    for (const auto& stroke : std::exchange(m_Moved, {})) {
+        auto it = index.find(stroke->id);
+        if (it != index.end() && m_Strokes[it->second] == stroke) {
+            moved.push_back(stroke);
+        }
+    }
+    return moved;
+}
+
+const std::unordered_map<uint64_t, size_t>& Whiteboard::strokeIndex()
+{
+    if (m_IndexRevision != m_Revision) {
+        m_StrokeIndex.clear();
+        m_IndexedStrokes = 0;
+        m_IndexRevision = m_Revision;
+    }
+    // Appends leave the revision alone, so only the new tail needs indexing
+    for (; m_IndexedStrokes < m_Strokes.size(); m_IndexedStrokes++) {
+        m_StrokeIndex[m_Strokes[m_IndexedStrokes]->id] = m_IndexedStrokes;
+    }
+    return m_StrokeIndex;
+}
+
+void Whiteboard::restorePaged(std::vector<StrokePtr> strokes)
+{
+    // A stroke may have been sent again while its region was paged out; the newer copy stays
+    std::unordered_set<uint64_t> resident;
+    for (const auto& stroke : m_Strokes) {
+        resident.insert(stroke->id);
+    }
+    strokes.erase(std::remove_if(strokes.begin(), strokes.end(), [&](const StrokePtr& stroke) {
+        return resident.count(stroke->id) != 0;
+    }), strokes.end());
+    if (strokes.empty()) {
+        return;
+    }
+
+    // Back into their old place in the stacking order
+    auto byOrder = [](const StrokePtr& a, const StrokePtr& b) { return a->order < b->order; };
+    std::sort(strokes.begin(), strokes.end(), byOrder);
+    for (const auto& stroke : strokes) {
+        m_ResidentBytes += strokeBytes(*stroke);
+    }
+    size_t middle = m_Strokes.size();
+    m_Strokes.insert(m_Strokes.end(), strokes.begin(), strokes.end());
+    std::inplace_merge(m_Strokes.begin(), m_Strokes.begin() + middle, m_Strokes.end(), byOrder);
+    ++m_Revision;
+    ++m_Version;
+    m_PagedIn = true;
+}
+
+void Whiteboard::updatePaging()
+{
+    std::vector<StrokePtr> loaded = m_Pager.takeLoaded();
+    for (const auto& stroke : loaded) {
+        if (isFetching(stroke->id)) {
+            m_Arrived.push_back(stroke->id);
         }
+    }
+    restorePaged(std::move(loaded));
+    resolveFetches();
+    // A region already loading may have had pages restored into it since, so it waits its turn
+    size_t fetches = 0;
+    for (auto key = m_FetchRegions.begin(); key != m_FetchRegions.end() && fetches < FETCH_REGIONS_PER_TICK;) {
+        if (m_Pager.isLoading(*key)) {
+            ++key;
+            continue;
+        }
+        m_Pager.load(*key);
+        key = m_FetchRegions.erase(key);
+        fetches++;
+    }
+
+    // Our own view with a screen of slack around it, plus whatever others look at
+    std::vector<Rect>& keep = m_PagingAreas;
+    keep.assign(m_ActiveAreas.begin(), m_ActiveAreas.end());
+    Rect viewport = getViewportRect();
+    if (!viewport.isEmpty()) {
+        keep.push_back(viewport.expanded(std::max(viewport.width(), viewport.height())));
+    }
+
+    m_PagingTick++;
+    for (const auto& area : keep) {
+        m_Pager.pageIn(area);
+
+        // Regions in view are the most recently used. A far zoomed-out view covers
+        // too many to list, but then nothing it shows can be evicted anyway.
+        int64_t x0 = static_cast<int64_t>(std::floor(area.minX / BoardPager::REGION_SIZE));
+        int64_t y0 = static_cast<int64_t>(std::floor(area.minY / BoardPager::REGION_SIZE));
+        int64_t x1 = static_cast<int64_t>(std::floor(area.maxX / BoardPager::REGION_SIZE));
+        int64_t y1 = static_cast<int64_t>(std::floor(area.maxY / BoardPager::REGION_SIZE));
+        if ((x1 - x0 + 1) * (y1 - y0 + 1) <= 1024) {
+            for (int64_t y = y0; y <= y1; y++) {
+                for (int64_t x = x0; x <= x1; x++) {
+                    m_RegionUse[{ x, y }] = m_PagingTick;
+                }
+            }
+        }
+    }
+
+    size_t budget = static_cast<size_t>(m_MemoryBudgetMB) * 1024 * 1024;
+    if (m_ResidentBytes > budget && m_Pager.isAvailable()) {
+        evictColdRegions(keep);
+    }
+    m_PagedStrokes = m_Pager.getPagedStrokes();
+}
+
+void Whiteboard::evictColdRegions(const std::vector<Rect>& keep)
+{
+    struct RegionUsage {
+        size_t bytes = 0;
+        Rect bounds;
     };
+    std::map<BoardPager::RegionKey, RegionUsage> regions;
+    for (const auto& stroke : m_Strokes) {
+        RegionUsage& usage = regions[BoardPager::regionOf(*stroke)];
+        usage.bytes += strokeBytes(*stroke);
+        usage.bounds.include(stroke->bounds);
+    }
+
+    // Least recently viewed first; regions never viewed count as oldest
+    std::vector<std::pair<uint64_t, BoardPager::RegionKey>> candidates;
+    for (const auto& [key, usage] : regions) {
+        bool active = m_Pager.isLoading(key) || std::any_of(keep.begin(), keep.end(), [&](const Rect& area) {
+            return area.intersects(usage.bounds);
+        });
+        if (!active) {
+            auto use = m_RegionUse.find(key);
+            candidates.push_back({ use != m_RegionUse.end() ? use->second : 0, key });
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    // Go well under the budget so the next few strokes do not page again
+    size_t target = static_cast<size_t>(m_MemoryBudgetMB) * 1024 * 1024 / 4 * 3;
+    size_t resident = m_ResidentBytes;
+    std::map<BoardPager::RegionKey, std::vector<StrokePtr>> pages;
+    for (const auto& [use, key] : candidates) {
+        if (resident <= target) {
+            break;
+        }
+        pages[key];
+        resident -= regions[key].bytes;
+    }
+    if (pages.empty()) {
+        return;
+    }
+
+    m_Strokes.erase(std::remove_if(m_Strokes.begin(), m_Strokes.end(), [&](const StrokePtr& stroke) {
+        auto page = pages.find(BoardPager::regionOf(*stroke));
+        if (page == pages.end()) {
+            return false;
+        }
+        page->second.push_back(stroke);
+        return true;
+    }), m_Strokes.end());
+    m_ResidentBytes = resident;
+    ++m_Revision;
+    ++m_Version;
+
+    for (auto& [key, strokes] : pages) {
+        m_Pager.pageOut(key, std::move(strokes));
+        m_RegionUse.erase(key);
+    }
 }
 
+void Whiteboard::addImages(const std::vector<BoardImage>& images)
+{
+    for (const auto& image : images) {
+        auto existing = std::find_if(m_Images.begin(), m_Images.end(), [&](const BoardImage& other) {
+            return other.id == image.id;
+        });
+        if (existing != m_Images.end()) {
+            *existing = image;
+        }
+        else {
+            m_Images.push_back(image);
+        }
+    }
+    ++m_Version;
+}
 
+void Whiteboard::closePiece()
+{
+    if (m_ActiveStroke.points.empty()) {
+        return;
+    }
+    if (m_ActiveStroke.isShape()) {
+        const auto& points = m_ActiveStroke.points;
+        if (points.size() != 2 || (points[0].x == points[1].x && points[0].y == points[1].y)) {
+            m_ActiveStroke = Stroke(); // A click without a drag makes no shape
+            return;
+        }
+    }
+
+    else if (m_ActiveStroke.points.size() > 2) {
+        // Slow drags sample many points a fraction of a pixel apart
+        PointList& points = m_ActiveStroke.points;
+        points.resize(filterByDistance(points.data(), points.size(), MIN_POINT_SPACING, points.data()));
+        m_ActiveStroke.updateBounds();
+    }
+
+    m_GesturePieces.push_back(std::make_shared<const Stroke>(std::move(m_ActiveStroke)));
+    m_ActiveStroke = Stroke();
+}
 
-void Whiteboard::saveState()
+void Whiteboard::finishStroke()
 {
-    m_UndoStack.push(m_Strokes);
-    // Clear redo stack when new action is performed
-    while (!m_RedoStack.empty()) {
-        m_RedoStack.pop();
+    isDrawing = false;
+    closePiece();
+    if (m_GesturePieces.empty()) {
+        return;
+    }
+
+    // Every piece of the gesture goes on top, and is undone and sent as one
+    std::vector<StrokePtr> strokes;
+    for (const auto& piece : std::exchange(m_GesturePieces, {})) {
+        auto stroke = std::make_shared<Stroke>(*piece);
+        stroke->order = m_NextOrder + strokes.size();
+        strokes.push_back(std::move(stroke));
     }
+
+    addStrokes(strokes);
+    HistoryEntry entry;
+    entry.added = strokes;
+    recordHistory(std::move(entry));
+
+    BoardOp op;
+    op.type = OpType::AddStrokes;
+    for (const auto& stroke : strokes) {
+        op.strokes.push_back(*stroke);
+    }
+    m_PendingOps.push_back(std::move(op));
 }
 
-ImVec2 Whiteboard::screenToCanvas(const ImVec2& screenPos, const ImVec2& windowPos)
+void Whiteboard::pasteImage(const CanvasPoint& canvasPos)
 {
-    return ImVec2(
-        (screenPos.x - windowPos.x - m_Offset.x) / m_Zoom,
-        (screenPos.y - windowPos.y - m_Offset.y) / m_Zoom
-    );
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> rgba;
+    if (!readClipboardImage(width, height, rgba)) {
+        return;
+    }
+
+    // Pasting the same picture twice stores and sends its pixels once
+    std::vector<uint8_t> blob = ImageCache::encodeImage(width, height, rgba);
+    BoardImage image;
+    image.id = m_SiteId | m_NextStrokeId++;
+    image.blobHash = m_BlobStore.put(blob);
+    image.blobSize = blob.size();
+
+    // One image pixel per screen pixel at the current zoom, centred on the mouse
+    double halfWidth = 0.5 * width / m_Zoom;
+    double halfHeight = 0.5 * height / m_Zoom;
+    image.bounds = { canvasPos.x - halfWidth, canvasPos.y - halfHeight, canvasPos.x + halfWidth, canvasPos.y + halfHeight };
+
+    addImages({ image });
+    HistoryEntry entry;
+    entry.addedImages.push_back(image);
+    recordHistory(std::move(entry));
+
+    BoardOp op;
+    op.type = OpType::AddImages;
+    op.images.push_back(std::move(image));
+    m_PendingOps.push_back(std::move(op));
 }
 
-ImVec2 Whiteboard::canvasToScreen(const ImVec2& canvasPos, const ImVec2& windowPos)
+void Whiteboard::drawImages(ImDrawList* drawList, const ImVec2& windowPos, const std::vector<BoardImage>& images)
+{
+    Rect viewport = getViewportRect();
+    for (const auto& image : images) {
+        if (!viewport.intersects(image.bounds)) {
+            continue;
+        }
+
+        ImVec2 min = canvasToScreen({ image.bounds.minX, image.bounds.minY }, windowPos);
+        ImVec2 max = canvasToScreen({ image.bounds.maxX, image.bounds.maxY }, windowPos);
+        GLuint texture = m_ImageCache.getTexture(image.blobHash);
+        if (texture != 0) {
+            drawList->AddImage(reinterpret_cast<ImTextureID>(static_cast<intptr_t>(texture)), min, max);
+        }
+        else {
+            // Placeholder while the blob downloads or decodes
+            drawList->AddRectFilled(min, max, ImColor(0.5f, 0.5f, 0.5f, 0.25f));
+            drawList->AddRect(min, max, ImColor(0.5f, 0.5f, 0.5f, 0.8f));
+        }
+    }
+}
+
+CanvasPoint Whiteboard::screenToCanvas(const ImVec2& screenPos, const ImVec2& windowPos)
+{
+    return {
+        m_Camera.x + (screenPos.x - windowPos.x) / m_Zoom,
+        m_Camera.y + (screenPos.y - windowPos.y) / m_Zoom
+    };
+}
+
+ImVec2 Whiteboard::canvasToScreen(const CanvasPoint& canvasPos, const ImVec2& windowPos)
 {
     return ImVec2(
-        canvasPos.x * m_Zoom + windowPos.x + m_Offset.x,
-        canvasPos.y * m_Zoom + windowPos.y + m_Offset.y
+        static_cast<float>((canvasPos.x - m_Camera.x) * m_Zoom + windowPos.x),
+        static_cast<float>((canvasPos.y - m_Camera.y) * m_Zoom + windowPos.y)
     );
 }
 
+void Whiteboard::beginStroke()
+{
+    m_ActiveStroke = Stroke();
+    m_ActiveStroke.id = m_SiteId | m_NextStrokeId++;
+    m_ActiveStroke.scale = Stroke::scaleForZoom(m_Zoom);
+    m_ActiveStroke.color = m_CurrentColor;
+    m_ActiveStroke.thickness = m_CurrentThickness / m_Zoom;
+    m_ActiveStroke.kind = m_Tool;
+}
+
+bool Whiteboard::restartStroke(const CanvasPoint& from, const CanvasPoint& to)
+{
+    // Both ends have to be in range of one tile; long segments get a coarser step
+    for (int scale = Stroke::scaleForZoom(m_Zoom); scale <= Stroke::MAX_SCALE; scale++) {
+        m_ActiveStroke.points.clear();
+        m_ActiveStroke.scale = static_cast<int8_t>(scale);
+        if (m_ActiveStroke.addPoint(from) && m_ActiveStroke.addPoint(to)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Whiteboard::dragShape(const CanvasPoint& end)
+{
+    restartStroke(m_ShapeStart, end);
+}
+
+void Whiteboard::continueStroke(const CanvasPoint& canvasPos)
+{
+    if (m_ActiveStroke.addPoint(canvasPos)) {
+        return;
+    }
+
+    // Too far from the stroke's tile to encode: carry on seamlessly in a new
+    // stroke. The pieces wait beside the active stroke until the mouse is released.
+    CanvasPoint last = m_ActiveStroke.position(m_ActiveStroke.points.back());
+    closePiece();
+    beginStroke();
+    restartStroke(last, canvasPos);
+}
+
+Rect Whiteboard::selectionBounds()
+{
+    // Strokes removed or paged out since they were selected drop out of the selection
+    const auto& index = strokeIndex();
+    m_Selection.erase(std::remove_if(m_Selection.begin(), m_Selection.end(), [&](uint64_t id) {
+        return index.count(id) == 0;
+    }), m_Selection.end());
+
+    Rect bounds;
+    for (uint64_t id : m_Selection) {
+        bounds.include(m_Strokes[index.at(id)]->bounds);
+    }
+    return bounds;
+}
+
+StrokeTransform Whiteboard::selectionDragTransform() const
+{
+    switch (m_SelectDrag) {
+    case SelectDrag::Move:
+        return { 1.0, m_DragCurrent.x - m_DragStart.x, m_DragCurrent.y - m_DragStart.y };
+    case SelectDrag::Scale: {
+        // Uniform, by how far the handle moved along the diagonal through it
+        double diagonalX = m_DragStart.x - m_ScalePivot.x;
+        double diagonalY = m_DragStart.y - m_ScalePivot.y;
+        double length = diagonalX * diagonalX + diagonalY * diagonalY;
+        if (length == 0.0) {
+            return {};
+        }
+        double factor = ((m_DragCurrent.x - m_ScalePivot.x) * diagonalX + (m_DragCurrent.y - m_ScalePivot.y) * diagonalY) / length;
+        // Mirroring would need a negative scale; stop at a hundredth instead
+        return StrokeTransform::around(m_ScalePivot, std::max(factor, 0.01), 0.0, 0.0);
+    }
+    default:
+        return {};
+    }
+}
+
+void Whiteboard::dragSelection(const CanvasPoint& canvasPos)
+{
+    if (m_SelectDrag == SelectDrag::None) {
+        m_DragStart = canvasPos;
+        m_SelectDrag = SelectDrag::Marquee;
+        m_Lasso.assign(1, canvasPos);
+
+        Rect bounds = selectionBounds();
+        if (!bounds.isEmpty()) {
+            const CanvasPoint corners[] = {
+                { bounds.minX, bounds.minY }, { bounds.maxX, bounds.minY },
+                { bounds.maxX, bounds.maxY }, { bounds.minX, bounds.maxY },
+            };
+            double reach = SELECTION_HANDLE_SIZE / m_Zoom;
+            for (int i = 0; i < 4; i++) {
+                if (std::abs(canvasPos.x - corners[i].x) <= reach && std::abs(canvasPos.y - corners[i].y) <= reach) {
+                    m_SelectDrag = SelectDrag::Scale;
+                    m_DragStart = corners[i];
+                    m_ScalePivot = corners[(i + 2) % 4];
+                    break;
+                }
+            }
+            Rect point;
+            point.include(canvasPos.x, canvasPos.y);
+            if (m_SelectDrag == SelectDrag::Marquee && bounds.contains(point)) {
+                m_SelectDrag = SelectDrag::Move;
+            }
+        }
+    }
+
+    m_DragCurrent = canvasPos;
+    if (m_SelectDrag == SelectDrag::Marquee && m_LassoSelect) {
+        // A point every couple of pixels is plenty for the outline
+        const CanvasPoint& last = m_Lasso.back();
+        if (std::hypot(canvasPos.x - last.x, canvasPos.y - last.y) * m_Zoom >= 2.0) {
+            m_Lasso.push_back(canvasPos);
+        }
+    }
+}
+
+void Whiteboard::finishSelectionDrag()
+{
+    StrokeTransform change = selectionDragTransform();
+    SelectDrag drag = std::exchange(m_SelectDrag, SelectDrag::None);
+    if (drag == SelectDrag::Marquee) {
+        selectInMarquee();
+    }
+    else if (!change.isIdentity()) {
+        transformSelection(change);
+    }
+}
+
+void Whiteboard::selectInMarquee()
+{
+    m_Selection.clear();
+    double dragged = std::hypot(m_DragCurrent.x - m_DragStart.x, m_DragCurrent.y - m_DragStart.y) * m_Zoom;
+    if (dragged < CLICK_SLOP) {
+        if (uint64_t id = strokeAt(m_DragCurrent)) {
+            m_Selection.push_back(id);
+        }
+        return;
+    }
+    if (!m_LassoSelect) {
+        Rect box;
+        box.include(m_DragStart.x, m_DragStart.y);
+        box.include(m_DragCurrent.x, m_DragCurrent.y);
+        for (const auto& stroke : m_Strokes) {
+            if (box.contains(stroke->bounds)) {
+                m_Selection.push_back(stroke->id);
+            }
+        }
+        return;
+    }
+
+    if (m_Lasso.size() < 3) {
+        return;
+    }
+    // Strokes whose box center is inside the outline; the box around it rules out most
+    Rect box;
+    for (const auto& point : m_Lasso) {
+        box.include(point.x, point.y);
+    }
+    for (const auto& stroke : m_Strokes) {
+        if (!box.intersects(stroke->bounds)) {
+            continue;
+        }
+        CanvasPoint center{ (stroke->bounds.minX + stroke->bounds.maxX) * 0.5, (stroke->bounds.minY + stroke->bounds.maxY) * 0.5 };
+        if (insidePolygon(m_Lasso, center)) {
+            m_Selection.push_back(stroke->id);
+        }
+    }
+}
+
+uint64_t Whiteboard::strokeAt(const CanvasPoint& canvasPos) const
+{
+    double slop = CLICK_SLOP / m_Zoom;
+    Rect point;
+    point.include(canvasPos.x, canvasPos.y);
+    // Topmost first
+    for (auto it = m_Strokes.rbegin(); it != m_Strokes.rend(); ++it) {
+        const Stroke& stroke = **it;
+        if (!stroke.bounds.expanded(slop).contains(point)) {
+            continue;
+        }
+        if (stroke.isShape()) {
+            return stroke.id;
+        }
+        // Measured in the stroke's own steps, where its points are
+        double step = stroke.step();
+        CanvasPoint origin = stroke.origin();
+        float x = static_cast<float>((canvasPos.x - origin.x) / step);
+        float y = static_cast<float>((canvasPos.y - origin.y) / step);
+        double reach = (stroke.width() * 0.5 + slop) / step;
+        if (polylineDistanceSquared(stroke.points.data(), stroke.points.size(), x, y) <= reach * reach) {
+            return stroke.id;
+        }
+    }
+    return 0;
+}
+
+void Whiteboard::transformSelection(const StrokeTransform& change)
+{
+    const auto& index = strokeIndex();
+    HistoryEntry entry;
+    for (uint64_t id : m_Selection) {
+        auto it = index.find(id);
+        if (it == index.end()) {
+            continue;
+        }
+        const StrokeTransform& current = m_Strokes[it->second]->transform;
+        entry.moved.push_back(id);
+        entry.movedFrom.push_back(current);
+        entry.movedTo.push_back(current.then(change));
+    }
+    if (entry.moved.empty()) {
+        return;
+    }
+
+    moveStrokes(entry.moved, entry.movedTo);
+    recordHistory(std::move(entry));
+}
+
+void Whiteboard::drawSelection(ImDrawList* drawList, const ImVec2& windowPos)
+{
+    const ImU32 color = ImColor(0.2f, 0.5f, 1.0f, 1.0f);
+    if (m_SelectDrag == SelectDrag::Marquee) {
+        if (m_LassoSelect) {
+            m_LassoOutline.clear();
+            for (const auto& point : m_Lasso) {
+                m_LassoOutline.push_back(canvasToScreen(point, windowPos));
+            }
+            drawList->AddPolyline(m_LassoOutline.data(), static_cast<int>(m_LassoOutline.size()), color, true, 1.0f);
+        }
+        else {
+            drawList->AddRect(canvasToScreen(m_DragStart, windowPos), canvasToScreen(m_DragCurrent, windowPos), color);
+        }
+        return;
+    }
+
+    Rect bounds = selectionBounds();
+    if (bounds.isEmpty()) {
+        return;
+    }
+    // While dragging only the outline follows the mouse
+    bounds = selectionDragTransform().apply(bounds);
+    ImVec2 min = canvasToScreen({ bounds.minX, bounds.minY }, windowPos);
+    ImVec2 max = canvasToScreen({ bounds.maxX, bounds.maxY }, windowPos);
+    drawList->AddRect(min, max, color);
+    for (const ImVec2& corner : { min, ImVec2(max.x, min.y), max, ImVec2(min.x, max.y) }) {
+        drawList->AddRectFilled(ImVec2(corner.x - SELECTION_HANDLE_SIZE, corner.y - SELECTION_HANDLE_SIZE),
+            ImVec2(corner.x + SELECTION_HANDLE_SIZE, corner.y + SELECTION_HANDLE_SIZE), color);
+    }
+}
+
+void Whiteboard::applyHistoryStep(const std::vector<StrokePtr>& dropStrokes, const std::vector<BoardImage>& dropImages,
+    const std::vector<StrokePtr>& restoreStrokes, const std::vector<BoardImage>& restoreImages)
+{
+    BoardOp removeOp;
+    removeOp.type = OpType::RemoveStrokes;
+    for (const auto& stroke : dropStrokes) {
+        removeOp.strokeIds.push_back(stroke->id);
+    }
+    for (const auto& image : dropImages) {
+        removeOp.strokeIds.push_back(image.id);
+    }
+    removeStrokes(removeOp.strokeIds);
+    addStrokes(restoreStrokes);
+    addImages(restoreImages);
+
+    if (!removeOp.strokeIds.empty()) {
+        m_PendingOps.push_back(std::move(removeOp));
+    }
+    if (!restoreStrokes.empty()) {
+        BoardOp addOp;
+        addOp.type = OpType::AddStrokes;
+        for (const auto& stroke : restoreStrokes) {
+            addOp.strokes.push_back(*stroke);
+        }
+        m_PendingOps.push_back(std::move(addOp));
+    }
+    if (!restoreImages.empty()) {
+        BoardOp imageOp;
+        imageOp.type = OpType::AddImages;
+        imageOp.images = restoreImages;
+        m_PendingOps.push_back(std::move(imageOp));
+    }
+}
+
 void Whiteboard::Undo()
 {
     if (!m_UndoStack.empty()) {
-        m_RedoStack.push(m_Strokes);
-        m_Strokes = m_UndoStack.top();
-        m_UndoStack.pop();
+        HistoryEntry entry = std::move(m_UndoStack.back());
+        m_UndoStack.pop_back();
+
+        // Only this peer's own action is reverted; strokes others drew since stay
+        applyHistoryStep(entry.added, entry.addedImages, entry.removed, entry.removedImages);
+        if (!entry.moved.empty()) {
+            moveStrokes(entry.moved, entry.movedFrom);
+        }
+        if (entry.keptPages != 0) {
+            // A cleared board comes back paged out. Each stroke is sent to peers
+            // once its region has been read, unless a newer copy is here already.
+            const auto& index = strokeIndex();
+            std::vector<uint64_t> newer;
+            for (uint64_t id : m_Pager.restore(entry.keptPages)) {
+                if (index.count(id) != 0) {
+                    newer.push_back(id);
+                    continue;
+                }
+                m_Announce.insert(id);
+                fetch(id);
+            }
+            m_Pager.forget(newer);
+            m_HistoryBytes -= entry.keptBytes;
+            entry.keptPages = 0;
+            entry.keptBytes = 0;
+        }
+        m_RedoStack.push_back(std::move(entry));
     }
 }
 
 void Whiteboard::redo()
 {
     if (!m_RedoStack.empty()) {
-        m_UndoStack.push(m_Strokes);
-        m_Strokes = m_RedoStack.top();
-        m_RedoStack.pop();
+        HistoryEntry entry = std::move(m_RedoStack.back());
+        m_RedoStack.pop_back();
+
+        if (entry.cleared) {
+            // Whatever is on the board now, not only what the clear removed back then
+            size_t bytes = historyEntryBytes(entry);
+            clearBoard(entry);
+            m_HistoryBytes = m_HistoryBytes - bytes + historyEntryBytes(entry);
+        }
+        else {
+            applyHistoryStep(entry.removed, entry.removedImages, entry.added, entry.addedImages);
+            if (!entry.moved.empty()) {
+                moveStrokes(entry.moved, entry.movedTo);
+            }
+        }
+        m_UndoStack.push_back(std::move(entry));
+        trimHistory();
+    }
+}
+
+void Whiteboard::clearBoard(HistoryEntry& entry)
+{
+    // Resident strokes join the paged out ones in a set the pager keeps aside,
+    // so Undo can bring the board back without it all staying in memory
+    entry.cleared = true;
+    entry.removed.clear();
+    entry.removedImages = m_Images;
+    if (m_Pager.isAvailable()) {
+        entry.keptPages = m_Pager.setAside(m_Strokes);
+        entry.keptBytes = m_Pager.getSetBytes(entry.keptPages);
+    }
+    else {
+        entry.removed = m_Strokes;
     }
+    clearStrokes();
+    m_Images.clear();
+
+    BoardOp op;
+    op.type = OpType::Clear;
+    m_PendingOps.push_back(std::move(op));
 }
 
 void Whiteboard::init()
 {
+    if (!m_StrokeRenderer.init()) {
+        std::cerr << "GPU stroke renderer unavailable, falling back to ImGui draw lists" << std::endl;
+    }
+}
 
+void Whiteboard::shutdown()
+{
+    m_StrokeRenderer.shutdown();
+    m_ImageCache.shutdown();
 }
 
 void Whiteboard::renderCanvas()
@@ -110,6 +999,7 @@ void Whiteboard::renderCanvas()
             ImVec2 windowPos = ImGui::GetWindowPos();
             ImVec2 windowSize = ImGui::GetWindowSize();
             ImVec2 contentRegion = ImGui::GetContentRegionAvail();
+            m_ViewSize = windowSize;
             // Draw background
             ImDrawList* drawList = ImGui::GetWindowDrawList();
             drawList->AddRectFilled(
@@ -120,14 +1010,17 @@ void Whiteboard::renderCanvas()
 
             // Handle input
             if (ImGui::IsWindowHovered()) {
+                ImVec2 mousePos = ImGui::GetMousePos();
+
                 if (ImGui::GetIO().MouseWheel != 0.0f) {
+                    // Zoom around the mouse so the point under it stays put
+                    CanvasPoint anchor = screenToCanvas(mousePos, windowPos);
                     m_Zoom *= (1.0f + ImGui::GetIO().MouseWheel * 0.1f);
-                    if (m_Zoom < 0.1f) m_Zoom = 0.1f;
-                    if (m_Zoom > 5.0f) m_Zoom = 5.0f;
+                    m_Zoom = std::clamp(m_Zoom, MIN_ZOOM, MAX_ZOOM);
+                    m_Camera.x = anchor.x - (mousePos.x - windowPos.x) / m_Zoom;
+                    m_Camera.y = anchor.y - (mousePos.y - windowPos.y) / m_Zoom;
                 }
 
-                ImVec2 mousePos = ImGui::GetMousePos();
-
                 if (ImGui::IsMouseDown(2)) {
                     if (!isDragging) {
                         isDragging = true;
@@ -135,8 +1028,8 @@ void Whiteboard::renderCanvas()
                     }
                     ImGui::SetMouseCursor(ImGuiMouseCursor_Hand);
 
-                    m_Offset.x += mousePos.x - m_LastMousePos.x;
-                    m_Offset.y += mousePos.y - m_LastMousePos.y;
+                    m_Camera.x -= (mousePos.x - m_LastMousePos.x) / m_Zoom;
+                    m_Camera.y -= (mousePos.y - m_LastMousePos.y) / m_Zoom;
                     m_LastMousePos = mousePos;
                 }
                 else {
@@ -144,27 +1037,34 @@ void Whiteboard::renderCanvas()
                 }
 
                 if (ImGui::IsMouseDown(0) && !isDragging) {
-                    ImVec2 canvasPos = screenToCanvas(mousePos, windowPos);
-
-                    if (!isDrawing) {
-                        saveState(); // Save state before starting new stroke
-                        m_Strokes.push_back(Stroke());
-                        isDrawing = true;
+                    CanvasPoint canvasPos = screenToCanvas(mousePos, windowPos);
+                    if (m_Selecting) {
+                        dragSelection(canvasPos);
+                    }
+                    else {
+                        if (!isDrawing) {
+                            beginStroke();
+                            m_ShapeStart = canvasPos;
+                            isDrawing = true;
+                        }
+                        if (m_ActiveStroke.isShape()) {
+                            dragShape(canvasPos);
+                        }
+                        else {
+                            continueStroke(canvasPos);
+                        }
                     }
-
-                    Point newPoint = {
-                        canvasPos.x,
-                        canvasPos.y,
-                        m_CurrentColor,
-                        m_CurrentThickness / m_Zoom
-                    };
-                    m_Strokes.back().points.push_back(newPoint);
                 }
-                else {
-                    isDrawing = false;
+
+                if (ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Escape))) {
+                    m_Selection.clear();
                 }
 
 
+                if (ImGui::GetIO().KeyCtrl && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_V))) {
+                    pasteImage(screenToCanvas(mousePos, windowPos));
+                }
+
                 if (ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Backspace)))
                 {
                     if (ImGui::GetIO().KeyCtrl)
@@ -182,41 +1082,65 @@ void Whiteboard::renderCanvas()
 
             }
 
-            // Draw all m_Strokes
-            for (const auto& stroke : m_Strokes) {
-                for (size_t i = 1; i < stroke.points.size(); i++) {
-                    const auto& p1 = stroke.points[i - 1];
-                    const auto& p2 = stroke.points[i];
-
-                    ImVec2 screenP1 = canvasToScreen(ImVec2(p1.x, p1.y), windowPos);
-                    ImVec2 screenP2 = canvasToScreen(ImVec2(p2.x, p2.y), windowPos);
-
-                    drawList->AddLine(
-                        screenP1,
-                        screenP2,
-                        ImColor(p1.color[0], p1.color[1], p1.color[2]),
-                        p1.thickness * m_Zoom
-                    );
+            // The stroke ends on release even if the mouse left the canvas meanwhile
+            if (isDrawing && !ImGui::IsMouseDown(0)) {
+                finishStroke();
+            }
+            if (m_SelectDrag != SelectDrag::None && !ImGui::IsMouseDown(0)) {
+                finishSelectionDrag();
+            }
+
+            // Everything below draws one consistent version of the board
+            DocumentPtr document = publish();
+
+            // Images go underneath the strokes
+            m_ImageCache.update();
+            drawImages(drawList, windowPos, document->images);
+
+            // Draw all committed strokes, then the one being drawn on top
+            if (m_UseGpuRenderer && m_StrokeRenderer.isInitialized()) {
+                // Re-anchor once float positions around the camera would start to lose sub-pixel precision
+                if (std::max(std::abs(m_Camera.x - m_RenderAnchor.x), std::abs(m_Camera.y - m_RenderAnchor.y)) * m_Zoom > 1e5) {
+                    m_RenderAnchor = m_Camera;
                 }
+                m_StrokeRenderer.sync(document->strokes, document->revision, m_RenderAnchor, m_Zoom);
+                m_StrokeRenderer.syncActive(m_ActiveStroke);
+                m_StrokeRenderer.draw(drawList, canvasToScreen(m_RenderAnchor, windowPos), m_Zoom);
+                // Pieces a long gesture was split into; only ever a few strokes
+                m_Tessellator.tessellate(m_GesturePieces, drawList, m_Camera, windowPos, m_Zoom);
+            }
+            else {
+                // Non-owning pointer to the active stroke, so it needs no copy or allocation
+                StrokePtr active(StrokePtr(), &m_ActiveStroke);
+                m_Tessellator.tessellate(document->strokes, drawList, m_Camera, windowPos, m_Zoom);
+                m_Tessellator.tessellate(m_GesturePieces, drawList, m_Camera, windowPos, m_Zoom);
+                m_Tessellator.tessellate(std::span<const StrokePtr>(&active, 1), drawList, m_Camera, windowPos, m_Zoom);
             }
 
-            // Draw grid
-            const float gridSize = 50.0f * m_Zoom;
+            // Draw grid, doubling its spacing as we zoom out so lines stay 50-100 px apart
+            const double gridStep = 50.0 * std::exp2(std::ceil(-std::log2(m_Zoom)));
+            const float gridSize = static_cast<float>(gridStep * m_Zoom);
+            const float gridStartX = static_cast<float>((std::ceil(m_Camera.x / gridStep) * gridStep - m_Camera.x) * m_Zoom);
+            const float gridStartY = static_cast<float>((std::ceil(m_Camera.y / gridStep) * gridStep - m_Camera.y) * m_Zoom);
             const ImU32 gridColor = ImColor(0.8f, 0.8f, 0.8f, 0.2f);
-            for (float x = fmod(m_Offset.x, gridSize); x < windowSize.x; x += gridSize) {
+            for (float x = gridStartX; x < windowSize.x; x += gridSize) {
                 drawList->AddLine(
                     ImVec2(windowPos.x + x, windowPos.y),
                     ImVec2(windowPos.x + x, windowPos.y + windowSize.y),
                     gridColor
                 );
             }
-            for (float y = fmod(m_Offset.y, gridSize); y < windowSize.y; y += gridSize) {
+            for (float y = gridStartY; y < windowSize.y; y += gridSize) {
                 drawList->AddLine(
                     ImVec2(windowPos.x, windowPos.y + y),
                     ImVec2(windowPos.x + windowSize.x, windowPos.y + y),
                     gridColor
                 );
             }
+
+            if (m_Selecting) {
+                drawSelection(drawList, windowPos);
+            }
         }
         ImGui::End();
     }
@@ -240,137 +1164,499 @@ void Whiteboard::drawToolWindow()
 
     ImGui::Separator();
 
+    ImGui::Text("Tool");
+    const char* toolNames[] = { "Pen", "Line", "Arrow", "Rectangle", "Ellipse" };
+    for (int i = 0; i < 5; i++) {
+        if (i % 3 != 0) {
+            ImGui::SameLine();
+        }
+        if (ImGui::RadioButton(toolNames[i], !m_Selecting && m_Tool == static_cast<StrokeKind>(i))) {
+            m_Tool = static_cast<StrokeKind>(i);
+            m_Selecting = false;
+            m_Selection.clear();
+        }
+    }
+    ImGui::SameLine();
+    if (ImGui::RadioButton("Select", m_Selecting)) {
+        m_Selecting = true;
+    }
+    if (m_Selecting) {
+        if (ImGui::RadioButton("Box", !m_LassoSelect)) {
+            m_LassoSelect = false;
+        }
+        ImGui::SameLine();
+        if (ImGui::RadioButton("Lasso", m_LassoSelect)) {
+            m_LassoSelect = true;
+        }
+        ImGui::SameLine();
+        ImGui::Text("%zu selected", m_Selection.size());
+    }
+
     ImGui::Text("Drawing Color");
     ImGui::ColorEdit3("##DrawingColor", m_CurrentColor.data());
 
     ImGui::Text("Canvas Color");
-    ImGui::ColorEdit3("##CanvasColor", 
-        m_CanvasColor.data());
+    if (ImGui::ColorEdit3("##CanvasColor", 
+        m_CanvasColor.data())) {
+        m_CanvasColorChanged = true;
+        ++m_Version;
+    }
 
     ImGui::Text("Brush Size");
     ImGui::SliderFloat("##Thickness", &m_CurrentThickness, 1.0f, 20.0f);
 
-    ImGui::Text("Zoom: %.1fx", m_Zoom);
+    ImGui::Text("Zoom: %.3gx", m_Zoom);
     if (ImGui::Button("Reset Zoom")) {
         m_Zoom = 1.0f;
     }
 
     if (ImGui::Button("Reset Pan")) {
-        m_Offset = ImVec2(0.0f, 0.0f);
+        m_Camera = CanvasPoint();
     }
 
-    if (ImGui::Button("Clear Canvas")) {
-        saveState(); // Save state before clearing
-        m_Strokes.clear();
+    if (ImGui::Button("Clear Canvas") && (!m_Strokes.empty() || !m_Images.empty() || !m_Pager.empty())) {
+        HistoryEntry entry;
+        clearBoard(entry);
+        recordHistory(std::move(entry));
     }
 
     if (ImGui::Button(showCanvas ? "Hide Canvas" : "Show Canvas")) {
         showCanvas = !showCanvas;
     }
 
+    if (m_StrokeRenderer.isInitialized()) {
+        ImGui::Checkbox("GPU Stroke Renderer", &m_UseGpuRenderer);
+    }
+
+    ImGui::Text("Memory Budget");
+    if (ImGui::SliderInt("##MemoryBudget", &m_MemoryBudgetMB, 16, 4096, "%d MB", ImGuiSliderFlags_Logarithmic)) {
+        trimHistory();
+    }
+    ImGui::Text("Resident %.1f MB, %zu strokes paged out", m_ResidentBytes / (1024.0 * 1024.0), m_Pager.getPagedStrokes());
+
+    drawExportSection();
+
     ImGui::Text("\nControls:");
-    ImGui::Text("- Left Click: Draw");
+    ImGui::Text("- Left Click: Draw, or drag a shape");
+    ImGui::Text("- Select: Click a stroke or drag to pick several, drag them to move, a corner to resize");
+    ImGui::Text("- Escape: Clear selection");
     ImGui::Text("- Middle Click: Pan");
     ImGui::Text("- Mouse Wheel: Zoom");
     ImGui::Text("- Backspace: Undo");
     ImGui::Text("- Ctrl+Backspace: Redo");
+    ImGui::Text("- Ctrl+V: Paste Image");
 
     ImGui::End();
 }
 
+void Whiteboard::drawExportSection()
+{
+    ImGui::Separator();
+    ImGui::Text("Export");
+
+    if (m_Exporter.isRunning()) {
+        ImGui::ProgressBar(m_Exporter.getProgress());
+        if (ImGui::Button("Cancel Export")) {
+            m_Exporter.cancel();
+        }
+        return;
+    }
+
+    ImGui::InputText("##ExportPath", m_ExportPath, sizeof(m_ExportPath));
+    ImGui::RadioButton("PNG", &m_ExportFormat, 0);
+    ImGui::SameLine();
+    ImGui::RadioButton("SVG", &m_ExportFormat, 1);
+
+    ExportSettings settings;
+    settings.path = m_ExportPath;
+    settings.format = m_ExportFormat == 0 ? ExportFormat::Png : ExportFormat::Svg;
+    settings.scale = m_ExportScale;
+    settings.background = m_CanvasColor;
+
+    if (settings.format == ExportFormat::Png) {
+        ImGui::SliderFloat("Scale", &m_ExportScale, 0.1f, 16.0f, "%.1f px/unit", ImGuiSliderFlags_Logarithmic);
+        uint32_t width = 0;
+        uint32_t height = 0;
+        Exporter::measure(m_Strokes, m_Images, settings, width, height, m_Pager.getPagedBounds());
+        ImGui::Text("%u x %u px", width, height);
+    }
+
+    if (ImGui::Button("Export")) {
+        // The export thread keeps this version alive while drawing goes on.
+        // Paged out regions are read on the pager's thread and handed to it.
+        m_Exporter.start(publish(), settings, m_Pager.readPaged());
+    }
+
+    m_Exporter.getStatus(m_ExportStatus);
+    if (!m_ExportStatus.empty()) {
+        ImGui::TextWrapped("%s", m_ExportStatus.c_str());
+    }
+}
+
 void Whiteboard::handleNetworkMessage(const std::string& message)
 {
     deserialize(message);
 }
 
-std::string Whiteboard::getUpdateData()
+void Whiteboard::applyOp(const BoardOp& op)
 {
-    return serialize();
+    switch (op.type) {
+    case OpType::AddStrokes: {
+        // A stroke we already hold (e.g. streamed in twice) is replaced, not
+        // duplicated. Most are new, so the board is only walked for those held.
+        const auto& index = strokeIndex();
+        std::vector<uint64_t> held;
+        for (const auto& stroke : op.strokes) {
+            if (index.count(stroke.id) != 0) {
+                held.push_back(stroke.id);
+            } else if (isFetching(stroke.id)) {
+                m_Arrived.push_back(stroke.id); // Settled against the copy added below
+            }
+        }
+        if (!held.empty()) {
+            removeStrokes(held, false);
+        }
+        addStrokes(op.strokes);
+        break;
+    }
+    case OpType::RemoveStrokes:
+        removeStrokes(op.strokeIds);
+        break;
+    case OpType::Clear:
+        clearStrokes();
+        m_Images.clear();
+        break;
+    case OpType::CanvasColor:
+        m_CanvasColor = op.canvasColor;
+        ++m_Version;
+        break;
+    case OpType::Snapshot:
+        clearStrokes();
+        addStrokes(op.strokes);
+        m_Images = op.images;
+        m_CanvasColor = op.canvasColor;
+        ++m_Revision;
+        break;
+    case OpType::AddImages:
+        addImages(op.images);
+        break;
+    case OpType::TransformStrokes:
+        transformStrokes(op.strokeIds, op.transforms);
+        break;
+    case OpType::Viewport:
+    case OpType::BlobRequest:
+    case OpType::BlobChunk:
+    case OpType::Hello:
+    case OpType::Welcome:
+    case OpType::Ack:
+    case OpType::DigestQuery:
+    case OpType::Digest:
+    case OpType::StrokeRequest:
+        break;
+    }
 }
 
-std::string Whiteboard::serialize() const 
+bool Whiteboard::overlaps(const BoardOp& remote, const BoardOp& local)
 {
-    YAML::Node node;
+    auto touchesIds = [](const BoardOp& op, const std::unordered_set<uint64_t>& ids) {
+        for (const auto& stroke : op.strokes) {
+            if (ids.count(stroke.id) != 0) return true;
+        }
+        for (const auto& image : op.images) {
+            if (ids.count(image.id) != 0) return true;
+        }
+        for (uint64_t id : op.strokeIds) {
+            if (ids.count(id) != 0) return true;
+        }
+        return false;
+    };
 
-    // Serialize strokes
-    for (const auto& stroke : m_Strokes) {
-        node["strokes"].push_back(stroke);
+    switch (remote.type) {
+    case OpType::Snapshot:
+        return true;
+    case OpType::Clear:
+        return local.type == OpType::AddStrokes || local.type == OpType::AddImages;
+    case OpType::CanvasColor:
+        return local.type == OpType::CanvasColor;
+    case OpType::AddStrokes:
+    case OpType::AddImages:
+    case OpType::RemoveStrokes:
+    case OpType::TransformStrokes: {
+        if (local.type == OpType::Clear) {
+            // Only what remote adds needs clearing again
+            return remote.type == OpType::AddStrokes || remote.type == OpType::AddImages;
+        }
+        std::unordered_set<uint64_t> ids;
+        for (const auto& stroke : remote.strokes) ids.insert(stroke.id);
+        for (const auto& image : remote.images) ids.insert(image.id);
+        ids.insert(remote.strokeIds.begin(), remote.strokeIds.end());
+        return touchesIds(local, ids);
     }
+    default:
+        return false;
+    }
+}
 
-    // Serialize undo stack
-    auto temp = m_UndoStack;
-    while (!temp.empty())
-    {
-        const auto stackItem = temp.top();
-        YAML::Node stackNode;
-        for (const auto& stroke : stackItem) {
-            stackNode.push_back(stroke);
-        }
-        node["undoStack"].push_back(stackNode);
-        temp.pop();
+void Whiteboard::applyRemoteOp(const BoardOp& op)
+{
+    applyOp(op);
+    replayUnacked(op);
+}
+
+void Whiteboard::replayUnacked(const BoardOp& remote)
+{
+    // Our pending ops reach the host after this one, so where they overlap ours win.
+    // Ops before the first overlap commute with it and stay as they are.
+    auto first = std::find_if(m_Unacked.begin(), m_Unacked.end(), [&](const BoardOp& local) {
+        return overlaps(remote, local);
+    });
+    for (auto it = first; it != m_Unacked.end(); ++it) {
+        applyOp(*it);
     }
+}
 
-    // Serialize redo stack
-    temp = m_RedoStack;
-    while (!temp.empty())
-    {
-        const auto stackItem = temp.top();
-        YAML::Node stackNode;
-        for (const auto& stroke : stackItem) {
-            stackNode.push_back(stroke);
-        }
-        node["redoStack"].push_back(stackNode);
-        temp.pop();
+StagedSnapshot Whiteboard::stageSnapshot(BoardOp op)
+{
+    StagedSnapshot staged;
+    staged.strokes.reserve(op.strokes.size());
+    uint64_t order = 1;
+    for (auto& stroke : op.strokes) {
+        auto added = std::make_shared<Stroke>(std::move(stroke));
+        added->order = order++;
+        staged.bytes += strokeBytes(*added);
+        staged.digest.add(*added);
+        staged.strokes.push_back(std::move(added));
     }
+    op.strokes.clear();
+    staged.op = std::move(op);
+    return staged;
+}
 
-    // Serialize other properties
-    node["currentColor"] = m_CurrentColor;
-    node["canvasColor"] = m_CanvasColor;
-    node["currentThickness"] = m_CurrentThickness;
-    node["zoom"] = m_Zoom;
+void Whiteboard::applyRemoteSnapshot(StagedSnapshot staged)
+{
+    // What applyOp does for a snapshot, minus the per-stroke work done while staging
+    clearStrokes();
+    m_Strokes = std::move(staged.strokes);
+    m_Digest = std::move(staged.digest);
+    m_ResidentBytes = staged.bytes;
+    m_NextOrder = std::max<uint64_t>(m_NextOrder, m_Strokes.size() + 1);
+    m_Images = std::move(staged.op.images);
+    m_CanvasColor = staged.op.canvasColor;
+    ++m_Revision;
+    ++m_Version;
+    replayUnacked(staged.op);
+}
 
-    return YAML::Dump(node);
+void Whiteboard::acknowledge(uint64_t clientSeq)
+{
+    while (!m_Unacked.empty() && m_Unacked.front().clientSeq <= clientSeq) {
+        m_Unacked.pop_front();
+    }
 }
 
-void Whiteboard::deserialize(const std::string& nodeString)
+void Whiteboard::replayLocalOp(const BoardOp& op)
 {
-    YAML::Node node = YAML::Load(nodeString);
-    // Deserialize strokes
-    if (node["strokes"]) {
-        m_Strokes.clear();
-        for (const auto& strokeNode : node["strokes"]) {
-            m_Strokes.push_back(strokeNode.as<Stroke>());
+    applyOp(op);
+    if (m_Predicting) {
+        m_Unacked.push_back(op);
+    }
+}
+
+void Whiteboard::takeLocalOps(std::vector<BoardOp>& ops)
+{
+    if (m_CanvasColorChanged) {
+        // Dragging the picker changes the color every frame; only the latest value matters
+        BoardOp op;
+        op.type = OpType::CanvasColor;
+        op.canvasColor = m_CanvasColor;
+        m_PendingOps.push_back(std::move(op));
+        m_CanvasColorChanged = false;
+    }
+
+    // The two vectors trade buffers, so neither has to grow again
+    ops.clear();
+    ops.swap(m_PendingOps);
+    for (auto& op : ops) {
+        op.clientSeq = m_NextClientSeq++;
+        if (m_Predicting) {
+            m_Unacked.push_back(op);
         }
     }
+}
+
+void Whiteboard::getUpdateData(const std::function<void(std::string)>& write)
+{
+    serialize(write);
+}
+
+DocumentPtr Whiteboard::publish()
+{
+    const DocumentPtr& current = m_Document.current();
+    if (current->version == m_Version) {
+        return current;
+    }
+
+    // Copies pointers only; the strokes themselves are shared with the previous version
+    auto document = std::make_shared<BoardDocument>();
+    document->version = m_Version;
+    document->revision = m_Revision;
+    document->strokes = m_Strokes;
+    document->images = m_Images;
+    document->canvasColor = m_CanvasColor;
+
+    m_Document.publish(std::move(document));
+    return m_Document.current();
+}
+
+Rect Whiteboard::getViewportRect() const
+{
+    Rect viewport;
+    viewport.include(m_Camera.x, m_Camera.y);
+    viewport.include(m_Camera.x + m_ViewSize.x / m_Zoom, m_Camera.y + m_ViewSize.y / m_Zoom);
+    return viewport;
+}
 
-    // Deserialize undo stack
-    if (node["undoStack"]) {
-        while (!m_UndoStack.empty()) m_UndoStack.pop(); // Clear current stack
-        for (const auto& stackNode : node["undoStack"]) {
-            std::vector<Stroke> stackItem;
-            for (const auto& strokeNode : stackNode) {
-                stackItem.push_back(strokeNode.as<Stroke>());
+uint64_t Whiteboard::getChecksum()
+{
+    // FNV-1a
+    auto mix = [](uint64_t& hash, const void* data, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+    };
+    auto strokeHash = [&mix](const Stroke& stroke) {
+        uint64_t hash = 14695981039346656037ull;
+        mix(hash, &stroke.id, sizeof(stroke.id));
+        mix(hash, &stroke.kind, sizeof(stroke.kind));
+        mix(hash, &stroke.tileX, sizeof(stroke.tileX));
+        mix(hash, &stroke.tileY, sizeof(stroke.tileY));
+        mix(hash, &stroke.scale, sizeof(stroke.scale));
+        mix(hash, stroke.color.data(), sizeof(float) * 3);
+        mix(hash, &stroke.thickness, sizeof(float));
+        if (!stroke.transform.isIdentity()) {
+            mix(hash, &stroke.transform, sizeof(StrokeTransform));
+        }
+        for (const auto& point : stroke.points) {
+            mix(hash, &point.x, sizeof(point.x));
+            mix(hash, &point.y, sizeof(point.y));
+        }
+        return hash;
+    };
+
+    // Paged out regions are read one at a time; the old copy of a stroke sent
+    // again while it was paged out does not count
+    uint64_t strokes = 0;
+    std::unordered_set<uint64_t> resident;
+    for (const auto& stroke : m_Strokes) {
+        resident.insert(stroke->id);
+        strokes += strokeHash(*stroke);
+    }
+    m_Pager.visitPaged([&](std::vector<StrokePtr> paged) {
+        for (const auto& stroke : paged) {
+            if (resident.count(stroke->id) == 0) {
+                strokes += strokeHash(*stroke);
             }
-            m_UndoStack.push(stackItem);
         }
+    });
+
+    uint64_t hash = 14695981039346656037ull;
+    mix(hash, m_CanvasColor.data(), sizeof(float) * 3);
+    mix(hash, &strokes, sizeof(strokes));
+    for (const auto& image : m_Images) {
+        mix(hash, &image.id, sizeof(image.id));
+        mix(hash, image.blobHash.data(), image.blobHash.size());
+        mix(hash, &image.bounds, sizeof(Rect));
     }
+    return hash;
+}
 
-    // Deserialize redo stack
-    if (node["redoStack"]) {
-        while (!m_RedoStack.empty()) m_RedoStack.pop(); // Clear current stack
-        for (const auto& stackNode : node["redoStack"]) {
-            std::vector<Stroke> stackItem;
-            for (const auto& strokeNode : stackNode) {
-                stackItem.push_back(strokeNode.as<Stroke>());
-            }
-            m_RedoStack.push(stackItem);
+void Whiteboard::findStrokes(const std::vector<uint64_t>& ids, std::vector<Stroke>& found,
+    std::vector<uint64_t>& gone, std::vector<uint64_t>& paged)
+{
+    const auto& index = strokeIndex();
+    for (uint64_t id : ids) {
+        auto it = index.find(id);
+        if (it != index.end()) {
+            found.push_back(*m_Strokes[it->second]);
         }
+        else if (fetch(id)) {
+            m_Requested.insert(id);
+            paged.push_back(id);
+        }
+        else {
+            gone.push_back(id);
+        }
+    }
+}
+
+void Whiteboard::takeFetched(std::vector<Stroke>& found, std::vector<uint64_t>& gone)
+{
+    found = std::exchange(m_Fetched, {});
+    gone = std::exchange(m_FetchGone, {});
+}
+
+std::vector<BoardImage> Whiteboard::getMissingBlobs(bool visibleOnly) const
+{
+    Rect viewport = getViewportRect();
+    std::vector<BoardImage> missing;
+    for (const auto& image : m_Images) {
+        if ((!visibleOnly || viewport.intersects(image.bounds)) && !m_BlobStore.has(image.blobHash)) {
+            missing.push_back(image);
+        }
+    }
+    return missing;
+}
+
+void Whiteboard::writeMetrics(MetricsWriter& writer) const
+{
+    DocumentPtr document = getDocument();
+    size_t points = 0;
+    for (const auto& stroke : document->strokes) {
+        points += stroke->points.size();
     }
+    writer.gauge("linkvue_board_strokes", "Strokes on the board", double(document->strokes.size()));
+    writer.gauge("linkvue_board_points", "Points over all strokes on the board", double(points));
+    writer.gauge("linkvue_board_images", "Images on the board", double(document->images.size()));
+    writer.counter("linkvue_board_version", "Edits applied to the board", double(document->version));
+    writer.gauge("linkvue_history_entries", "Undo and redo entries", double(m_HistoryEntries));
+    writer.gauge("linkvue_history_bytes", "Approximate memory held by undo and redo history", double(m_HistoryBytes));
+    writer.gauge("linkvue_resident_stroke_bytes", "Approximate memory held by resident strokes", double(m_ResidentBytes));
+    writer.gauge("linkvue_paged_strokes", "Strokes paged out to disk", double(m_PagedStrokes));
+}
 
-    // Deserialize other properties
-    if (node["currentColor"]) m_CurrentColor = node["currentColor"].as<std::array<float, 3>>();
-    if (node["canvasColor"]) m_CanvasColor = node["canvasColor"].as<std::array<float, 3>>();
-    if (node["currentThickness"]) m_CurrentThickness = node["currentThickness"].as<float>();
-    if (node["zoom"]) m_Zoom = node["zoom"].as<float>();
+void Whiteboard::serialize(const std::function<void(std::string)>& write)
+{
+    BoardOp snapshot;
+    snapshot.type = OpType::Snapshot;
+    std::unordered_set<uint64_t> resident;
+    for (const auto& stroke : m_Strokes) {
+        resident.insert(stroke->id);
+        snapshot.strokes.push_back(*stroke);
+    }
+    snapshot.images = m_Images;
+    snapshot.canvasColor = m_CanvasColor;
+    write(encodeOp(snapshot));
+
+    // Paged out regions follow one message each, so the board is never all in memory
+    m_Pager.visitPaged([&](std::vector<StrokePtr> paged) {
+        BoardOp region;
+        region.type = OpType::AddStrokes;
+        for (const auto& stroke : paged) {
+            if (resident.count(stroke->id) == 0) {
+                region.strokes.push_back(*stroke);
+            }
+        }
+        if (!region.strokes.empty()) {
+            write(encodeOp(region));
+        }
+    });
 }
 
+void Whiteboard::deserialize(const std::string& nodeString)
+{
+    BoardOp op;
+    if (decodeOp(nodeString, op)) {
+        applyOp(op);
+    }
+}
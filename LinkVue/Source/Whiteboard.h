@@ -5,47 +5,217 @@
 
 
 #include <vector>
-#include <stack>
+#include <deque>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <span>
 #include <array>
+#include <atomic>
 #include <iostream>
+#include <functional>
 
-#include <yaml-cpp/yaml.h>
+#include "Stroke.h"
+#include "BoardDocument.h"
+#include "Protocol.h"
+#include "StrokeRenderer.h"
+#include "StrokeTessellator.h"
+#include "Exporter.h"
+#include "BlobStore.h"
+#include "ImageCache.h"
+#include "Metrics.h"
+#include "BoardPager.h"
+#include "BoardDigest.h"
 
-struct Point {
-    float x, y;
-    std::array<float, 3> color;
-    float thickness;
+// One local action, undone by removing what it added, restoring what it removed
+// and putting what it moved back where it was. A clear keeps the strokes it
+// removed in the page file rather than in memory.
+struct HistoryEntry {
+    std::vector<StrokePtr> added;
+    std::vector<StrokePtr> removed;
+    std::vector<BoardImage> addedImages;
+    std::vector<BoardImage> removedImages;
+    std::vector<uint64_t> moved;
+    std::vector<StrokeTransform> movedFrom;
+    std::vector<StrokeTransform> movedTo;
+    bool cleared = false;   // Redone by clearing again
+    uint64_t keptPages = 0; // Pager set with what the clear removed, until undone
+    size_t keptBytes = 0;   // Memory the pager holds for that set
 };
 
-struct Stroke {
-    std::vector<Point> points;
+// A snapshot made ready off the UI thread: its strokes already wrapped, stacked
+// and hashed, so putting it on the board is little more than a swap
+struct StagedSnapshot {
+    BoardOp op; // Images and canvas color; the strokes moved out
+    std::vector<StrokePtr> strokes;
+    BoardDigest digest;
+    size_t bytes = 0;
 };
 
 class Whiteboard {
 private:
-    std::vector<Stroke> m_Strokes;
-    std::stack<std::vector<Stroke>> m_UndoStack;
-    std::stack<std::vector<Stroke>> m_RedoStack;
+    static constexpr float MIN_ZOOM = 1e-4f;
+    static constexpr float MAX_ZOOM = 1e4f;
+
+    std::vector<StrokePtr> m_Strokes;
+    std::vector<BoardImage> m_Images; // Drawn below the strokes
+    std::deque<HistoryEntry> m_UndoStack; // Newest at the back; the oldest go once over budget
+    std::deque<HistoryEntry> m_RedoStack;
+    std::atomic<size_t> m_HistoryEntries{ 0 }; // Both stacks, for metrics scraped off-thread
+    std::atomic<size_t> m_HistoryBytes{ 0 };
     std::array<float, 3> m_CurrentColor = { 0.0f, 0.0f, 0.0f }; // Drawing color
     std::array<float, 3> m_CanvasColor = { 1.0f, 1.0f, 1.0f };  // Canvas background color
     float m_CurrentThickness = 2.0f;
     bool isDrawing = false;
     bool showCanvas = true;
     bool isDragging = false;
-    ImVec2 m_Offset = ImVec2(0.0f, 0.0f); // Canvas offset for panning
+    CanvasPoint m_Camera; // Canvas point at the window's top-left corner, moved by panning
     ImVec2 m_LastMousePos = ImVec2(0.0f, 0.0f); // Last mouse position for panning
     float m_Zoom = 1.0f; // Zoom level
+    ImVec2 m_ViewSize = ImVec2(0.0f, 0.0f); // Canvas window size, for the viewport rect
+
+    // Stroke being drawn; only added to m_Strokes once the mouse is released
+    Stroke m_ActiveStroke;
+    std::vector<StrokePtr> m_GesturePieces; // Earlier pieces of the same gesture, split off at tile edges
+    StrokeKind m_Tool = StrokeKind::Freehand;
+    CanvasPoint m_ShapeStart; // Where the shape being dragged was started
+
+    // Select tool: a box or lasso picks strokes by their bounds, then dragging
+    // the selection moves it and dragging a corner handle resizes it. Only an
+    // outline follows the mouse; the strokes move once on release.
+    enum class SelectDrag { None, Marquee, Move, Scale };
+    bool m_Selecting = false;
+    bool m_LassoSelect = false;
+    std::vector<uint64_t> m_Selection;
+    SelectDrag m_SelectDrag = SelectDrag::None;
+    std::vector<CanvasPoint> m_Lasso;  // Marquee corners, or the lasso's outline
+    std::vector<ImVec2> m_LassoOutline; // m_Lasso on screen; kept between frames to reuse its buffer
+    CanvasPoint m_DragStart;
+    CanvasPoint m_DragCurrent;
+    CanvasPoint m_ScalePivot;          // Corner opposite the handle being dragged
+
+    // Stroke ids are unique per peer: random site id in the high bits, counter in the low bits
+    uint64_t m_SiteId = 0;
+    uint64_t m_NextStrokeId = 1;
+
+    // Local edits not yet handed to the network
+    std::vector<BoardOp> m_PendingOps;
+    bool m_CanvasColorChanged = false;
+
+    // Client-side prediction: local ops are shown at once and kept here until the
+    // host acknowledges them, so remote ops can be ordered in front of them
+    bool m_Predicting = false;
+    uint64_t m_NextClientSeq = 1;
+    std::deque<BoardOp> m_Unacked;
+
+    // GPU stroke rendering
+    StrokeRenderer m_StrokeRenderer;
+    bool m_UseGpuRenderer = true;
+    uint64_t m_Revision = 0; // Bumped whenever m_Strokes is edited other than by appending
+
+    // Stroke id -> position in m_Strokes, rebuilt when the revision changes and extended on append
+    std::unordered_map<uint64_t, size_t> m_StrokeIndex;
+    uint64_t m_IndexRevision = 0;
+    size_t m_IndexedStrokes = 0;
+    std::vector<StrokePtr> m_Moved; // Strokes given a new transform since takeMoved()
+    CanvasPoint m_RenderAnchor; // GPU positions are relative to this
+
+    // Memory budget for resident strokes. Once over it, regions away from every
+    // active area are paged out, least recently viewed first.
+    int m_MemoryBudgetMB = 512;
+    uint64_t m_NextOrder = 1;                  // Next stacking position
+    std::atomic<size_t> m_ResidentBytes{ 0 };  // Held by m_Strokes
+    std::atomic<size_t> m_PagedStrokes{ 0 };   // Mirrors the pager, for metrics
+    std::vector<Rect> m_ActiveAreas;           // Kept resident besides our own view
+    std::vector<Rect> m_PagingAreas;           // Active areas plus our view, reused every frame
+    std::map<BoardPager::RegionKey, uint64_t> m_RegionUse; // Last paging tick a region was in an active area
+    uint64_t m_PagingTick = 0;
+    bool m_PagedIn = false;
+    BoardPager m_Pager;
+
+    // Paged out strokes wanted back for a reason of our own, and the regions
+    // holding them, loaded a few per tick. Ids that turned up or went away are
+    // settled on the next tick.
+    std::unordered_map<uint64_t, StrokeTransform> m_PagedTransforms; // Applied once resident
+    std::unordered_set<uint64_t> m_Requested; // By peers, handed out by takeFetched()
+    std::unordered_set<uint64_t> m_Announce;  // Brought back by undoing a clear, sent to peers
+    std::set<BoardPager::RegionKey> m_FetchRegions;
+    std::vector<uint64_t> m_Arrived;
+    std::vector<Stroke> m_Fetched;
+    std::vector<uint64_t> m_FetchGone;
+
+    // Hash tree over every stroke, paged out ones included, for anti-entropy checks
+    BoardDigest m_Digest;
+
+    // Only this object's thread edits the board. Everyone else reads the last
+    // published document, handed over without a lock and never modified afterwards.
+    uint64_t m_Version = 0; // Bumped on every edit
+    DocumentHandoff m_Document{ std::make_shared<const BoardDocument>() };
+
+    // CPU stroke geometry for the ImGui draw list path
+    ThreadPool m_Workers;
+    StrokeTessellator m_Tessellator{ m_Workers };
+
+    // Pasted images: pixels in the local blob cache, textures decoded off the UI thread
+    BlobStore m_BlobStore;
+    ImageCache m_ImageCache{ m_BlobStore };
+
+    // Background PNG/SVG export
+    Exporter m_Exporter{ m_BlobStore };
+    char m_ExportPath[260] = "board.png";
+    int m_ExportFormat = 0; // 0 = PNG, 1 = SVG
+    float m_ExportScale = 1.0f;
+    std::string m_ExportStatus; // Reused every frame
 
     // Private helper functions
-    void saveState();
-    ImVec2 screenToCanvas(const ImVec2& screenPos, const ImVec2& windowPos);
-    ImVec2 canvasToScreen(const ImVec2& canvasPos, const ImVec2& windowPos);
-    std::string serialize() const;
+    void recordHistory(HistoryEntry entry);
+    void addStrokes(const std::vector<Stroke>& strokes);
+    void addStrokes(const std::vector<StrokePtr>& strokes);
+    void removeStrokes(const std::vector<uint64_t>& ids, bool forgetPaged = true);
+    void clearStrokes();
+    void transformStrokes(const std::vector<uint64_t>& ids, const std::vector<StrokeTransform>& transforms);
+    void moveStrokes(const std::vector<uint64_t>& ids, const std::vector<StrokeTransform>& transforms);
+    const std::unordered_map<uint64_t, size_t>& strokeIndex();
+    void restorePaged(std::vector<StrokePtr> strokes);
+    bool fetch(uint64_t id);
+    bool isFetching(uint64_t id) const;
+    void resolveFetches();
+    void clearBoard(HistoryEntry& entry);
+    void dropHistory(const HistoryEntry& entry);
+    void evictColdRegions(const std::vector<Rect>& keep);
+    void trimHistory();
+    static bool overlaps(const BoardOp& remote, const BoardOp& local);
+    void replayUnacked(const BoardOp& remote);
+    void addImages(const std::vector<BoardImage>& images);
+    void applyHistoryStep(const std::vector<StrokePtr>& dropStrokes, const std::vector<BoardImage>& dropImages,
+        const std::vector<StrokePtr>& restoreStrokes, const std::vector<BoardImage>& restoreImages);
+    void beginStroke();
+    void continueStroke(const CanvasPoint& canvasPos);
+    bool restartStroke(const CanvasPoint& from, const CanvasPoint& to);
+    void dragShape(const CanvasPoint& end);
+    void closePiece();
+    void finishStroke();
+    void pasteImage(const CanvasPoint& canvasPos);
+    Rect selectionBounds();
+    StrokeTransform selectionDragTransform() const;
+    void dragSelection(const CanvasPoint& canvasPos);
+    void finishSelectionDrag();
+    void selectInMarquee();
+    uint64_t strokeAt(const CanvasPoint& canvasPos) const;
+    void transformSelection(const StrokeTransform& change);
+    void drawSelection(ImDrawList* drawList, const ImVec2& windowPos);
+    void drawImages(ImDrawList* drawList, const ImVec2& windowPos, const std::vector<BoardImage>& images);
+    void drawExportSection();
+    CanvasPoint screenToCanvas(const ImVec2& screenPos, const ImVec2& windowPos);
+    ImVec2 canvasToScreen(const CanvasPoint& canvasPos, const ImVec2& windowPos);
+    void serialize(const std::function<void(std::string)>& write);
     void deserialize(const std::string& node);
 
 public:
 
-    Whiteboard() = default;
+    Whiteboard();
     ~Whiteboard() = default;
 
 
@@ -53,19 +223,90 @@ public:
     void Undo();
     void redo();
     void init();
+    void shutdown();
 
     void renderCanvas();
     void drawToolWindow();
 
     void handleNetworkMessage(const std::string& message);
 
-    // Get data that needs to be sent over network
-    std::string getUpdateData(); 
+    // Applies an op received from another peer. Remote ops never enter local history.
+    void applyOp(const BoardOp& op);
+
+    // Applies an authoritative op from the host on top of the board, then puts back
+    // whatever of the unacknowledged local ops it touched
+    void applyRemoteOp(const BoardOp& op);
+
+    // Does the work of applying a snapshot that does not need the board; safe from any thread
+    static StagedSnapshot stageSnapshot(BoardOp op);
+
+    // applyRemoteOp() for a snapshot staged with stageSnapshot()
+    void applyRemoteSnapshot(StagedSnapshot staged);
+
+    // Replaces ops with the ops for local edits made since the last call, in order,
+    // numbered with clientSeq. Passing the same vector every frame reuses its memory.
+    void takeLocalOps(std::vector<BoardOp>& ops);
+
+    // Clients predict: taken ops stay pending until acknowledge() confirms them
+    void setPredicting(bool predicting) { m_Predicting = predicting; }
+    void acknowledge(uint64_t clientSeq);
+    const std::deque<BoardOp>& getUnackedOps() const { return m_Unacked; }
+
+    // Applies a recorded local op as if it had just been drawn, for replays
+    void replayLocalOp(const BoardOp& op);
+
+    // The whole board as a snapshot message of what is in memory, followed by
+    // one message per paged out region
+    void getUpdateData(const std::function<void(std::string)>& write);
+
+    // Canvas-space rectangle currently visible in the Canvas window
+    Rect getViewportRect() const;
+
+    // Pages regions in and out around the view and the active areas. Call once a frame.
+    void updatePaging();
+
+    void setMemoryBudget(int megabytes) { m_MemoryBudgetMB = megabytes; trimHistory(); }
+    size_t getResidentBytes() const { return m_ResidentBytes; }
+    size_t getPagedStrokes() const { return m_PagedStrokes; }
+
+    // Host: areas clients look at, which stay resident like our own view
+    void setActiveAreas(std::span<const Rect> areas) { m_ActiveAreas.assign(areas.begin(), areas.end()); }
+
+    // Whether strokes were paged back in since the last call
+    bool takePagedIn() { return std::exchange(m_PagedIn, false); }
+
+    // Strokes moved or resized since the last call, which may now be in view of other clients
+    std::vector<StrokePtr> takeMoved();
+
+    // Publishes the board if it changed since the last call and returns it.
+    // Only call this from the thread that edits the board.
+    DocumentPtr publish();
+
+    // Last published board; safe from any thread
+    DocumentPtr getDocument() const { return m_Document.load(); }
 
     //Getters and Setters for the Networking class
-    std::vector<Stroke> getStrokes() const { return m_Strokes; }
-    std::stack<std::vector<Stroke>> getUndoStack() const { return m_UndoStack; }
-    std::stack<std::vector<Stroke>> getRedoStack() const { return m_RedoStack; }
+    const std::vector<BoardImage>& getImages() const { return m_Images; }
+    BlobStore& getBlobStore() { return m_BlobStore; }
+
+    // Appends board size, paging and history memory; safe from any thread
+    void writeMetrics(MetricsWriter& writer) const;
+
+    // Hash of the board contents, paged out strokes included, for checking replays.
+    // Strokes are hashed one by one and summed, so the order they are read in, and
+    // the stacking order, do not matter.
+    uint64_t getChecksum();
+
+    const BoardDigest& getDigest() const { return m_Digest; }
+
+    // Sorts ids into strokes in memory, ids on the board no more, and ids paged
+    // out. Those are read back in the background and handed out by takeFetched().
+    void findStrokes(const std::vector<uint64_t>& ids, std::vector<Stroke>& found,
+        std::vector<uint64_t>& gone, std::vector<uint64_t>& paged);
+    void takeFetched(std::vector<Stroke>& found, std::vector<uint64_t>& gone);
+
+    // Images whose pixels are not cached yet, optionally only those in view
+    std::vector<BoardImage> getMissingBlobs(bool visibleOnly) const;
 
     // Getter and Setter declarations
 
@@ -76,7 +317,7 @@ public:
     void setCurrentColor(const std::array<float, 3>& newColor) { m_CurrentColor = newColor; }
 
     const std::array<float, 3>& getCanvasColor() const { return m_CanvasColor; }
-    void setCanvasColor(const std::array<float, 3>& newColor) { m_CanvasColor = newColor; }
+    void setCanvasColor(const std::array<float, 3>& newColor) { m_CanvasColor = newColor; ++m_Version; }
 
     float getCurrentThickness() const { return m_CurrentThickness; }
     void setCurrentThickness(float newThickness) { m_CurrentThickness = newThickness; }
@@ -0,0 +1,227 @@
+// Repair bandwidth of the anti-entropy check versus board size.
+// Builds a host board and a client copy that differs from it in a few strokes,
+// runs the same digest exchange a client runs against its host, and compares
+// the bytes it took with resending the whole board as a snapshot. Every run
+// checks that the client ends up with exactly the host's strokes.
+//
+//   LinkVueDigestBench [--max <strokes>] [--seed <n>]
+
+#include "BoardDigest.h"
+#include "InterestManager.h"
+#include "Protocol.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    const ClientId CLIENT = 1;
+
+    // One side of the exchange: its strokes and the digest over them
+    struct Board {
+        std::map<uint64_t, Stroke> strokes;
+        BoardDigest digest;
+
+        void add(const Stroke& stroke)
+        {
+            strokes[stroke.id] = stroke;
+            digest.add(stroke);
+        }
+
+        void remove(uint64_t id)
+        {
+            strokes.erase(id);
+            digest.remove(id);
+        }
+    };
+
+    Stroke randomStroke(std::mt19937_64& rng, uint64_t id)
+    {
+        Stroke stroke;
+        stroke.id = id;
+        stroke.color = { float(rng() % 256) / 255.0f, float(rng() % 256) / 255.0f, float(rng() % 256) / 255.0f };
+        stroke.thickness = 1.0f + float(rng() % 8);
+        CanvasPoint at{ double(rng() % 200000) - 100000.0, double(rng() % 200000) - 100000.0 };
+        size_t points = 16 + rng() % 48;
+        for (size_t i = 0; i < points; i++) {
+            at.x += double(int(rng() % 9) - 4);
+            at.y += double(int(rng() % 9) - 4);
+            stroke.addPoint(at);
+        }
+        return stroke;
+    }
+
+    // Round trips through the codec like a real message, counting its size
+    BoardOp transfer(const BoardOp& op, size_t& bytes)
+    {
+        std::string message = encodeOp(op);
+        bytes += message.size();
+        BoardOp received;
+        decodeOp(message, received);
+        return received;
+    }
+
+    struct Result {
+        int roundTrips = 0;
+        size_t bytesUp = 0;
+        size_t bytesDown = 0;
+        size_t fetched = 0;
+        size_t dropped = 0;
+        double seconds = 0.0;
+    };
+
+    // The client side mirrors Application::checkDigest and handleDigest, the host
+    // side Application's handling of DigestQuery and StrokeRequest
+    Result repair(Board& host, InterestManager& interest, Board& client)
+    {
+        Result result;
+        auto start = Clock::now();
+
+        BoardOp query;
+        query.type = OpType::DigestQuery;
+        query.digestNodes.push_back(BoardDigest::ROOT);
+        query.digestHashes.push_back(client.digest.hashOf(BoardDigest::ROOT));
+        while (!query.digestNodes.empty()) {
+            std::vector<uint32_t> leaves;
+            for (uint32_t node : query.digestNodes) {
+                if (BoardDigest::isLeaf(node)) {
+                    leaves.push_back(node);
+                }
+            }
+            BoardOp reply = transfer(interest.answerDigestQuery(CLIENT, transfer(query, result.bytesUp)), result.bytesDown);
+            result.roundTrips++;
+
+            std::vector<uint64_t> wanted;
+            std::vector<uint64_t> extra;
+            if (!leaves.empty()) {
+                client.digest.compare(leaves, reply.strokeIds, reply.strokeHashes, wanted, extra);
+            }
+            for (uint64_t id : extra) {
+                client.remove(id);
+            }
+            result.dropped += extra.size();
+            if (!wanted.empty()) {
+                BoardOp request;
+                request.type = OpType::StrokeRequest;
+                request.strokeIds = std::move(wanted);
+                request = transfer(request, result.bytesUp);
+
+                BoardOp found;
+                found.type = OpType::AddStrokes;
+                for (uint64_t id : request.strokeIds) {
+                    auto it = host.strokes.find(id);
+                    if (it != host.strokes.end()) {
+                        found.strokes.push_back(it->second);
+                    }
+                }
+                interest.markKnown(CLIENT, found);
+                for (const auto& stroke : transfer(found, result.bytesDown).strokes) {
+                    client.add(stroke);
+                }
+                result.fetched += found.strokes.size();
+            }
+
+            BoardOp next;
+            next.type = OpType::DigestQuery;
+            for (uint32_t node : client.digest.differing(reply.digestNodes, reply.digestHashes)) {
+                next.digestNodes.push_back(node);
+                next.digestHashes.push_back(client.digest.hashOf(node));
+            }
+            query = std::move(next);
+        }
+
+        result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        return result;
+    }
+
+    bool sameStrokes(const Board& a, const Board& b)
+    {
+        if (a.strokes.size() != b.strokes.size()) {
+            return false;
+        }
+        for (const auto& [id, stroke] : a.strokes) {
+            auto it = b.strokes.find(id);
+            if (it == b.strokes.end() || BoardDigest::hashStroke(it->second) != BoardDigest::hashStroke(stroke)) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t maxStrokes = 262144;
+    uint64_t seed = 1;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::strcmp(argv[i], "--max") == 0) {
+            maxStrokes = std::strtoull(argv[i + 1], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--seed") == 0) {
+            seed = std::strtoull(argv[i + 1], nullptr, 10);
+        }
+    }
+
+    std::printf("%10s %8s %6s %12s %12s %14s %10s %10s\n",
+        "strokes", "diverged", "trips", "bytes up", "bytes down", "snapshot", "saved", "ms");
+    bool allMatched = true;
+    for (size_t count = 1024; count <= maxStrokes; count *= 4) {
+        std::mt19937_64 rng(seed + count);
+        Board host;
+        for (size_t i = 0; i < count; i++) {
+            host.add(randomStroke(rng, (uint64_t(1) << 32) | (i + 1)));
+        }
+
+        // What a full resync would cost
+        BoardOp snapshot;
+        snapshot.type = OpType::Snapshot;
+        for (const auto& [id, stroke] : host.strokes) {
+            snapshot.strokes.push_back(stroke);
+        }
+        size_t snapshotBytes = encodeOp(snapshot).size();
+
+        for (size_t diverged : { 0, 1, 10, 100 }) {
+            // The host believes the client holds its whole board
+            InterestManager interest;
+            interest.addClient(CLIENT);
+            interest.markKnown(CLIENT, snapshot);
+            Board client = host;
+
+            // Equal parts strokes the client lost, strokes only it has, and strokes it holds an old version of
+            uint64_t nextExtra = uint64_t(2) << 32;
+            for (size_t i = 0; i < diverged; i++) {
+                auto victim = std::next(client.strokes.begin(), rng() % client.strokes.size());
+                switch (i % 3) {
+                case 0:
+                    client.remove(victim->first);
+                    break;
+                case 1:
+                    client.add(randomStroke(rng, nextExtra++));
+                    break;
+                case 2: {
+                    Stroke changed = victim->second;
+                    changed.color[0] = 1.0f - changed.color[0];
+                    client.add(changed);
+                    break;
+                }
+                }
+            }
+
+            Result result = repair(host, interest, client);
+            bool matched = sameStrokes(host, client) &&
+                client.digest.hashOf(BoardDigest::ROOT) == host.digest.hashOf(BoardDigest::ROOT);
+            allMatched &= matched;
+            std::printf("%10zu %8zu %6d %12zu %12zu %14zu %9.1fx %10.2f%s\n",
+                count, diverged, result.roundTrips, result.bytesUp, result.bytesDown, snapshotBytes,
+                double(snapshotBytes) / double(result.bytesUp + result.bytesDown), result.seconds * 1000.0,
+                matched ? "" : "  MISMATCH");
+        }
+    }
+    return allMatched ? 0 : 1;
+}
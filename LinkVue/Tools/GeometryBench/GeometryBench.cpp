@@ -0,0 +1,171 @@
+// Speed of the point kernels at each SIMD level the CPU supports, against the
+// scalar code. Every level is also checked to give bit for bit the scalar
+// results, over random strokes of every length up to a few vectors and over
+// points far enough apart to saturate the distance filter's 16-bit math.
+//
+//   LinkVueGeometryBench [--points <n>] [--seed <n>]
+
+#include "Geometry.h"
+#include "Stroke.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // Random walk like a drawn stroke, with now and then a jump anywhere in range
+    std::vector<Point> randomPoints(std::mt19937_64& rng, size_t count)
+    {
+        std::vector<Point> points(count);
+        int x = int(rng() % 65536) - 32768;
+        int y = int(rng() % 65536) - 32768;
+        for (auto& point : points) {
+            if (rng() % 64 == 0) {
+                x = int(rng() % 65536) - 32768;
+                y = int(rng() % 65536) - 32768;
+            }
+            else {
+                x = std::clamp(x + int(rng() % 9) - 4, -32768, 32767);
+                y = std::clamp(y + int(rng() % 9) - 4, -32768, 32767);
+            }
+            point = { static_cast<int16_t>(x), static_cast<int16_t>(y) };
+        }
+        return points;
+    }
+
+    // Everything a level produces for one set of points, to compare byte-wise
+    std::string runKernels(const std::vector<Point>& points, float x, float y)
+    {
+        std::string out;
+        auto append = [&out](const void* data, size_t size) {
+            out.append(static_cast<const char*>(data), size);
+        };
+
+        std::vector<float> positions(2 * points.size());
+        transformPoints(points.data(), points.size(), 12.5f, -3.25f, 0.375f, positions.data());
+        append(positions.data(), positions.size() * sizeof(float));
+
+        if (!points.empty()) {
+            Point min;
+            Point max;
+            pointBounds(points.data(), points.size(), min, max);
+            append(&min, sizeof(min));
+            append(&max, sizeof(max));
+        }
+
+        float distance = polylineDistanceSquared(points.data(), points.size(), x, y);
+        append(&distance, sizeof(distance));
+
+        for (int minDistance : { 1, 3, 40, 20000 }) {
+            std::vector<Point> kept(points.size());
+            size_t count = filterByDistance(points.data(), points.size(), minDistance, kept.data());
+            append(&count, sizeof(count));
+            append(kept.data(), count * sizeof(Point));
+        }
+        return out;
+    }
+
+    double timeMs(const std::function<void()>& run)
+    {
+        const int REPEATS = 20;
+        run(); // Warm up
+        auto start = Clock::now();
+        for (int i = 0; i < REPEATS; i++) {
+            run();
+        }
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / REPEATS;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t pointCount = 1 << 20;
+    uint64_t seed = 1;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::strcmp(argv[i], "--points") == 0) {
+            pointCount = std::strtoull(argv[i + 1], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--seed") == 0) {
+            seed = std::strtoull(argv[i + 1], nullptr, 10);
+        }
+    }
+
+    std::vector<SimdLevel> levels;
+    for (SimdLevel level : { SimdLevel::Scalar, SimdLevel::Sse2, SimdLevel::Avx2 }) {
+        if (level <= getSupportedSimdLevel()) {
+            levels.push_back(level);
+        }
+    }
+
+    // Correctness: short strokes exercise every tail length, long ones the loops
+    bool allMatched = true;
+    std::mt19937_64 rng(seed);
+    for (int trial = 0; trial < 2000; trial++) {
+        size_t count = trial < 1000 ? trial % 40 : rng() % 4096;
+        std::vector<Point> points = randomPoints(rng, count);
+        float x = float(int(rng() % 65536) - 32768) + 0.25f;
+        float y = float(int(rng() % 65536) - 32768) - 0.5f;
+
+        setSimdLevel(SimdLevel::Scalar);
+        std::string expected = runKernels(points, x, y);
+        for (SimdLevel level : levels) {
+            setSimdLevel(level);
+            if (runKernels(points, x, y) != expected) {
+                std::printf("MISMATCH: %s, %zu points, seed %llu, trial %d\n",
+                    getSimdLevelName(level), count, static_cast<unsigned long long>(seed), trial);
+                allMatched = false;
+            }
+        }
+    }
+
+    // Speed on one long stroke's worth of points
+    std::vector<Point> points = randomPoints(rng, pointCount);
+    std::vector<float> positions(2 * points.size());
+    std::vector<Point> kept(points.size());
+    float sink = 0.0f;
+
+    struct Kernel {
+        const char* name;
+        std::function<void()> run;
+    };
+    const Kernel kernels[] = {
+        { "transform", [&]() {
+            transformPoints(points.data(), points.size(), 12.5f, -3.25f, 0.375f, positions.data());
+            sink += positions[positions.size() / 2];
+        } },
+        { "bounds", [&]() {
+            Point min;
+            Point max;
+            pointBounds(points.data(), points.size(), min, max);
+            sink += min.x + max.y;
+        } },
+        { "distance", [&]() {
+            sink += polylineDistanceSquared(points.data(), points.size(), 100.25f, -200.5f);
+        } },
+        { "filter", [&]() {
+            sink += float(filterByDistance(points.data(), points.size(), 3, kept.data()));
+        } },
+    };
+
+    std::printf("%zu points\n%10s %8s %10s %10s\n", pointCount, "kernel", "level", "ms", "speedup");
+    for (const Kernel& kernel : kernels) {
+        double scalarMs = 0.0;
+        for (SimdLevel level : levels) {
+            setSimdLevel(level);
+            double ms = timeMs(kernel.run);
+            if (level == SimdLevel::Scalar) {
+                scalarMs = ms;
+            }
+            std::printf("%10s %8s %10.3f %9.2fx\n", kernel.name, getSimdLevelName(level), ms, scalarMs / ms);
+        }
+    }
+    std::printf("%s (%g)\n", allMatched ? "All levels match scalar" : "MISMATCH", sink);
+    return allMatched ? 0 : 1;
+}
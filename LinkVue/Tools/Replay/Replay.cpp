@@ -0,0 +1,190 @@
+// Headless replay of a session recording.
+// Re-drives a Whiteboard through every recorded op, either as fast as possible or
+// paced by the recorded timestamps, then reports what each op type cost to apply
+// and whether the final board matches the checksum taken when recording stopped.
+//
+//   LinkVueReplay <recording> [--speed <factor>]
+//
+// Without --speed the ops are applied back to back; --speed 1 plays in real time.
+
+#include "Whiteboard.h"
+#include "Protocol.h"
+#include "SessionRecording.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    struct OpStats {
+        std::vector<double> micros;
+        double total = 0.0;
+    };
+
+    double percentile(std::vector<double>& samples, double fraction)
+    {
+        if (samples.empty()) {
+            return 0.0;
+        }
+        size_t index = std::min(samples.size() - 1, static_cast<size_t>(fraction * samples.size()));
+        std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+        return samples[index];
+    }
+
+    // Ops the application consumes itself instead of applying to the board
+    bool isBoardOp(OpType type)
+    {
+        switch (type) {
+        case OpType::Viewport:
+        case OpType::BlobRequest:
+        case OpType::BlobChunk:
+        case OpType::Hello:
+        case OpType::Welcome:
+        case OpType::DigestQuery:
+        case OpType::Digest:
+        case OpType::StrokeRequest:
+            return false;
+        default:
+            return true;
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s <recording> [--speed <factor>]\n", argv[0]);
+        return 2;
+    }
+
+    double speed = 0.0;
+    for (int i = 2; i + 1 < argc; i++) {
+        if (std::strcmp(argv[i], "--speed") == 0) {
+            speed = std::atof(argv[i + 1]);
+        }
+    }
+
+    // A client recording is one that received a Welcome; clients predict their own ops
+    bool isClient = false;
+    {
+        SessionReader scan;
+        if (!scan.open(argv[1])) {
+            std::fprintf(stderr, "%s is not a session recording\n", argv[1]);
+            return 2;
+        }
+        RecordEntry entry;
+        BoardOp op;
+        while (!isClient && scan.next(entry)) {
+            isClient = entry.kind == RecordKind::Inbound && entry.payload.find("welcome") != std::string::npos &&
+                decodeOp(entry.payload, op) && op.type == OpType::Welcome;
+        }
+    }
+
+    SessionReader reader;
+    reader.open(argv[1]);
+
+    Whiteboard board;
+    board.setPredicting(isClient);
+    std::map<std::string, OpStats> stats;
+    uint64_t lastSeq = 0;
+    uint64_t outboundMessages = 0;
+    uint64_t outboundBytes = 0;
+    uint64_t inboundBytes = 0;
+    bool hasChecksum = false;
+    uint64_t expectedChecksum = 0;
+
+    RecordEntry entry;
+    Clock::time_point start = Clock::now();
+    while (reader.next(entry)) {
+        if (speed > 0.0) {
+            auto due = start + std::chrono::microseconds(static_cast<int64_t>(entry.timeMicros / speed));
+            std::this_thread::sleep_until(due);
+        }
+
+        switch (entry.kind) {
+        case RecordKind::Outbound:
+            outboundMessages++;
+            outboundBytes += entry.payload.size();
+            break;
+
+        case RecordKind::Checksum:
+            hasChecksum = entry.payload.size() == 8;
+            expectedChecksum = 0;
+            for (size_t i = 0; i < entry.payload.size() && i < 8; i++) {
+                expectedChecksum |= static_cast<uint64_t>(static_cast<uint8_t>(entry.payload[i])) << (i * 8);
+            }
+            break;
+
+        case RecordKind::Inbound:
+        case RecordKind::LocalOp: {
+            if (entry.kind == RecordKind::Inbound) {
+                inboundBytes += entry.payload.size();
+            }
+
+            // Decoding is part of the cost, as it is in the application
+            Clock::time_point opStart = Clock::now();
+            BoardOp op;
+            if (!decodeOp(entry.payload, op) || !isBoardOp(op.type)) {
+                break;
+            }
+            if (entry.kind == RecordKind::Inbound && op.seq != 0) {
+                if (op.seq <= lastSeq) {
+                    break;
+                }
+                lastSeq = op.seq;
+            }
+            if (entry.kind == RecordKind::LocalOp) {
+                board.replayLocalOp(op);
+            }
+            else if (op.type == OpType::Ack) {
+                board.acknowledge(op.clientSeq);
+            }
+            else if (isClient) {
+                board.applyRemoteOp(op);
+            }
+            else {
+                board.applyOp(op);
+            }
+            double micros = std::chrono::duration<double, std::micro>(Clock::now() - opStart).count();
+
+            OpStats& opStats = stats[opTypeName(op.type)];
+            opStats.micros.push_back(micros);
+            opStats.total += micros;
+            break;
+        }
+        }
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::printf("%-10s %8s %12s %10s %10s %10s\n", "op", "count", "total ms", "p50 us", "p99 us", "max us");
+    for (auto& [name, opStats] : stats) {
+        double maximum = *std::max_element(opStats.micros.begin(), opStats.micros.end());
+        std::printf("%-10s %8zu %12.3f %10.1f %10.1f %10.1f\n", name.c_str(), opStats.micros.size(),
+            opStats.total / 1000.0, percentile(opStats.micros, 0.5), percentile(opStats.micros, 0.99), maximum);
+    }
+    std::printf("\nrecorded %.3f s, replayed in %.3f s\n", entry.timeMicros / 1e6, elapsed);
+    std::printf("inbound %llu bytes, outbound %llu messages / %llu bytes\n",
+        static_cast<unsigned long long>(inboundBytes), static_cast<unsigned long long>(outboundMessages),
+        static_cast<unsigned long long>(outboundBytes));
+    std::printf("strokes %zu, images %zu\n", board.publish()->strokes.size(), board.getImages().size());
+
+    uint64_t checksum = board.getChecksum();
+    std::printf("checksum %016llx", static_cast<unsigned long long>(checksum));
+    if (!hasChecksum) {
+        std::printf(" (recording has no final checksum)\n");
+        return 0;
+    }
+    if (checksum != expectedChecksum) {
+        std::printf(" MISMATCH, recorded %016llx\n", static_cast<unsigned long long>(expectedChecksum));
+        return 1;
+    }
+    std::printf(" matches recording\n");
+    return 0;
+}